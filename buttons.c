@@ -7,92 +7,82 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include "buttons.h"
+#include "timer0.h"
+#include "input.h"
 
-// Global variable to keep track of the last button state so that we 
-// can detect changes when an interrupt fires. The lower 4 bits (0 to 3)
-// will correspond to the last state of port B pins 0 to 3.
-static volatile uint8_t last_button_state;
+#define BUTTON_MASK 0x0F
 
-// Our button queue. button_queue[0] is always the head of the queue. If we
-// take something off the queue we just move everything else along. We don't
-// use a circular buffer since it is usually expected that the queue is very
-// short. In most uses it will never have more than 1 element at a time.
-// This button queue can be changed by the interrupt handler below so we should
-// turn off interrupts if we're changing the queue outside the handler.
-#define BUTTON_QUEUE_SIZE 4
-static volatile uint8_t button_queue[BUTTON_QUEUE_SIZE];
-static volatile int8_t queue_length;
+// Debounced state of the buttons (bit n set if button n is down).
+static uint8_t button_state;
 
-// Setup interrupt if any of pins B0 to B3 change. We do this
-// using a pin change interrupt. These pins correspond to pin
-// change interrupts PCINT8 to PCINT11 which are covered by
-// Pin change interrupt 1.
-void init_button_interrupts(void) {
-	// Enable the interrupt (see datasheet page 91)
-	PCICR |= (1<<PCIE1);
-	
-	// Make sure the interrupt flag is cleared (by writing a 
-	// 1 to it) (see datasheet page 92)
-	PCIFR |= (1<<PCIF1);
-	
-	// Choose which pins we're interested in by setting
-	// the relevant bits in the mask register (see datasheet page 94)
-	PCMSK1 |= (1<<PCINT8)|(1<<PCINT9)|(1<<PCINT10)|(1<<PCINT11);	
-	
-	// Empty the button push queue
-	queue_length = 0;
+// Vertical counter - bit n of count0 and count1 form a two bit counter
+// for button n. The counter is reset while the button reads the same as
+// its debounced state and counts the samples that differ otherwise. When
+// it wraps (after BUTTON_DEBOUNCE_SAMPLES samples) the debounced state
+// changes. All four buttons are handled at once with bitwise operations,
+// so the cost is the same however many buttons change.
+static uint8_t count0 = 0xFF, count1 = 0xFF;
+
+// Auto repeat. repeat_count counts down the ticks until the held buttons
+// next repeat. It restarts whenever no button is held.
+static volatile uint16_t repeat_delay = 500;
+static volatile uint16_t repeat_interval = 100;
+static uint16_t repeat_count;
+
+#if BUTTON_DEBOUNCE_SAMPLES != 4
+#error "The two bit vertical counter debounces over 4 samples"
+#endif
+
+void init_buttons(void) {
+	// Buttons are inputs
+	DDRB &= ~BUTTON_MASK;
 }
 
-int8_t button_pushed(void) {
-	int8_t return_value = NO_BUTTON_PUSHED;	// Assume no button pushed
-	if(queue_length > 0) {
-		// Remove the first element off the queue and move all the other
-		// entries closer to the front of the queue. We turn off interrupts (if on)
-		// before we make any changes to the queue. If interrupts were on
-		// we turn them back on when done.
-		return_value = button_queue[0];
-		
-		// Save whether interrupts were enabled and turn them off
-		int8_t interrupts_were_enabled = bit_is_set(SREG, SREG_I);
-		cli();
-		
-		for(uint8_t i = 1; i < queue_length; i++) {
-			button_queue[i-1] = button_queue[i];
-		}
-		queue_length--;
-		
-		if(interrupts_were_enabled) {
-			// Turn them back on again
-			sei();
+void set_button_repeat(uint16_t delay_ms, uint16_t interval_ms) {
+	// The repeat counter counts down to 0 - it can't start at 0
+	if(delay_ms == 0) {
+		delay_ms = 1;
+	}
+	if(interval_ms == 0) {
+		interval_ms = 1;
+	}
+	uint8_t interrupts_were_enabled = begin_critical_section();
+	repeat_delay = delay_ms;
+	repeat_interval = interval_ms;
+	end_critical_section(interrupts_were_enabled);
+}
+
+// Add events for the given buttons to the input queue.
+static void post_events(uint8_t buttons, uint8_t type) {
+	for(uint8_t pin = 0; buttons; pin++, buttons >>= 1) {
+		if(buttons & 1) {
+			input_post(INPUT_BUTTON, type | pin);
 		}
 	}
-	return return_value;
 }
 
-// Interrupt handler for a change on buttons
-ISR(PCINT1_vect) {
-	// Get the current state of the buttons. We'll compare this with
-	// the last state to see what has changed.
-	uint8_t button_state = PINB & 0x0F;
+void sample_buttons(void) {
+	uint8_t changed = (PINB & BUTTON_MASK) ^ button_state;
 	
-	// Toggle between button down an
-	button_down = !button_down;
+	// Count the buttons that differ from their debounced state (and
+	// reset the others). changed is left with the buttons whose counter
+	// wrapped.
+	count0 = ~(count0 & changed);
+	count1 = count0 ^ (count1 & changed);
+	changed &= count0 & count1;
+	button_state ^= changed;
 	
-	// Iterate over all the buttons and see which ones have changed.
-	// Any button pushes are added to the queue of button pushes (if
-	// there is space). We ignore button releases so we're just looking
-	// for a transition from 0 in the last_button_state bit to a 1 in the 
-	// button_state.
-	for(uint8_t pin=0; pin<=3; pin++) {
-		if(queue_length < BUTTON_QUEUE_SIZE && 
-				(button_state & (1<<pin)) && 
-				!(last_button_state & (1<<pin))) {
-			// Add the button push to the queue (and update the
-			// length of the queue
-			button_queue[queue_length++] = pin;
-		}
+	// The repeat delay starts again when no buttons are held or a new
+	// button is pushed. All held buttons repeat together.
+	if(button_state == 0 || (changed & button_state)) {
+		repeat_count = repeat_delay;
+	} else if(--repeat_count == 0) {
+		repeat_count = repeat_interval;
+		post_events(button_state & ~changed, BUTTON_EVENT_REPEAT);
 	}
 	
-	// Remember this button state
-	last_button_state = button_state;
-}
\ No newline at end of file
+	if(changed) {
+		post_events(changed & button_state, BUTTON_EVENT_PRESS);
+		post_events(changed & ~button_state, BUTTON_EVENT_RELEASE);
+	}
+}
@@ -3,8 +3,11 @@
  *
  * Author: Peter Sutton
  *
- * We assume four push buttons (B0 to B3) are connected to pins B0 to B3. We configure
- * pin change interrupts on these pins.
+ * We assume four push buttons (B0 to B3) are connected to pins B0 to B3. The
+ * pins are sampled every timer 0 tick (see sample_buttons()) and debounced - a
+ * button must read the same for BUTTON_DEBOUNCE_SAMPLES ticks in a row before
+ * it is considered pushed or released. Button events are added to the input
+ * queue (see input.h).
  */ 
 
 
@@ -13,24 +16,28 @@
 
 #include <stdint.h>
 
-#define NO_BUTTON_PUSHED (-1)
+#define BUTTON_DEBOUNCE_SAMPLES 4
 
-/* Set up pin change interrupts on pins B0 to B3.
- * It is assumed that global interrupts are off when this function is called
- * and are enabled sometime after this function is called.
- */
-void init_button_interrupts(void);
+// Button event codes are the button number (0 to 3) combined with one of these
+#define BUTTON_EVENT_PRESS 0x00
+#define BUTTON_EVENT_RELEASE 0x10
+#define BUTTON_EVENT_REPEAT 0x20
+#define BUTTON_EVENT_TYPE_MASK 0x30
+#define BUTTON_EVENT_BUTTON_MASK 0x03
 
-/* Return the last button pushed (0 to 3) or -1 (NO_BUTTON_PUSHED) if 
- * there are no button pushes to return. (A small queue of button pushes
- * is kept. This function should be called frequently enough to
- * ensure the queue does not overflow. Excess button pushes are
- * discarded.)
+/* Set up pins B0 to B3 as inputs. The buttons are sampled by the timer 0
+ * interrupt from then on.
  */
+void init_buttons(void);
 
-int8_t button_pushed(void);
+/* Set the auto repeat delay (the time a button must be held before it
+ * starts repeating) and the time between repeats, in ms.
+ */
+void set_button_repeat(uint16_t delay_ms, uint16_t interval_ms);
 
-// A variable to track the current state of the button.
-volatile int button_down;
+/* Sample and debounce the buttons. This is called from the timer 0
+ * interrupt handler once every tick.
+ */
+void sample_buttons(void);
 
-#endif /* BUTTONS_H_ */
\ No newline at end of file
+#endif /* BUTTONS_H_ */
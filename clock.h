@@ -0,0 +1,118 @@
+/*
+ * clock.h
+ *
+ * Author: Xinyi Li
+ *
+ * System clock configuration. Every value that depends on the clock
+ * speed - timer prescalers and compare values, the UART baud rate
+ * divisor, tone periods and the ADC prescaler - is calculated here from
+ * F_CPU at compile time. To run the board at a different speed define
+ * F_CPU on the compiler command line (e.g. -DF_CPU=16000000UL). 8MHz is
+ * the internal oscillator; 16MHz and 20MHz need an external crystal
+ * (and the fuses set to use it).
+ *
+ * The checks below fail the build if a derived value would be out of
+ * range or too inaccurate at the chosen clock speed.
+ */
+
+#ifndef CLOCK_H_
+#define CLOCK_H_
+
+#ifndef F_CPU
+#define F_CPU 8000000UL
+#endif
+
+#if F_CPU != 8000000UL && F_CPU != 16000000UL && F_CPU != 20000000UL
+#error "Unsupported F_CPU - the supported clock speeds are 8, 16 and 20MHz"
+#endif
+
+/* Timer 0 generates our 1ms tick. We use the smallest prescaler that lets
+ * the 8 bit counter reach a whole millisecond. (At 20MHz the tick can't
+ * be exact - it is 998.4us.)
+ */
+#if F_CPU / 64 / 1000 <= 256
+#define TIMER0_PRESCALER 64
+#else
+#define TIMER0_PRESCALER 256
+#endif
+#define TIMER0_COUNTS_PER_TICK ((F_CPU / TIMER0_PRESCALER + 500) / 1000)
+
+// Tick error in parts per million - must be less than 0.5%
+#define TIMER0_TICK_ERROR_PPM \
+	(((TIMER0_COUNTS_PER_TICK * TIMER0_PRESCALER * 1000 > F_CPU) ? \
+	(TIMER0_COUNTS_PER_TICK * TIMER0_PRESCALER * 1000 - F_CPU) : \
+	(F_CPU - TIMER0_COUNTS_PER_TICK * TIMER0_PRESCALER * 1000)) / (F_CPU / 1000000))
+#if TIMER0_COUNTS_PER_TICK > 256 || TIMER0_TICK_ERROR_PPM > 5000
+#error "Can't generate a 1ms tick with timer 0 at this clock speed"
+#endif
+
+/* Microseconds per timer 0 count, as a fixed point number with 8
+ * fractional bits. This is scaled to the tick so that a whole tick of
+ * counts is 1000us.
+ */
+#define TIMER0_US_PER_COUNT_Q8 ((1000UL * 256 + TIMER0_COUNTS_PER_TICK / 2) / TIMER0_COUNTS_PER_TICK)
+
+/* Timer 2 runs freely at F_CPU/1024 as a reference for detecting lost
+ * timer 0 ticks. TIMER0_TICK_Q8 and TIMER0_COUNT_Q8 are the length of
+ * a tick and of a timer 0 count in timer 2 counts, as fixed point numbers
+ * with 8 fractional bits. (Both are exact for the supported clocks.)
+ * Timer 2 wraps every 256 counts (32.8ms at 8MHz) - lost ticks can only
+ * be detected if the tick interrupt is delayed by less than this.
+ */
+#define TIMER2_PRESCALER 1024
+#define TIMER0_TICK_Q8 (TIMER0_PRESCALER * TIMER0_COUNTS_PER_TICK * 256UL / TIMER2_PRESCALER)
+#define TIMER0_COUNT_Q8 (TIMER0_PRESCALER * 256UL / TIMER2_PRESCALER)
+
+/* Timer 1 generates tones. It is clocked at F_CPU/8 and the period of a
+ * tone is given in timer 1 counts, so the lowest tone we play (100Hz)
+ * must fit in 16 bits.
+ */
+#define TIMER1_PRESCALER 8
+#define TIMER1_HZ (F_CPU / TIMER1_PRESCALER)
+#if TIMER1_HZ / 100 > 65535
+#error "Timer 1 prescaler too small for the lowest tone at this clock speed"
+#endif
+
+/* The ADC clock must be between 50kHz and 200kHz. ADC_PRESCALER_SELECT
+ * is the value of the ADPS bits for ADC_PRESCALER.
+ */
+#if F_CPU / 64 <= 200000
+#define ADC_PRESCALER 64
+#define ADC_PRESCALER_SELECT 6
+#else
+#define ADC_PRESCALER 128
+#define ADC_PRESCALER_SELECT 7
+#endif
+#if F_CPU / ADC_PRESCALER < 50000 || F_CPU / ADC_PRESCALER > 200000
+#error "No ADC prescaler gives a valid ADC clock at this clock speed"
+#endif
+
+/* UART baud rate divisor for the given baud rate in normal speed mode
+ * (and, for the _U2X versions, double speed mode), rounded to the
+ * nearest integer, and the resulting baud rate error in tenths of a
+ * percent. The UART uses whichever mode is more accurate (see
+ * serialio.c). The default baud rate (which can be set on the compiler
+ * command line, e.g. -DSERIAL_BAUD=250000UL) must be accurate to 2% in
+ * one of the modes. Double speed mode allows rates up to F_CPU/8 - e.g.
+ * 250000 and 500000 baud are exact at 8MHz and 16MHz. (115200 baud is
+ * 3.5% out at 8MHz and 2.1% out at 16MHz, so isn't usable at those
+ * speeds.)
+ */
+#ifndef SERIAL_BAUD
+#define SERIAL_BAUD 19200UL
+#endif
+#define SERIAL_MAX_BAUD_ERROR_PERMILLE 20
+#define UBRR_VALUE(baud) (((F_CPU / (8 * (baud))) + 1) / 2 - 1)
+#define UBRR_BAUD(baud) (F_CPU / (16 * (UBRR_VALUE(baud) + 1)))
+#define BAUD_ERROR_PERMILLE(baud) \
+	((UBRR_BAUD(baud) > (baud) ? UBRR_BAUD(baud) - (baud) : (baud) - UBRR_BAUD(baud)) * 1000 / (baud))
+#define UBRR_U2X_VALUE(baud) (((F_CPU / (4 * (baud))) + 1) / 2 - 1)
+#define UBRR_U2X_BAUD(baud) (F_CPU / (8 * (UBRR_U2X_VALUE(baud) + 1)))
+#define BAUD_U2X_ERROR_PERMILLE(baud) \
+	((UBRR_U2X_BAUD(baud) > (baud) ? UBRR_U2X_BAUD(baud) - (baud) : (baud) - UBRR_U2X_BAUD(baud)) * 1000 / (baud))
+#if BAUD_ERROR_PERMILLE(SERIAL_BAUD) > SERIAL_MAX_BAUD_ERROR_PERMILLE && \
+		BAUD_U2X_ERROR_PERMILLE(SERIAL_BAUD) > SERIAL_MAX_BAUD_ERROR_PERMILLE
+#error "Default baud rate can't be generated accurately at this clock speed"
+#endif
+
+#endif /* CLOCK_H_ */
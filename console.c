@@ -0,0 +1,400 @@
+/*
+ * console.c
+ *
+ * Author: Xinyi Li
+ */
+
+#include <avr/pgmspace.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "console.h"
+#include "terminalio.h"
+#include "serialio.h"
+#include "scheduler.h"
+#include "timer0.h"
+#include "project.h"
+#include "input.h"
+#include "record.h"
+#include "latency.h"
+#include "frame.h"
+#include "telemetry.h"
+#include "mirror.h"
+#include "params.h"
+#include "level.h"
+
+#define CONSOLE_LINE_LENGTH 32
+
+// The command being typed. active is set while a command is being typed
+// and ready once Enter has been pressed (until console_task() runs it).
+static char line[CONSOLE_LINE_LENGTH];
+static uint8_t line_length;
+static uint8_t active;
+static uint8_t ready;
+
+// The report being printed: a list of sections (in program memory), each
+// printed a line at a time, the section and line we're up to and the
+// number of lines printed so far.
+typedef uint8_t (*ReportSection)(uint8_t line);
+static const ReportSection* report;
+static uint8_t report_sections;
+static uint8_t report_section;
+static uint8_t report_line;
+static uint8_t report_lines;
+
+// Command handlers. args points to the rest of the line after the
+// command name (with leading spaces removed).
+static void stats_command(char* args);
+static void rec_command(char* args);
+static void replay_command(char* args);
+static void lat_command(char* args);
+static void baud_command(char* args);
+static void tele_command(char* args);
+static void mirror_command(char* args);
+static void params_command(char* args);
+static void get_command(char* args);
+static void set_command(char* args);
+
+typedef struct {
+	const char* name;		// in program memory
+	void (*handler)(char* args);
+} ConsoleCommand;
+
+static const char stats_name[] PROGMEM = "stats";
+static const char rec_name[] PROGMEM = "rec";
+static const char replay_name[] PROGMEM = "replay";
+static const char lat_name[] PROGMEM = "lat";
+static const char baud_name[] PROGMEM = "baud";
+static const char tele_name[] PROGMEM = "tele";
+static const char mirror_name[] PROGMEM = "mirror";
+static const char params_name[] PROGMEM = "params";
+static const char get_name[] PROGMEM = "get";
+static const char set_name[] PROGMEM = "set";
+
+static const ConsoleCommand commands[] PROGMEM = {
+	{ stats_name, stats_command },
+	{ rec_name, rec_command },
+	{ replay_name, replay_command },
+	{ lat_name, lat_command },
+	{ baud_name, baud_command },
+	{ tele_name, tele_command },
+	{ mirror_name, mirror_command },
+	{ params_name, params_command },
+	{ get_name, get_command },
+	{ set_name, set_command }
+};
+#define NUM_COMMANDS (sizeof(commands) / sizeof(commands[0]))
+
+// Start printing a report (from console_task())
+static void start_report(const ReportSection* sections, uint8_t count) {
+	report = sections;
+	report_sections = count;
+	report_section = 0;
+	report_line = 0;
+	report_lines = 0;
+}
+
+static void run_command(void) {
+	char* args = line;
+	// Split the line into the command name and its arguments
+	while(*args && *args != ' ') {
+		args++;
+	}
+	while(*args == ' ') {
+		*args++ = '\0';
+	}
+
+	move_cursor(1, CONSOLE_ROW + 1);
+	for(uint8_t i = 0; i < NUM_COMMANDS; i++) {
+		const char* name = (const char*)pgm_read_word(&commands[i].name);
+		if(strcmp_P(line, name) == 0) {
+			void (*handler)(char*) = (void (*)(char*))pgm_read_word(&commands[i].handler);
+			handler(args);
+			return;
+		}
+	}
+	printf_P(PSTR("Unknown command: %s"), line);
+	clear_to_end_of_line();
+}
+
+// Echo what is typed. (This is never held up by the serial port - see
+// console_input().)
+static void echo_input(char c) {
+	if(!active) {
+		// Start a new command, abandoning whatever is left of the last one
+		active = 1;
+		ready = 0;
+		report = 0;
+		line_length = 0;
+		move_cursor(1, CONSOLE_ROW);
+		clear_to_end_of_line();
+		putchar(CONSOLE_START_CHAR);
+	} else if(c == '\n') {
+		line[line_length] = '\0';
+		active = 0;
+		ready = 1;
+	} else if(c == 8 || c == 127) {
+		// Backspace
+		if(line_length > 0) {
+			line_length--;
+			move_cursor(line_length + 2, CONSOLE_ROW);
+			clear_to_end_of_line();
+		}
+	} else if(line_length < CONSOLE_LINE_LENGTH - 1 && c >= ' ') {
+		// Echo the character in place - the game may have moved the
+		// cursor since the last one.
+		line[line_length++] = c;
+		move_cursor(line_length + 1, CONSOLE_ROW);
+		putchar(c);
+	}
+}
+
+uint8_t console_input(char c) {
+	if(!active && c != CONSOLE_START_CHAR) {
+		return 0;
+	}
+	// The echo is status output, so it is dropped rather than waiting if
+	// the serial port is busy.
+	uint8_t priority = serial_set_priority(SERIAL_STATUS);
+	echo_input(c);
+	serial_set_priority(priority);
+	return 1;
+}
+
+// Print the next line of the report, if there's room for a whole line.
+// Returns 0 once the report has finished.
+static uint8_t report_next_line(void) {
+	if(serial_output_space(SERIAL_DEBUG) < CONSOLE_REPORT_LINE) {
+		return 1;
+	}
+	if(report_lines++) {
+		putchar('\n');
+	}
+	ReportSection section = (ReportSection)pgm_read_word(&report[report_section]);
+	if(section(report_line)) {
+		report_line++;
+	} else {
+		report_line = 0;
+		report_section++;
+	}
+	return report_section < report_sections;
+}
+
+void console_task(void) {
+	uint8_t priority = serial_set_priority(SERIAL_DEBUG);
+	if(ready && serial_output_space(SERIAL_DEBUG) >= CONSOLE_REPORT_LINE) {
+		ready = 0;
+		run_command();
+	}
+	if(report && !report_next_line()) {
+		report = 0;
+	}
+	serial_set_priority(priority);
+}
+
+///////////////////////////////// Commands /////////////////////////////////////
+
+// Report sections for the stats command
+static uint8_t tick_stats(uint8_t line) {
+	static TickStats stats;
+	if(line == 0) {
+		get_tick_stats(&stats);
+		reset_tick_stats();
+		printf_P(PSTR("lost ticks: %lu"), stats.lost_ticks);
+	} else {
+		printf_P(PSTR("max tick latency: %uus, interrupts off: %uus"),
+				stats.max_latency, stats.max_critical_section);
+	}
+	clear_to_end_of_line();
+	return line == 0;
+}
+
+static uint8_t io_stats(uint8_t line) {
+	if(line == 0) {
+		printf_P(PSTR("input events dropped: %u"), input_overflows());
+	} else if(line == 1) {
+		printf_P(PSTR("serial bytes sent: %lu"), serial_bytes_sent());
+	} else if(line == 2) {
+		printf_P(PSTR("status lines: %lu bytes, %lu coalesced"),
+				status_bytes_sent(), status_bytes_coalesced());
+	} else if(line == 3) {
+		printf_P(PSTR("dropped bytes: critical %u status %u debug %u"),
+				serial_dropped_bytes(SERIAL_CRITICAL),
+				serial_dropped_bytes(SERIAL_STATUS),
+				serial_dropped_bytes(SERIAL_DEBUG));
+	} else if(line == 4) {
+		printf_P(PSTR("serial throughput: %lu bytes/s at %lu baud"),
+				serial_bytes_per_second(), serial_baud());
+	} else {
+		printf_P(PSTR("frames received: %u  errors: %u  dropped: %u"),
+				frames_received(), frame_errors(), frames_dropped());
+	}
+	clear_to_end_of_line();
+	return line < 5;
+}
+
+static const ReportSection stats_report[] PROGMEM = {
+	scheduler_print_stats, tick_stats, print_input_latency, io_stats,
+	telemetry_print_stats, mirror_print_stats, level_print_stats
+};
+
+static void stats_command(char* args) {
+	start_report(stats_report, sizeof(stats_report) / sizeof(stats_report[0]));
+}
+
+static const ReportSection rec_dump_report[] PROGMEM = { record_dump };
+
+// rec on|off - record every game from now on (or stop)
+// rec dump - print the recording of the last game
+static void rec_command(char* args) {
+	if(strcmp_P(args, PSTR("on")) == 0) {
+		record_enable(1);
+	} else if(strcmp_P(args, PSTR("off")) == 0) {
+		record_enable(0);
+	} else if(strcmp_P(args, PSTR("dump")) == 0) {
+		start_report(rec_dump_report, 1);
+		return;
+	}
+	printf_P(PSTR("recording %S"), record_enabled() ? PSTR("on") : PSTR("off"));
+	clear_to_end_of_line();
+}
+
+// replay - replay the recording of the last game (as the next game)
+static void replay_command(char* args) {
+	if(replay_request()) {
+		printf_P(PSTR("replaying the recorded game next"));
+	} else {
+		printf_P(PSTR("no complete recording"));
+	}
+	clear_to_end_of_line();
+}
+
+static const ReportSection lat_report[] PROGMEM = { latency_print };
+
+// lat - print input to display latencies
+// lat reset - clear them
+static void lat_command(char* args) {
+	if(strcmp_P(args, PSTR("reset")) == 0) {
+		latency_reset();
+	} else {
+		start_report(lat_report, 1);
+	}
+}
+
+// baud - print the baud rate
+// baud <rate> - change it (the terminal must then be changed to match)
+static void baud_command(char* args) {
+	if(*args) {
+		char* end;
+		uint32_t baud = strtoul(args, &end, 10);
+		if(*end || *args < '0' || *args > '9') {
+			printf_P(PSTR("%s isn't a baud rate"), args);
+		} else if(!serial_baud_supported(baud)) {
+			printf_P(PSTR("%lu baud can't be generated accurately"), baud);
+		} else {
+			// (The message is sent at the old rate - the change happens
+			// once it has gone.)
+			printf_P(PSTR("changing to %lu baud"), baud);
+			clear_to_end_of_line();
+			(void)serial_set_baud(baud);
+			return;
+		}
+		clear_to_end_of_line();
+		return;
+	}
+	printf_P(PSTR("%lu baud"), serial_baud());
+	clear_to_end_of_line();
+}
+
+// tele on|off - send the telemetry stream (or stop)
+static void tele_command(char* args) {
+	if(strcmp_P(args, PSTR("on")) == 0) {
+		telemetry_enable(1);
+	} else if(strcmp_P(args, PSTR("off")) == 0) {
+		telemetry_enable(0);
+	}
+	printf_P(PSTR("telemetry %S"), telemetry_enabled() ? PSTR("on") : PSTR("off"));
+	clear_to_end_of_line();
+}
+
+// mirror on|off - show the LED matrix on the terminal (or stop)
+static void mirror_command(char* args) {
+	if(strcmp_P(args, PSTR("on")) == 0) {
+		mirror_enable(1);
+	} else if(strcmp_P(args, PSTR("off")) == 0) {
+		mirror_enable(0);
+	}
+	printf_P(PSTR("LED matrix mirror %S"), mirror_enabled() ? PSTR("on") : PSTR("off"));
+	clear_to_end_of_line();
+}
+
+static const ReportSection params_report[] PROGMEM = { params_print };
+
+// params - list the game parameters
+// params save|load|defaults - save them to EEPROM, load the saved ones or
+// go back to the defaults
+static void params_command(char* args) {
+	uint8_t save = strcmp_P(args, PSTR("save")) == 0;
+	uint8_t load = strcmp_P(args, PSTR("load")) == 0;
+	// (Loading while a save is being written would read a half written
+	// copy, and another save would start writing over it.)
+	if((save || load) && params_saving()) {
+		printf_P(PSTR("still saving"));
+	} else if(save) {
+		params_save();
+		printf_P(PSTR("saving"));
+	} else if(load) {
+		printf_P(params_load() ? PSTR("loaded") : PSTR("nothing saved - unchanged"));
+	} else if(strcmp_P(args, PSTR("defaults")) == 0) {
+		params_defaults();
+		printf_P(PSTR("defaults"));
+	} else {
+		start_report(params_report, 1);
+		return;
+	}
+	clear_to_end_of_line();
+}
+
+// Split "name value" into the parameter and the value. Returns the
+// parameter, or -1 (having printed a message) if there is no such
+// parameter.
+static int8_t find_param(char* args, char** value) {
+	*value = args;
+	while(**value && **value != ' ') {
+		(*value)++;
+	}
+	while(**value == ' ') {
+		*(*value)++ = '\0';
+	}
+	int8_t index = param_find(args);
+	if(index < 0) {
+		printf_P(PSTR("Unknown parameter: %s"), args);
+		clear_to_end_of_line();
+	}
+	return index;
+}
+
+// get <name> - print a game parameter
+static void get_command(char* args) {
+	char* value;
+	int8_t index = find_param(args, &value);
+	if(index >= 0) {
+		param_print(index);
+	}
+}
+
+// set <name> <value> - change a game parameter (until the board is reset,
+// unless the parameters are saved)
+static void set_command(char* args) {
+	char* value;
+	int8_t index = find_param(args, &value);
+	if(index < 0) {
+		return;
+	}
+	uint32_t number = strtoul(value, 0, 10);
+	if(!*value || number > UINT16_MAX || !param_set(index, number)) {
+		printf_P(PSTR("Out of range: "));
+	}
+	param_print(index);
+}
@@ -0,0 +1,44 @@
+/*
+ * console.h
+ *
+ * Author: Xinyi Li
+ *
+ * A very small command console on the serial terminal. Typing the
+ * CONSOLE_START_CHAR character starts a command; the command is run
+ * when Enter is pressed. While a command is being typed all serial
+ * input goes to the console rather than the game. Command output is
+ * shown from CONSOLE_ROW downwards, below the rest of the game's
+ * terminal output. Typing a new command abandons whatever output of the
+ * last command has not been printed yet.
+ */
+
+#ifndef CONSOLE_H_
+#define CONSOLE_H_
+
+#include <stdint.h>
+
+#define CONSOLE_START_CHAR ':'
+#define CONSOLE_ROW 30
+// The longest line of console output. Report lines can be up to 5
+// characters shorter than this (the line ending and clearing the rest of
+// the line take the other 5). It can't be more than the room the serial
+// output buffer has for SERIAL_DEBUG output (see serialio.h).
+#define CONSOLE_REPORT_LINE 64
+
+/* Offer a character received from the serial port to the console.
+ * Returns 1 if the console used the character (the caller should
+ * ignore it), 0 otherwise.
+ */
+uint8_t console_input(char c);
+
+/* Run the command that has been typed and print its output. This should
+ * be run regularly (e.g. as a scheduler task). Console output is
+ * SERIAL_DEBUG output, so the game never waits for it: a command is only
+ * run, and a report only printed a line at a time, when there is room in
+ * the serial output buffer for a whole line (CONSOLE_REPORT_LINE
+ * characters, which includes the line ending and clearing the rest of the
+ * line). A long report (e.g. stats) is spread over many runs.
+ */
+void console_task(void);
+
+#endif /* CONSOLE_H_ */
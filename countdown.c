@@ -11,6 +11,7 @@
 
 #include "countdown.h"
 #include "timer0.h"
+#include "params.h"
 
 void display_digit(uint8_t digit, int cc_switch, int decimal) {	
 	PORTC = digit == 0 ? 0 : digit;
@@ -26,5 +27,5 @@ void init_countdown() {
 
 void reset_countdown() {
 	time_remaining_ms = 11;
-	time_remaining_s = 15;
+	time_remaining_s = param(PARAM_COUNTDOWN);
 }
\ No newline at end of file
@@ -7,43 +7,27 @@
 
 #include <avr/eeprom.h>
 #include <avr/interrupt.h>
-#include <stdio.h>
+#include <avr/pgmspace.h>
 #include <ctype.h>
+#include <string.h>
 #include "eeprom.h"
 #include "terminalio.h"
 #include "project.h"
+#include "fmt.h"
 
 uint32_t offset = 50;
 uint32_t offset_s = 150;
 
+// The eeprom_update functions wait for any previous write to finish and
+// only turn interrupts off for the few cycles of the write sequence, so
+// we don't turn interrupts off here. (Each byte takes about 3.3ms to
+// write - holding interrupts off for that long would lose clock ticks.)
 void write_eeprom_name(uint8_t name[12], uint8_t index) {
-	while(EECR & (1<<EEPE));
-	int8_t interrupts_on = bit_is_set(SREG, SREG_I);
-	cli();
-	
-	EECR |= (1<<EEMPE);
-	EECR |= (1<<EEPE);
-	
 	eeprom_update_block((void*) name, (void*) (index * 12) + offset, 12);
-	
-	if (interrupts_on) {
-		sei();
-	}
 }
 
 void write_eeprom_score(uint32_t score, uint8_t index) {
-	while(EECR & (1<<EEPE));
-	int8_t interrupts_on = bit_is_set(SREG, SREG_I);
-	cli();
-	
-	EECR |= (1<<EEMPE);
-	EECR |= (1<<EEPE);
-	
 	eeprom_update_dword((uint32_t*) (index * 32) + offset_s, score);
-	
-	if (interrupts_on) {
-		sei();
-	}
 }
 
 void write_eeprom(uint8_t name[12], uint32_t score, uint8_t index) {
@@ -51,7 +35,40 @@ void write_eeprom(uint8_t name[12], uint32_t score, uint8_t index) {
 	write_eeprom_score(score, index);
 }
 
-void compare_and_update(uint32_t current_score) {
+// A high score entry being written in the background - the name followed
+// by the score - and the number of bytes written so far.
+static uint8_t pending_entry[16];
+static uint8_t pending_index;
+static uint8_t pending_written = sizeof(pending_entry);
+
+void begin_write_eeprom(uint8_t name[12], uint32_t score, uint8_t index) {
+	memcpy(pending_entry, name, 12);
+	memcpy(pending_entry + 12, &score, 4);
+	pending_index = index;
+	pending_written = 0;
+}
+
+uint8_t continue_write_eeprom(void) {
+	uint8_t* address;
+	while(pending_written < sizeof(pending_entry)) {
+		if(!eeprom_is_ready()) {
+			return 0;
+		}
+		if(pending_written < 12) {
+			address = (uint8_t*) (pending_index * 12) + offset + pending_written;
+		} else {
+			address = (uint8_t*) ((uint32_t*) (pending_index * 32) + offset_s)
+					+ pending_written - 12;
+		}
+		// Only bytes that change are written, so this may get through
+		// several bytes before the EEPROM is busy
+		eeprom_update_byte(address, pending_entry[pending_written]);
+		pending_written++;
+	}
+	return 1;
+}
+
+int8_t find_high_score_slot(uint32_t current_score) {
 	while(EECR & (1<<EEPE));
 	EECR |= (1<<EERE);
 	uint32_t score;
@@ -68,10 +85,8 @@ void compare_and_update(uint32_t current_score) {
 		eeprom_read_block((void*) name, (void*) (i * 12) + offset, 12);
 		score = eeprom_read_dword((uint32_t*) (i * 32) + offset_s);
 		if (score == 0xFFFFFFFF || !isalpha(name[0])) {
-			uint8_t *new_name = request_name();
-			if (new_name != '\0')
-				write_eeprom(new_name, current_score, i);
-			return;
+			// Empty entry
+			return i;
 		}
 		if (current_score > score) {
 			replacables[j][0] = i;
@@ -90,10 +105,9 @@ void compare_and_update(uint32_t current_score) {
 		}
 	}
 	if (lowest_score[1] != 0) {
-		uint8_t *new_name = request_name();
-		if (new_name != '\0')
-			write_eeprom(new_name, current_score, lowest_score[0]);
+		return lowest_score[0];
 	}
+	return -1;
 }
 
 void read_eeprom(void) {
@@ -102,13 +116,16 @@ void read_eeprom(void) {
 	uint8_t name[12];
 	uint32_t score;
 	move_cursor(10, 22);
-	printf("High scores: \n");
+	fmt_put_string_P(PSTR("High scores: \n"));
 	for (int i = 0; i < 5; i++) {
 		eeprom_read_block((void*) name, (void*) (i * 12) + offset, 12);
 		score = eeprom_read_dword((uint32_t*) (i * 32) + offset_s);
 		if (score != 0xFFFFFFFF && isalpha(name[0])) {
 			move_cursor(10,23+i);
-			printf("%s: %lu \n", name, score);
+			fmt_put_string((char*)name);
+			fmt_put_string_P(PSTR(": "));
+			fmt_put_unsigned(score, 0);
+			fmt_put_string_P(PSTR(" \n"));
 		}
 	}
 }
\ No newline at end of file
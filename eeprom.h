@@ -7,6 +7,14 @@
 
 
 void write_eeprom(uint8_t name[12], uint32_t score, uint8_t index);
-void compare_and_update(uint32_t current_score);
+// Write a high score entry without waiting for the EEPROM. Call
+// continue_write_eeprom() until it returns 1 - each call writes as much
+// as it can without waiting for a write to finish.
+void begin_write_eeprom(uint8_t name[12], uint32_t score, uint8_t index);
+uint8_t continue_write_eeprom(void);
+// Return the high score entry (0 to 4) the given score should replace,
+// or -1 if it isn't a high score. The caller asks for the player's name
+// and then writes it with write_eeprom().
+int8_t find_high_score_slot(uint32_t current_score);
 void read_eeprom(void);
 
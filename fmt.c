@@ -0,0 +1,134 @@
+/*
+ * fmt.c
+ *
+ * Author: Xinyi Li
+ */
+
+#include <avr/pgmspace.h>
+
+#include "fmt.h"
+#include "serialio.h"
+
+// Write the digits of value (at least one) to the end of buffer, i.e.
+// backwards from buffer + FMT_MAX_DIGITS. Returns the number of digits.
+static uint8_t decimal_digits(char* end, uint32_t value) {
+	uint8_t length = 0;
+	do {
+		*--end = '0' + value % 10;
+		value /= 10;
+		length++;
+	} while(value);
+	return length;
+}
+
+// Copy length characters to buffer, padded with spaces on the left to
+// width characters.
+static uint8_t pad(char* buffer, const char* text, uint8_t length,
+		uint8_t width) {
+	uint8_t i = 0;
+	while(length + i < width) {
+		buffer[i++] = ' ';
+	}
+	for(uint8_t j = 0; j < length; j++) {
+		buffer[i++] = text[j];
+	}
+	return i;
+}
+
+uint8_t fmt_unsigned(char* buffer, uint32_t value, uint8_t width) {
+	char digits[FMT_MAX_DIGITS];
+	uint8_t length = decimal_digits(digits + FMT_MAX_DIGITS, value);
+	return pad(buffer, digits + FMT_MAX_DIGITS - length, length, width);
+}
+
+uint8_t fmt_signed(char* buffer, int32_t value, uint8_t width) {
+	char digits[FMT_MAX_DIGITS];
+	// (Negate as unsigned so the most negative number works.)
+	uint32_t magnitude = value < 0 ? -(uint32_t)value : (uint32_t)value;
+	uint8_t length = decimal_digits(digits + FMT_MAX_DIGITS, magnitude);
+	if(value < 0) {
+		digits[FMT_MAX_DIGITS - ++length] = '-';
+	}
+	return pad(buffer, digits + FMT_MAX_DIGITS - length, length, width);
+}
+
+uint8_t fmt_hex(char* buffer, uint32_t value, uint8_t digits) {
+	for(uint8_t i = digits; i > 0; i--) {
+		uint8_t digit = value & 0x0F;
+		buffer[i - 1] = digit < 10 ? '0' + digit : 'A' + digit - 10;
+		value >>= 4;
+	}
+	return digits;
+}
+
+static void put_buffer(const char* buffer, uint8_t length) {
+	(void)serial_write(buffer, length);
+}
+
+void fmt_put_unsigned(uint32_t value, uint8_t width) {
+	char buffer[FMT_MAX_DIGITS];
+	for(; width > FMT_MAX_DIGITS; width--) {
+		serial_put_char(' ');
+	}
+	put_buffer(buffer, fmt_unsigned(buffer, value, width));
+}
+
+void fmt_put_signed(int32_t value, uint8_t width) {
+	char buffer[FMT_MAX_DIGITS];
+	for(; width > FMT_MAX_DIGITS; width--) {
+		serial_put_char(' ');
+	}
+	put_buffer(buffer, fmt_signed(buffer, value, width));
+}
+
+void fmt_put_hex(uint32_t value, uint8_t digits) {
+	char buffer[8];
+	if(digits > 8) {
+		digits = 8;
+	}
+	put_buffer(buffer, fmt_hex(buffer, value, digits));
+}
+
+/* Strings are written a line at a time (with serial_write), with each
+ * linefeed sent as carriage return, linefeed. Lines longer than
+ * FMT_MAX_WRITE are split.
+ */
+#define FMT_MAX_WRITE 64
+
+void fmt_put_string(const char* string) {
+	uint8_t length = 0;
+	char c;
+	do {
+		c = string[length];
+		if(c == '\0' || c == '\n' || length == FMT_MAX_WRITE) {
+			(void)serial_write(string, length);
+			if(c == '\n') {
+				(void)serial_write_P(PSTR("\r\n"), 2);
+				length++;
+			}
+			string += length;
+			length = 0;
+		} else {
+			length++;
+		}
+	} while(c != '\0');
+}
+
+void fmt_put_string_P(const char* string) {
+	uint8_t length = 0;
+	char c;
+	do {
+		c = pgm_read_byte(string + length);
+		if(c == '\0' || c == '\n' || length == FMT_MAX_WRITE) {
+			(void)serial_write_P(string, length);
+			if(c == '\n') {
+				(void)serial_write_P(PSTR("\r\n"), 2);
+				length++;
+			}
+			string += length;
+			length = 0;
+		} else {
+			length++;
+		}
+	} while(c != '\0');
+}
@@ -0,0 +1,45 @@
+/*
+ * fmt.h
+ *
+ * Author: Xinyi Li
+ *
+ * Small integer and string formatting for the game's own output, so the
+ * game doesn't go through printf (vfprintf is large and slow - it parses
+ * the format string and divides 32 bit numbers for every character).
+ * The fmt_ functions format into a buffer; the fmt_put_ functions write
+ * straight to the serial output buffer at the current output priority
+ * (see serialio.h). printf is still available for the console's
+ * diagnostic output.
+ */
+
+#ifndef FMT_H_
+#define FMT_H_
+
+#include <stdint.h>
+
+// Longest number the functions below produce (without padding)
+#define FMT_MAX_DIGITS 11
+
+/* Format a number in decimal, right aligned (padded with spaces) to at
+ * least width characters. Returns the number of characters written to
+ * buffer (which must have room for the larger of width and
+ * FMT_MAX_DIGITS). No terminating null is added.
+ */
+uint8_t fmt_unsigned(char* buffer, uint32_t value, uint8_t width);
+uint8_t fmt_signed(char* buffer, int32_t value, uint8_t width);
+
+/* Format the low digits hex digits of a number in upper case hex, with
+ * leading zeros.
+ */
+uint8_t fmt_hex(char* buffer, uint32_t value, uint8_t digits);
+
+/* Write to the serial port. A linefeed is sent as carriage return,
+ * linefeed (as with printf).
+ */
+void fmt_put_unsigned(uint32_t value, uint8_t width);
+void fmt_put_signed(int32_t value, uint8_t width);
+void fmt_put_hex(uint32_t value, uint8_t digits);
+void fmt_put_string(const char* string);
+void fmt_put_string_P(const char* string);	// string in program memory
+
+#endif /* FMT_H_ */
@@ -0,0 +1,209 @@
+/*
+ * frame.c
+ *
+ * Author: Xinyi Li
+ */
+
+#include <avr/io.h>
+#include <util/crc16.h>
+#include <string.h>
+
+#include "frame.h"
+#include "input.h"
+#include "ring.h"
+#include "serialio.h"
+
+// A frame before COBS encoding is the channel, the payload and the CRC.
+// COBS adds one byte to anything shorter than 254 bytes.
+#define FRAME_MAX_DATA (FRAME_MAX_PAYLOAD + 3)
+#define FRAME_MAX_ENCODED (FRAME_MAX_DATA + 1)
+#if FRAME_MAX_DATA > 253
+#error "FRAME_MAX_PAYLOAD is too big for a single COBS block"
+#endif
+
+/* Receiving. The receive interrupt decodes the frame into rx_data as
+ * it arrives. A complete frame (other than an input frame) stays in
+ * rx_data, with rx_ready set, until frame_get() copies it out - any
+ * frame that arrives in the meantime is dropped.
+ */
+static uint8_t rx_data[FRAME_MAX_DATA];
+static uint8_t rx_length;
+static volatile uint8_t rx_ready;
+static uint8_t rx_in_frame;		// had the zero that starts a frame
+static uint8_t rx_encoded;		// encoded bytes received in this frame
+static uint8_t rx_block;		// bytes left in the current COBS block
+static uint8_t rx_block_code;	// code byte that started the block (0 if none yet)
+static uint8_t rx_error;		// frame too long to keep
+static uint8_t rx_dropping;		// frame arrived while rx_ready was set
+
+// Counters. (rx_dropped and tx_dropped are kept apart because one is
+// changed by the interrupt handler and the other isn't.)
+static volatile uint16_t received;
+static volatile uint16_t errors;
+static volatile uint16_t rx_dropped;
+static uint16_t tx_dropped;
+
+static uint16_t crc(const uint8_t* data, uint8_t length) {
+	uint16_t crc = 0xFFFF;
+	while(length--) {
+		crc = _crc_ccitt_update(crc, *data++);
+	}
+	return crc;
+}
+
+static void start_frame(void) {
+	rx_in_frame = 1;
+	rx_encoded = 0;
+	rx_block = 0;
+	rx_block_code = 0;
+	rx_error = 0;
+	rx_dropping = rx_ready;
+	if(!rx_dropping) {
+		rx_length = 0;
+	}
+}
+
+static void add_byte(uint8_t c) {
+	if(rx_dropping) {
+		return;
+	}
+	if(rx_length < FRAME_MAX_DATA) {
+		rx_data[rx_length++] = c;
+	} else {
+		rx_error = 1;
+	}
+}
+
+static void end_frame(void) {
+	rx_in_frame = 0;
+	if(rx_dropping) {
+		rx_dropped++;
+		return;
+	}
+	if(rx_error || rx_block != 0 || rx_length < 3 ||
+			crc(rx_data, rx_length - 2) !=
+			(rx_data[rx_length - 2] | (rx_data[rx_length - 1] << 8))) {
+		errors++;
+		return;
+	}
+	received++;
+	rx_length -= 2;
+	if(rx_data[0] == FRAME_INPUT) {
+		// We're in the receive interrupt handler so can add the input
+		// straight away. (A pair from a source that doesn't exist would
+		// be taken differently by each part of the game that reads the
+		// queue, so it is counted as an error instead.)
+		for(uint8_t i = 1; i + 1 < rx_length; i += 2) {
+			if(rx_data[i] >= INPUT_NUM_SOURCES) {
+				errors++;
+				continue;
+			}
+			input_post(rx_data[i], rx_data[i + 1]);
+		}
+		return;
+	}
+	rx_ready = 1;
+}
+
+uint8_t frame_receive(uint8_t c) {
+	if(!rx_in_frame) {
+		if(c != 0) {
+			return 0;
+		}
+		start_frame();
+		return 1;
+	}
+	if(c == 0) {
+		// A zero straight after the one that started the frame starts
+		// the frame instead (e.g. the end of the last frame and the
+		// start of this one).
+		if(rx_encoded) {
+			end_frame();
+		}
+		return 1;
+	}
+	if(++rx_encoded > FRAME_MAX_ENCODED) {
+		// Far too long - probably a stray zero in terminal input. Give
+		// up on the frame and treat what follows as text.
+		rx_in_frame = 0;
+		errors++;
+		return 1;
+	}
+	if(rx_block == 0) {
+		// A code byte. The block before it ended with a zero unless it
+		// was a full (0xFF) block.
+		if(rx_block_code != 0 && rx_block_code != 0xFF) {
+			add_byte(0);
+		}
+		rx_block_code = c;
+		rx_block = c - 1;
+	} else {
+		add_byte(c);
+		rx_block--;
+	}
+	return 1;
+}
+
+uint8_t frame_get(uint8_t* channel, uint8_t* payload, uint8_t* length) {
+	if(!rx_ready) {
+		return 0;
+	}
+	*channel = rx_data[0];
+	*length = rx_length - 1;
+	memcpy(payload, rx_data + 1, rx_length - 1);
+	// Only let the interrupt handler reuse rx_data once we've copied it
+	RING_BARRIER();
+	rx_ready = 0;
+	return 1;
+}
+
+uint8_t frame_send(uint8_t channel, const void* payload, uint8_t length) {
+	uint8_t data[FRAME_MAX_DATA];
+	uint8_t encoded[FRAME_MAX_ENCODED + 2];
+	if(length > FRAME_MAX_PAYLOAD) {
+		tx_dropped++;
+		return 0;
+	}
+	data[0] = channel;
+	memcpy(data + 1, payload, length);
+	uint16_t check = crc(data, length + 1);
+	data[length + 1] = check & 0xFF;
+	data[length + 2] = check >> 8;
+
+	// COBS encode between zeros. Each zero is replaced by the distance
+	// to the next zero (with one more at the end); code is the index of
+	// the byte to get the distance.
+	uint8_t out = 0;
+	encoded[out++] = 0;
+	uint8_t code = out++;
+	for(uint8_t i = 0; i < length + 3; i++) {
+		if(data[i] == 0) {
+			encoded[code] = out - code;
+			code = out++;
+		} else {
+			encoded[out++] = data[i];
+		}
+	}
+	encoded[code] = out - code;
+	encoded[out++] = 0;
+
+	uint8_t priority = serial_set_priority(SERIAL_STATUS);
+	uint8_t sent = serial_write(encoded, out);
+	serial_set_priority(priority);
+	if(!sent) {
+		tx_dropped++;
+	}
+	return sent;
+}
+
+uint16_t frames_received(void) {
+	return received;
+}
+
+uint16_t frame_errors(void) {
+	return errors;
+}
+
+uint16_t frames_dropped(void) {
+	return rx_dropped + tx_dropped;
+}
@@ -0,0 +1,90 @@
+/*
+ * frame.h
+ *
+ * Author: Xinyi Li
+ *
+ * Binary frames sent over the serial port alongside the terminal text,
+ * for programs (rather than people) to talk to the game.
+ *
+ * A frame is a channel number, a payload of up to FRAME_MAX_PAYLOAD bytes
+ * and a CRC-16 (CCITT, initial value 0xFFFF, low byte first) of the
+ * channel and payload. The frame is COBS encoded, so it contains no zero
+ * bytes, and sent between zero bytes. Terminal text never contains a zero
+ * byte, so both directions can carry a mix of frames and text: anything
+ * between a pair of zero bytes is a frame, everything else is text.
+ * Frames with a bad CRC are discarded.
+ *
+ * Channels (numbers in frames sent to the board / sent by the board):
+ * - FRAME_INPUT: pairs of (source, code) bytes which are added to the
+ *   input queue as if the input had happened (see input.h). A pair with
+ *   a source that doesn't exist is counted as a frame error.
+ * - FRAME_STATE: an empty frame asks for the game state, which is sent
+ *   back as a FrameState.
+ * - FRAME_STATS: an empty frame asks for statistics, which are sent back
+ *   as a FrameStats.
+ * - FRAME_BULK: bulk data - level uploads (see level.h).
+ * - FRAME_TELEMETRY: sent by the board while telemetry is on (see
+ *   telemetry.h).
+ * Multi-byte values are little endian.
+ */
+
+#ifndef FRAME_H_
+#define FRAME_H_
+
+#include <stdint.h>
+
+#define FRAME_INPUT 1
+#define FRAME_STATE 2
+#define FRAME_STATS 3
+#define FRAME_BULK 4
+#define FRAME_TELEMETRY 5
+
+#define FRAME_MAX_PAYLOAD 64
+
+typedef struct {
+	uint8_t mode;			// game mode (see project.c)
+	uint8_t level;
+	uint8_t lives;
+	uint8_t paused;
+	uint8_t frog_row;
+	uint8_t frog_column;
+	uint8_t frog_dead;
+	uint32_t score;
+} __attribute__((packed)) FrameState;
+
+typedef struct {
+	uint8_t cpu_busy;		// percent, over the last second
+	uint16_t input_dropped;
+	uint32_t serial_sent;	// bytes
+	uint16_t serial_dropped;	// bytes, all priorities
+	uint16_t frames_received;
+	uint16_t frame_errors;
+	uint16_t frames_dropped;	// received and sent
+} __attribute__((packed)) FrameStats;
+
+/* Called by the serial receive interrupt handler with each character
+ * received. Returns 1 if the character was part of a frame, 0 if it is
+ * terminal input. Input frames are handled straight away; other frames
+ * are kept until frame_get() is called.
+ */
+uint8_t frame_receive(uint8_t c);
+
+/* Get the frame that has been received, if any. Returns 1 and fills in
+ * channel, payload (which must have room for FRAME_MAX_PAYLOAD bytes) and
+ * length if there was a frame, otherwise returns 0. Only one frame is
+ * kept, so frames that arrive before this is called are dropped.
+ */
+uint8_t frame_get(uint8_t* channel, uint8_t* payload, uint8_t* length);
+
+/* Send a frame. Frames are sent as status output (see serialio.h) so
+ * they never hold up the game; a frame that doesn't fit in the serial
+ * output buffer is dropped. Returns 1 if the frame was sent.
+ */
+uint8_t frame_send(uint8_t channel, const void* payload, uint8_t length);
+
+/* Frame counters */
+uint16_t frames_received(void);
+uint16_t frame_errors(void);
+uint16_t frames_dropped(void);
+
+#endif /* FRAME_H_ */
@@ -12,8 +12,10 @@
 #include "countdown.h"
 #include "sound.h"
 #include "terminalio.h"
+#include "params.h"
+#include "level.h"
 #include <stdint.h>
-#include <stdio.h>
+#include <string.h>
 
 ///////////////////////////////// Global variables //////////////////////
 // frog_row and frog_column store the current position of the frog. Row 
@@ -73,6 +75,10 @@ static uint32_t log_data[4][2] = {
 		}
 };
 
+// The level being played - a copy of the built in level above, or of the
+// uploaded level that replaces it (see level.h)
+static Level level;
+
 // Lane positions. The bit position (0 to 63) of the lane_data above that is
 // currently in column 0 of the display (left hand side). (Bit position
 // 0 is the least significant bit.) For a lane position of N, the display
@@ -139,6 +145,16 @@ void redraw_frog(void);
 
 // Reset the game
 void initialise_game(void) {
+	// Get the level ready
+	uint8_t number = current_level % 4;
+	if(!level_get(number, &level)) {
+		memcpy(level.lanes, lane_data[number], sizeof(level.lanes));
+		memcpy(level.logs, log_data[number], sizeof(level.logs));
+		memcpy(level.vehicle_colours, vehicle_colours[number],
+				sizeof(level.vehicle_colours));
+		level.log_colour = colour_logs[number];
+	}
+
 	// Initial lane and log positions
 	lane_position[0] = lane_position[1] = lane_position[2] = 0;
 	log_position[0] = log_position[1] = 0;
@@ -170,7 +186,7 @@ void put_frog_in_start_position(void) {
 // This function assumes that the frog is not in row 7 (the top row). A frog in row 7 is out
 // of the game.
 void move_frog_forward(void) {
-	play_sound(100, 200);
+	play_sound(100, param(PARAM_MOVE_SOUND));
 	if (paused)
 		paused = !paused;
 	else {
@@ -181,8 +197,7 @@ void move_frog_forward(void) {
 		frog_dead = will_frog_die_at_position(frog_row+1, frog_column);
 		if (!frog_dead) {
 			add_to_score(1);
-			move_cursor(10,1);
-			printf("\nYour score is: %9lu\n", get_score());	
+			print_score();	
 		}
 		// Move the frog position forward and show the frog. 
 		// We do this whether the frog is alive or not. 
@@ -192,8 +207,7 @@ void move_frog_forward(void) {
 		// If the frog has ended up successfully in row 7 - add it to the riverbank_status flag
 		if(!frog_dead && frog_row == RIVERBANK_ROW) {
 			add_to_score(10);
-			move_cursor(10,1);
-			printf("\nYour score is: %9lu\n", get_score());
+			print_score();
 			reset_countdown();
 			riverbank_status |= (1<<frog_column);
 		}
@@ -201,7 +215,7 @@ void move_frog_forward(void) {
 }
 
 void move_frog_backward(void) {
-	play_sound(100, 200);
+	play_sound(100, param(PARAM_MOVE_SOUND));
 	if (paused)
 		paused = !paused;
 	else {
@@ -219,7 +233,7 @@ void move_frog_backward(void) {
 }
 
 void move_frog_to_left(void) {
-	play_sound(100, 200);
+	play_sound(100, param(PARAM_MOVE_SOUND));
 	if (paused)
 		paused = !paused;
 	else {
@@ -236,7 +250,7 @@ void move_frog_to_left(void) {
 }
 
 void move_frog_to_right(void) {
-	play_sound(100, 200);
+	play_sound(100, param(PARAM_MOVE_SOUND));
 	if (paused)
 		paused = !paused;
 	else {
@@ -254,7 +268,7 @@ void move_frog_to_right(void) {
 }
 
 void move_frog_up_left(void) {
-	play_sound(100, 200);
+	play_sound(100, param(PARAM_MOVE_SOUND));
 	if (paused)
 		paused = !paused;
 	else {
@@ -279,7 +293,7 @@ void move_frog_up_left(void) {
 }
 
 void move_frog_up_right(void) {
-	play_sound(100, 200);
+	play_sound(100, param(PARAM_MOVE_SOUND));
 	if (paused)
 		paused = !paused;
 	else {
@@ -304,7 +318,7 @@ void move_frog_up_right(void) {
 }
 
 void move_frog_down_left(void) {
-	play_sound(100, 200);
+	play_sound(100, param(PARAM_MOVE_SOUND));
 	if (paused)
 		paused = !paused;
 	else {
@@ -322,7 +336,7 @@ void move_frog_down_left(void) {
 }
 
 void move_frog_down_right(void) {
-	play_sound(100, 200);
+	play_sound(100, param(PARAM_MOVE_SOUND));
 	if (paused)
 		paused = !paused;
 	else {
@@ -359,6 +373,18 @@ uint8_t is_frog_dead(void) {
 	return frog_dead;
 }
 
+uint8_t get_lane_position(uint8_t lane) {
+	return lane_position[lane];
+}
+
+uint8_t get_log_position(uint8_t channel) {
+	return log_position[channel];
+}
+
+uint16_t get_riverbank_status(void) {
+	return riverbank_status;
+}
+
 // Scroll the given lane of traffic. (lane value must be 0 to 2)
 void scroll_vehicle_lane(uint8_t lane, int8_t direction) {
 	uint8_t frog_is_in_this_row = (frog_row == lane + FIRST_VEHICLE_ROW);
@@ -446,7 +472,7 @@ static uint8_t will_frog_die_at_position(int8_t row, int8_t column) {
 			if(bit_position >= LANE_DATA_WIDTH) {
 				bit_position -= LANE_DATA_WIDTH;
 			}
-			return (lane_data[current_level % 4][lane] >> bit_position) & 1;
+			return (level.lanes[lane] >> bit_position) & 1;
 			break;
 		case 5:
 		case 6:
@@ -455,7 +481,7 @@ static uint8_t will_frog_die_at_position(int8_t row, int8_t column) {
 			if(bit_position >= LOG_DATA_WIDTH) {
 				bit_position -= LOG_DATA_WIDTH;
 			}
-			return !((log_data[current_level % 4][channel] >> bit_position) & 1);
+			return !((level.logs[channel] >> bit_position) & 1);
 			break;
 		case 7:
 			return (riverbank_status >> column) & 1;
@@ -531,8 +557,8 @@ static void redraw_traffic_lane(uint8_t lane) {
 	uint8_t i;
 	uint8_t bit_position = lane_position[lane];
 	for(i=0; i<=15; i++) {
-		if((lane_data[current_level % 4][lane] >> bit_position) & 1) {
-			row_display_data[i] = vehicle_colours[current_level % 4][lane];
+		if((level.lanes[lane] >> bit_position) & 1) {
+			row_display_data[i] = level.vehicle_colours[lane];
 			} else {
 			row_display_data[i] = COLOUR_ROAD;
 		}
@@ -551,8 +577,8 @@ static void redraw_river_channel(uint8_t channel) {
 	uint8_t i;
 	uint8_t bit_position = log_position[channel];
 	for(i=0; i<=15; i++) {
-		if((log_data[current_level % 4][channel] >> bit_position) & 1) {
-			row_display_data[i] = colour_logs[current_level % 4];
+		if((level.logs[channel] >> bit_position) & 1) {
+			row_display_data[i] = level.log_colour;
 			} else {
 			row_display_data[i] = COLOUR_WATER;
 		}
@@ -75,6 +75,15 @@ uint8_t frog_has_reached_riverbank(void);
 // Check whether the frog is alive or dead
 uint8_t is_frog_dead(void);
 
+// Return the position of the given traffic lane (0 to 2) or log channel
+// (0 or 1), i.e. the bit of the lane or log data shown in column 0.
+uint8_t get_lane_position(uint8_t lane);
+uint8_t get_log_position(uint8_t channel);
+
+// Return the riverbank holes that have frogs in them (a 1 bit for each
+// column that is riverbank or a filled hole - see game.c)
+uint16_t get_riverbank_status(void);
+
 // Boolean flag to indicate whether the frog is alive or dead
 uint8_t frog_dead;
 
@@ -0,0 +1,50 @@
+/*
+ * input.c
+ *
+ * Author: Xinyi Li
+ */
+
+#include <avr/io.h>
+
+#include "input.h"
+#include "ring.h"
+#include "timer0.h"
+
+// Events are added by interrupt handlers and removed by the game (see
+// ring.h)
+#if !RING_SIZE_VALID(INPUT_QUEUE_SIZE)
+#error "INPUT_QUEUE_SIZE must be a power of two no bigger than 128"
+#endif
+static InputEvent queue[INPUT_QUEUE_SIZE];
+static Ring ring;
+static volatile uint16_t overflows;
+
+void input_post(uint8_t source, uint8_t code) {
+	if(ring_is_full(&ring, INPUT_QUEUE_SIZE)) {
+		overflows++;
+		return;
+	}
+	InputEvent* event = &queue[ring_head_index(&ring, INPUT_QUEUE_SIZE)];
+	event->source = source;
+	event->code = code;
+	event->timestamp_us = get_current_time_us();
+	// Only make the event visible once it is complete
+	ring_push(&ring);
+}
+
+uint8_t input_get(InputEvent* event) {
+	if(ring_is_empty(&ring)) {
+		return 0;
+	}
+	*event = queue[ring_tail_index(&ring, INPUT_QUEUE_SIZE)];
+	ring_pop(&ring);
+	return 1;
+}
+
+void input_flush(void) {
+	ring_flush(&ring);
+}
+
+uint16_t input_overflows(void) {
+	return overflows;
+}
@@ -0,0 +1,70 @@
+/*
+ * input.h
+ *
+ * Author: Xinyi Li
+ *
+ * A single queue of input events from every input source. Events are
+ * added by the interrupt handlers that sample the inputs - the timer 0
+ * tick (buttons), the ADC (joystick) and the UART receive interrupt
+ * (serial input) - and are taken off the queue by the game in the order
+ * they happened. Each event records its source, a code and the time it
+ * was added.
+ */
+
+#ifndef INPUT_H_
+#define INPUT_H_
+
+#include <stdint.h>
+
+// Event sources and what the code is for each
+#define INPUT_BUTTON 0		// button event (see buttons.h)
+#define INPUT_SERIAL 1		// key pressed (see below)
+#define INPUT_JOYSTICK 2	// JoystickDirection moved in
+#define INPUT_NUM_SOURCES 3
+
+/* Codes of INPUT_SERIAL events. The serial receive interrupt decodes
+ * the characters received, so a key that the terminal sends as several
+ * characters is a single event:
+ * - printable characters are themselves,
+ * - Enter is '\n' (whether the terminal sends CR, LF or CR LF),
+ * - Backspace is '\b' (whether the terminal sends BS or DEL),
+ * - the cursor keys (ESC [ A to ESC [ D, or ESC O A to ESC O D) are the
+ *   KEY_ codes below, and
+ * - ESC on its own is ESCAPE_CHAR (sent once the next character shows
+ *   that it didn't start an escape sequence).
+ * Other escape sequences (e.g. function keys) are discarded.
+ */
+#define ESCAPE_CHAR 27
+#define KEY_UP 0x80
+#define KEY_DOWN 0x81
+#define KEY_RIGHT 0x82
+#define KEY_LEFT 0x83
+
+#define INPUT_QUEUE_SIZE 16
+
+typedef struct {
+	uint8_t source;
+	uint8_t code;
+	uint32_t timestamp_us;	// from get_current_time_us()
+} InputEvent;
+
+/* Add an event to the queue, timestamped with the current time. The
+ * event is discarded if the queue is full. This must only be called
+ * from interrupt handlers that don't allow other interrupts while they
+ * run (i.e. not ISR_NOBLOCK handlers) - this is what makes it safe for
+ * several handlers to add events without turning interrupts off.
+ */
+void input_post(uint8_t source, uint8_t code);
+
+/* Take the oldest event off the queue. Returns 1 if there was an event,
+ * 0 if the queue was empty.
+ */
+uint8_t input_get(InputEvent* event);
+
+/* Discard every event in the queue */
+void input_flush(void);
+
+/* Number of events discarded because the queue was full */
+uint16_t input_overflows(void);
+
+#endif /* INPUT_H_ */
@@ -8,11 +8,251 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 
+#include "joystick.h"
+#include "timer0.h"
+#include "input.h"
+#include "clock.h"
+
+#define AXIS_X 0
+#define AXIS_Y 1
+
+// ADC channels: X is on ADC5 and Y on ADC6. (The old polling loop set
+// ADMUX to one channel and then read the conversion that had been started
+// on the other, so its readings were the other way round from its ADMUX
+// settings.)
+static const uint8_t axis_mux[2] = {
+	(1<<MUX2) | (1<<MUX0),
+	(1<<MUX2) | (1<<MUX1)
+};
+
+// The axis being converted
+static uint8_t axis;
+
+// The last JOYSTICK_OVERSAMPLE samples of each axis and their sum
+static uint16_t samples[2][JOYSTICK_OVERSAMPLE];
+static uint16_t sample_sum[2];
+static uint8_t sample_index[2];
+
+// Calibration. centre is in ADC counts. scale converts a distance from
+// the centre (on the negative and positive side) to a deflection - it
+// is a fixed point number with 8 fractional bits.
+#define CALIBRATION_START (2 * JOYSTICK_OVERSAMPLE)
+#define CALIBRATION_END (CALIBRATION_START + 2 * JOYSTICK_CALIBRATION_SAMPLES)
+static uint16_t calibration_count;
+static uint32_t calibration_sum[2];
+static uint16_t centre[2];
+static uint16_t scale[2][2];
+
+// The published state. sequence is incremented before and after the
+// state is changed, so it is odd while the state is being changed.
+static volatile JoystickState state;
+static volatile uint8_t sequence;
+
 void initialise_joystick(void) {
 	DDRA &= ~(0<<PINC5) | ~(0<<PINC6);
-	// Turn on the ADC (but don't start a conversion yet). Choose a clock
-	// divider of 64. (The ADC clock must be somewhere
-	// between 50kHz and 200kHz. We will divide our 8MHz clock by 64
-	// to give us 125kHz.)
-	ADCSRA = (1<<ADEN)|(1<<ADPS2)|(1<<ADPS1);
+	// The joystick pins are only used by the ADC - turn off their
+	// digital input buffers.
+	DIDR0 = (1<<ADC5D) | (1<<ADC6D);
+	axis = AXIS_X;
+	ADMUX = (1<<REFS0) | axis_mux[AXIS_X];
+	// Start a conversion on every timer 0 compare match (i.e. every tick)
+	ADCSRB = (1<<ADTS1) | (1<<ADTS0);
+	// Turn on the ADC with auto triggering and the conversion complete
+	// interrupt. Choose a clock divider of ADC_PRESCALER. (The ADC clock
+	// must be somewhere between 50kHz and 200kHz. At 8MHz we divide the
+	// clock by 64 to give us 125kHz - see clock.h.)
+	ADCSRA = (1<<ADEN) | (1<<ADATE) | (1<<ADIE) | ADC_PRESCALER_SELECT;
+}
+
+// Work out the centre of each axis from the samples taken at reset. If
+// the joystick was obviously being pushed we assume the centre is
+// halfway. Full deflection is where the reading reaches the end of the
+// ADC range.
+static void calibrate(void) {
+	for(uint8_t i = 0; i < 2; i++) {
+		uint16_t c = calibration_sum[i] / JOYSTICK_CALIBRATION_SAMPLES;
+		if(c < 412 || c > 612) {
+			c = 512;
+		}
+		centre[i] = c;
+		scale[i][0] = (JOYSTICK_FULL_SCALE * 256UL) / c;
+		scale[i][1] = (JOYSTICK_FULL_SCALE * 256UL) / (1023 - c);
+	}
+}
+
+static int16_t deflection(uint8_t i) {
+	int16_t distance = (int16_t)(sample_sum[i] / JOYSTICK_OVERSAMPLE) - centre[i];
+	if(distance < 0) {
+		return -(int16_t)(((uint32_t)-distance * scale[i][0]) >> 8);
+	} else {
+		return ((uint32_t)distance * scale[i][1]) >> 8;
+	}
+}
+
+void get_joystick_state(JoystickState* copy) {
+	uint8_t before;
+	do {
+		before = sequence;
+		copy->x = state.x;
+		copy->y = state.y;
+		copy->timestamp_us = state.timestamp_us;
+		copy->calibrated = state.calibrated;
+	} while((before & 1) || before != sequence);
+}
+
+static void update_direction(void);
+
+// A conversion has finished. (The next one starts at the next tick.)
+ISR(ADC_vect) {
+	uint16_t value = ADC;
+	uint8_t i = axis;
+	
+	// Switch to the other axis for the next conversion
+	axis = !axis;
+	ADMUX = (1<<REFS0) | axis_mux[axis];
+	
+	sample_sum[i] += value - samples[i][sample_index[i]];
+	samples[i][sample_index[i]] = value;
+	sample_index[i] = (sample_index[i] + 1) % JOYSTICK_OVERSAMPLE;
+	
+	if(calibration_count < CALIBRATION_END) {
+		// The first samples (taken while the ADC settles) are ignored.
+		// The ones after that are used for calibration.
+		calibration_count++;
+		if(calibration_count > CALIBRATION_START) {
+			calibration_sum[i] += value;
+		}
+		if(calibration_count < CALIBRATION_END) {
+			return;
+		}
+		calibrate();
+		state.calibrated = 1;
+	}
+	
+	sequence++;
+	if(i == AXIS_X) {
+		state.x = deflection(AXIS_X);
+	} else {
+		state.y = deflection(AXIS_Y);
+	}
+	state.timestamp_us = get_current_time_us();
+	sequence++;
+	
+	update_direction();
+}
+
+/////////////////////////////// Directions /////////////////////////////////////
+
+// The joystick angle is classified by which 30 degree boundaries (from
+// the x axis, folded into the first quadrant) it is past: sector 0 is
+// along the x axis, 1 is diagonal and 2 is along the y axis. y is past
+// the boundary at angle a if y^2 > x^2 tan^2(a). These are 256 tan^2(a)
+// for each boundary at (the boundary - JOYSTICK_HYSTERESIS), the
+// boundary and (the boundary + JOYSTICK_HYSTERESIS).
+#if JOYSTICK_HYSTERESIS != 5
+#error "Recalculate sector_boundary for the new JOYSTICK_HYSTERESIS"
+#endif
+static const uint16_t sector_boundary[2][3] = {
+	{ 56, 85, 126 },		// 25, 30 and 35 degrees
+	{ 522, 768, 1179 }		// 55, 60 and 65 degrees
+};
+
+// Direction for each sector and quadrant (bit 1 set for negative x,
+// bit 0 set for negative y)
+static const uint8_t sector_direction[3][4] = {
+	{ JOYSTICK_LEFT, JOYSTICK_LEFT, JOYSTICK_RIGHT, JOYSTICK_RIGHT },
+	{ JOYSTICK_UP_LEFT, JOYSTICK_DOWN_LEFT, JOYSTICK_UP_RIGHT, JOYSTICK_DOWN_RIGHT },
+	{ JOYSTICK_FORWARD, JOYSTICK_BACKWARD, JOYSTICK_FORWARD, JOYSTICK_BACKWARD }
+};
+
+// Sector of each direction (3 for the centre)
+static const uint8_t direction_sector[9] = {
+	3, 2, 2, 0, 0, 1, 1, 1, 1
+};
+
+// Squared magnitude at full deflection
+#define FULL_SCALE_SQUARED ((uint32_t)JOYSTICK_FULL_SCALE * JOYSTICK_FULL_SCALE)
+
+// Direction the joystick is in and the ms until it next repeats
+static volatile JoystickDirection direction;
+static uint16_t repeat_count;
+
+JoystickDirection joystick_classify(int16_t x, int16_t y,
+		JoystickDirection previous) {
+	uint32_t x2 = (int32_t)x * x;
+	uint32_t y2 = (int32_t)y * y;
+	uint32_t magnitude2 = x2 + y2;
+	uint8_t quadrant = ((x < 0) << 1) | (y < 0);
+	uint8_t previous_sector = direction_sector[previous];
+	uint8_t sector;
+	
+	if(magnitude2 <= (uint32_t)JOYSTICK_RELEASE * JOYSTICK_RELEASE ||
+			(previous == JOYSTICK_CENTRE &&
+			magnitude2 <= (uint32_t)JOYSTICK_ENGAGE * JOYSTICK_ENGAGE)) {
+		return JOYSTICK_CENTRE;
+	}
+	
+	// Count the boundaries the angle is past. A boundary next to the
+	// previous direction is moved away from it. (Each sector holds a
+	// direction in every quadrant, so this is only done in the quadrants
+	// the previous direction covers - the same sector on the other side
+	// isn't next to it.)
+	if(previous_sector < 3 &&
+			sector_direction[previous_sector][quadrant] != previous) {
+		previous_sector = 3;
+	}
+	y2 *= 256;
+	sector = 0;
+	for(uint8_t b = 0; b < 2; b++) {
+		uint8_t threshold;
+		if(previous_sector == b) {
+			threshold = 2;
+		} else if(previous_sector == b + 1) {
+			threshold = 0;
+		} else {
+			threshold = 1;
+		}
+		if(y2 > x2 * sector_boundary[b][threshold]) {
+			sector++;
+		}
+	}
+	return sector_direction[sector][quadrant];
+}
+
+// Time between repeats for the given deflection - JOYSTICK_REPEAT_SLOW
+// at JOYSTICK_ENGAGE down to JOYSTICK_REPEAT_FAST at full deflection.
+// (This is linear in the squared magnitude, which saves a square root.)
+static uint16_t repeat_interval(int16_t x, int16_t y) {
+	uint32_t magnitude2 = (int32_t)x * x + (int32_t)y * y;
+	const uint32_t engage2 = (uint32_t)JOYSTICK_ENGAGE * JOYSTICK_ENGAGE;
+	if(magnitude2 >= FULL_SCALE_SQUARED) {
+		return JOYSTICK_REPEAT_FAST;
+	} else if(magnitude2 <= engage2) {
+		return JOYSTICK_REPEAT_SLOW;
+	}
+	return JOYSTICK_REPEAT_SLOW - (magnitude2 - engage2) *
+			(JOYSTICK_REPEAT_SLOW - JOYSTICK_REPEAT_FAST) /
+			(FULL_SCALE_SQUARED - engage2);
+}
+
+// Called from the ADC interrupt handler after every sample (every ms).
+// A move is added to the input queue when the joystick is pushed in a
+// new direction and then repeatedly while it is held there.
+static void update_direction(void) {
+	JoystickDirection new_direction = joystick_classify(state.x, state.y, direction);
+	if(new_direction != direction) {
+		direction = new_direction;
+		// Add a delay to the hold before triggering auto repeat.
+		repeat_count = JOYSTICK_REPEAT_DELAY;
+		if(direction != JOYSTICK_CENTRE) {
+			input_post(INPUT_JOYSTICK, direction);
+		}
+	} else if(direction != JOYSTICK_CENTRE && --repeat_count == 0) {
+		repeat_count = repeat_interval(state.x, state.y);
+		input_post(INPUT_JOYSTICK, direction);
+	}
+}
+
+void joystick_reset_move(void) {
+	direction = JOYSTICK_CENTRE;
 }
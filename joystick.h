@@ -3,8 +3,89 @@
  *
  * Created: 5/23/2018 12:07:40 AM
  *  Author: Xinyi Li
- */ 
+ *
+ * The joystick is sampled in the background by the ADC. A conversion is
+ * started by every timer 0 tick (compare match A), alternating between
+ * the X and Y axes, so each axis is sampled every 2ms. The last
+ * JOYSTICK_OVERSAMPLE samples of each axis are averaged. The centre is
+ * calibrated from the first samples after reset, so the joystick must
+ * not be touched while the board starts up. Moves (the joystick pushed
+ * in a direction, and auto repeats while it is held) are added to the
+ * input queue (see input.h).
+ */
+
+#ifndef JOYSTICK_H_
+#define JOYSTICK_H_
+
+#include <stdint.h>
+
+#define JOYSTICK_OVERSAMPLE 8
+
+// Number of samples of each axis averaged to find the centre at reset
+#define JOYSTICK_CALIBRATION_SAMPLES 32
+
+// Deflection of the joystick when pushed all the way along an axis
+#define JOYSTICK_FULL_SCALE 512
+
+typedef struct {
+	// Deflection from the centre, -JOYSTICK_FULL_SCALE to JOYSTICK_FULL_SCALE
+	int16_t x;
+	int16_t y;
+	// Time of the newest sample (us, from get_current_time_us())
+	uint32_t timestamp_us;
+	// 0 until the centre has been calibrated (x and y are 0 until then)
+	uint8_t calibrated;
+} JoystickState;
+
+// Directions the joystick can be pushed in. (The joystick is mounted so
+// that positive x is to the left and positive y is forward.)
+typedef enum {
+	JOYSTICK_CENTRE,
+	JOYSTICK_FORWARD,
+	JOYSTICK_BACKWARD,
+	JOYSTICK_LEFT,
+	JOYSTICK_RIGHT,
+	JOYSTICK_UP_LEFT,
+	JOYSTICK_UP_RIGHT,
+	JOYSTICK_DOWN_LEFT,
+	JOYSTICK_DOWN_RIGHT
+} JoystickDirection;
+
+// The joystick must be pushed further than JOYSTICK_ENGAGE to select a
+// direction and stays in that direction until it drops below
+// JOYSTICK_RELEASE. A direction changes to a neighbouring one only once
+// the joystick is JOYSTICK_HYSTERESIS degrees past the boundary between
+// them.
+#define JOYSTICK_ENGAGE 400
+#define JOYSTICK_RELEASE 350
+#define JOYSTICK_HYSTERESIS 5
+
+// Auto repeat while the joystick is held (ms). After the initial delay
+// the joystick repeats every JOYSTICK_REPEAT_SLOW ms when just past
+// JOYSTICK_ENGAGE, speeding up to JOYSTICK_REPEAT_FAST ms when pushed
+// all the way.
+#define JOYSTICK_REPEAT_DELAY 500
+#define JOYSTICK_REPEAT_SLOW 200
+#define JOYSTICK_REPEAT_FAST 60
 
 void initialise_joystick(void);
 
-int joystick_enable;
\ No newline at end of file
+/* Get the latest joystick state. This never turns interrupts off - if a
+ * new sample arrives while the state is being copied it is copied again.
+ */
+void get_joystick_state(JoystickState* state);
+
+/* Classify a deflection as a direction. previous is the direction the
+ * joystick was last in - it is used for hysteresis.
+ */
+JoystickDirection joystick_classify(int16_t x, int16_t y,
+		JoystickDirection previous);
+
+/* Forget the current direction, so that if the joystick is being held
+ * a move is added to the input queue straight away.
+ */
+void joystick_reset_move(void);
+
+int joystick_enable;
+
+#endif /* JOYSTICK_H_ */
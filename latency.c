@@ -0,0 +1,119 @@
+/*
+ * latency.c
+ *
+ * Author: Xinyi Li
+ */
+
+#include <avr/pgmspace.h>
+#include <stdio.h>
+
+#include "latency.h"
+#include "input.h"
+#include "timer0.h"
+#include "terminalio.h"
+
+// Bucket n counts latencies from 2^n up to 2^(n+1) - 1 us (bucket 0 also
+// counts 0us). The last bucket counts everything longer.
+#define NUM_BUCKETS 18
+
+typedef struct {
+	uint16_t buckets[NUM_BUCKETS];
+	uint16_t count;
+	uint32_t total;
+	uint32_t min;
+	uint32_t max;
+} Histogram;
+
+static Histogram histograms[INPUT_NUM_SOURCES];
+
+// The measurement in progress (if measuring is set)
+static uint8_t measuring;
+static uint8_t measuring_source;
+static uint32_t measuring_since;
+
+static const char button_name[] PROGMEM = "button";
+static const char serial_name[] PROGMEM = "serial";
+static const char joystick_name[] PROGMEM = "joystick";
+static const char* const source_names[INPUT_NUM_SOURCES] PROGMEM = {
+	button_name, serial_name, joystick_name
+};
+
+void latency_begin(uint8_t source, uint32_t timestamp_us) {
+	if(source < INPUT_NUM_SOURCES) {
+		measuring = 1;
+		measuring_source = source;
+		measuring_since = timestamp_us;
+	}
+}
+
+void latency_displayed(void) {
+	if(!measuring) {
+		return;
+	}
+	measuring = 0;
+	
+	uint32_t latency = get_current_time_us() - measuring_since;
+	Histogram* histogram = &histograms[measuring_source];
+	uint8_t bucket = 0;
+	for(uint32_t upper = 2; latency >= upper && bucket < NUM_BUCKETS - 1; upper <<= 1) {
+		bucket++;
+	}
+	// Counts stop (rather than wrap) when they are full
+	if(histogram->count == UINT16_MAX) {
+		return;
+	}
+	histogram->buckets[bucket]++;
+	histogram->count++;
+	histogram->total += latency;
+	if(histogram->count == 1 || latency < histogram->min) {
+		histogram->min = latency;
+	}
+	if(latency > histogram->max) {
+		histogram->max = latency;
+	}
+}
+
+void latency_end(void) {
+	measuring = 0;
+}
+
+uint8_t latency_print(uint8_t line) {
+	if(line == 0) {
+		printf_P(PSTR("input to display (us)  count    min    avg   p99<=    max"));
+	} else {
+		Histogram* histogram = &histograms[line - 1];
+		uint32_t average = 0, p99 = 0;
+		if(histogram->count) {
+			average = histogram->total / histogram->count;
+			// The first bucket by which 99% of the latencies are counted
+			uint16_t needed = histogram->count - histogram->count / 100;
+			uint16_t counted = 0;
+			uint8_t bucket = 0;
+			while((counted += histogram->buckets[bucket]) < needed) {
+				bucket++;
+			}
+			p99 = (2UL << bucket) - 1;
+			if(p99 > histogram->max) {
+				p99 = histogram->max;
+			}
+		}
+		printf_P(PSTR("%-20S %6u %6lu %6lu %7lu %6lu"),
+				(const char*)pgm_read_word(&source_names[line - 1]),
+				histogram->count, histogram->min, average, p99, histogram->max);
+	}
+	clear_to_end_of_line();
+	return line < INPUT_NUM_SOURCES;
+}
+
+void latency_reset(void) {
+	for(uint8_t i = 0; i < INPUT_NUM_SOURCES; i++) {
+		Histogram* histogram = &histograms[i];
+		for(uint8_t j = 0; j < NUM_BUCKETS; j++) {
+			histogram->buckets[j] = 0;
+		}
+		histogram->count = 0;
+		histogram->total = 0;
+		histogram->min = 0;
+		histogram->max = 0;
+	}
+}
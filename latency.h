@@ -0,0 +1,40 @@
+/*
+ * latency.h
+ *
+ * Author: Xinyi Li
+ *
+ * Input to display latency. The time from an input event being sampled
+ * (its timestamp - see input.h) to the LED matrix update it caused being
+ * sent is measured for every input that changes the display, and kept
+ * as a histogram for each input source. Buckets are powers of two
+ * microseconds, so the 99th percentile is only known to within a factor
+ * of two (the upper end of its bucket is reported).
+ */
+
+#ifndef LATENCY_H_
+#define LATENCY_H_
+
+#include <stdint.h>
+
+/* The game is about to handle an input event from the given source which
+ * was sampled at the given time. The next pixel or row update sent to the
+ * LED matrix ends the measurement.
+ */
+void latency_begin(uint8_t source, uint32_t timestamp_us);
+
+/* A pixel or row update has been sent to the LED matrix */
+void latency_displayed(void);
+
+/* The game has finished handling the input event. If it didn't change the
+ * display nothing is recorded.
+ */
+void latency_end(void);
+
+/* Print (to standard output) one line of the count, min, average, 99th
+ * percentile and max for each input source, starting from line 0.
+ * Returns 1 if there are more lines to print.
+ */
+uint8_t latency_print(uint8_t line);
+void latency_reset(void);
+
+#endif /* LATENCY_H_ */
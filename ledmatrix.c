@@ -7,8 +7,11 @@
  */ 
 
 #include <avr/io.h>
+#include <util/crc16.h>
 #include "ledmatrix.h"
 #include "spi.h"
+#include "latency.h"
+#include "mirror.h"
 
 #define CMD_UPDATE_ALL 0x00
 #define CMD_UPDATE_PIXEL 0x01
@@ -17,6 +20,22 @@
 #define CMD_SHIFT_DISPLAY 0x04
 #define CMD_CLEAR_SCREEN 0x0F
 
+// CRC-16 of every byte sent to the LED matrix (see ledmatrix_checksum())
+static uint16_t checksum;
+
+static void send_byte(uint8_t byte) {
+	checksum = _crc16_update(checksum, byte);
+	(void)spi_send_byte(byte);
+}
+
+uint16_t ledmatrix_checksum(void) {
+	return checksum;
+}
+
+void ledmatrix_reset_checksum(void) {
+	checksum = 0;
+}
+
 void ledmatrix_setup(void) {
 	// Setup SPI - we divide the clock by 128.
 	// (This speed guarantees the SPI buffer will never overflow on
@@ -25,10 +44,11 @@ void ledmatrix_setup(void) {
 }
 
 void ledmatrix_update_all(MatrixData data) {
-	(void)spi_send_byte(CMD_UPDATE_ALL);
+	send_byte(CMD_UPDATE_ALL);
 	for(uint8_t y=0; y<MATRIX_NUM_ROWS; y++) {
 		for(uint8_t x=0; x<MATRIX_NUM_COLUMNS; x++) {
-			(void)spi_send_byte(data[x][y]);
+			send_byte(data[x][y]);
+			mirror_set_pixel(x, y, data[x][y]);
 		}
 	}
 }
@@ -38,9 +58,11 @@ void ledmatrix_update_pixel(uint8_t x, uint8_t y, PixelColour pixel) {
 		// Position isn't valid - we ignore the request.
 		return;
 	}
-	(void)spi_send_byte(CMD_UPDATE_PIXEL);
-	(void)spi_send_byte( ((y & 0x07)<<4) | (x & 0x0F));
-	(void)spi_send_byte(pixel);
+	send_byte(CMD_UPDATE_PIXEL);
+	send_byte( ((y & 0x07)<<4) | (x & 0x0F));
+	send_byte(pixel);
+	mirror_set_pixel(x, y, pixel);
+	latency_displayed();
 }
 
 void ledmatrix_update_row(uint8_t y, MatrixRow row) {
@@ -48,11 +70,13 @@ void ledmatrix_update_row(uint8_t y, MatrixRow row) {
 		// y value is too large - we ignore the request
 		return;
 	}
-	(void)spi_send_byte(CMD_UPDATE_ROW);
-	(void)spi_send_byte(y & 0x07);	// row number
+	send_byte(CMD_UPDATE_ROW);
+	send_byte(y & 0x07);	// row number
 	for(uint8_t x = 0; x<MATRIX_NUM_COLUMNS; x++) {
-		(void)spi_send_byte(row[x]);
+		send_byte(row[x]);
+		mirror_set_pixel(x, y, row[x]);
 	}
+	latency_displayed();
 }
 
 void ledmatrix_update_column(uint8_t x, MatrixColumn col) {
@@ -60,35 +84,41 @@ void ledmatrix_update_column(uint8_t x, MatrixColumn col) {
 		// x value is too large - we ignore the request
 		return;
 	}
-	(void)spi_send_byte(CMD_UPDATE_COL);
-	(void)spi_send_byte(x & 0x0F); // column number
+	send_byte(CMD_UPDATE_COL);
+	send_byte(x & 0x0F); // column number
 	for(uint8_t y = 0; y<MATRIX_NUM_ROWS; y++) {
-		(void)spi_send_byte(col[y]);
+		send_byte(col[y]);
+		mirror_set_pixel(x, y, col[y]);
 	}
 }
 
 void ledmatrix_shift_display_left(void) {
-	(void)spi_send_byte(CMD_SHIFT_DISPLAY);
-	(void)spi_send_byte(0x02);
+	send_byte(CMD_SHIFT_DISPLAY);
+	send_byte(0x02);
+	mirror_shift(-1, 0);
 }
 
 void ledmatrix_shift_display_right(void) {
-	(void)spi_send_byte(CMD_SHIFT_DISPLAY);
-	(void)spi_send_byte(0x01);
+	send_byte(CMD_SHIFT_DISPLAY);
+	send_byte(0x01);
+	mirror_shift(1, 0);
 }
 
 void ledmatrix_shift_display_up(void) {
-	(void)spi_send_byte(CMD_SHIFT_DISPLAY);
-	(void)spi_send_byte(0x08);
+	send_byte(CMD_SHIFT_DISPLAY);
+	send_byte(0x08);
+	mirror_shift(0, 1);
 }
 
 void ledmatrix_shift_display_down(void) {
-	(void)spi_send_byte(CMD_SHIFT_DISPLAY);
-	(void)spi_send_byte(0x04);
+	send_byte(CMD_SHIFT_DISPLAY);
+	send_byte(0x04);
+	mirror_shift(0, -1);
 }
 
 void ledmatrix_clear(void) {
-	(void)spi_send_byte(CMD_CLEAR_SCREEN);
+	send_byte(CMD_CLEAR_SCREEN);
+	mirror_clear();
 }
 
 void copy_matrix_column(MatrixColumn from, MatrixColumn to) {
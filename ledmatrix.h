@@ -40,6 +40,12 @@ void ledmatrix_shift_display_up(void);
 void ledmatrix_shift_display_down(void);
 void ledmatrix_clear(void);
 
+// A checksum (CRC-16) of every byte sent to the LED matrix since it was
+// last reset. Two runs that display exactly the same frames in the same
+// order have the same checksum.
+uint16_t ledmatrix_checksum(void);
+void ledmatrix_reset_checksum(void);
+
 // Functions to operate on rows and columns
 void copy_matrix_column(MatrixColumn from, MatrixColumn to);
 void copy_matrix_row(MatrixRow from, MatrixRow to);
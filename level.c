@@ -0,0 +1,254 @@
+/*
+ * level.c
+ *
+ * Author: Xinyi Li
+ */
+
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+#include <util/crc16.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "level.h"
+#include "frame.h"
+#include "terminalio.h"
+#include "timer0.h"
+
+#define LEVEL_MAGIC 0x4C
+#define LEVEL_VERSION 1
+
+// The level in EEPROM. The magic number is cleared before anything else
+// is written and only written once the rest is complete, so a level that
+// was only partly written is never loaded.
+typedef struct {
+	uint8_t magic;
+	uint8_t version;
+	uint8_t number;
+	Level level;
+	uint16_t crc;		// of level
+} __attribute__((packed)) LevelSlot;
+
+// The level has to fit in its EEPROM slot. (The preprocessor can't
+// use sizeof, so a slot that is too small gives an array of size -1.)
+typedef char level_slot_fits[
+		LEVEL_SLOT_START + sizeof(LevelSlot) <= LEVEL_SLOT_END ? 1 : -1];
+
+// The uploaded level being used
+static Level uploaded;
+static uint8_t uploaded_number;
+static uint8_t have_uploaded;
+
+// The upload in progress
+static Level incoming;
+static uint8_t received;
+static uint8_t incoming_number;
+static uint8_t destination;
+static uint16_t expected_crc;
+static uint8_t state;
+
+// Writing to EEPROM. Step 0 clears the magic number, the steps after
+// that write the rest of slot and the last step writes the magic number.
+// A level is removed from EEPROM by just doing step 0.
+static LevelSlot slot;
+static uint8_t write_step;
+static uint8_t write_steps;
+
+// Timings of the last upload (ms from LEVEL_BEGIN)
+static uint32_t begin_time;
+static uint16_t upload_ms;
+static uint16_t playable_ms;
+static uint16_t stored_ms;
+
+static uint16_t crc(const void* data, uint8_t length) {
+	const uint8_t* bytes = data;
+	uint16_t crc = 0xFFFF;
+	while(length--) {
+		crc = _crc_ccitt_update(crc, *bytes++);
+	}
+	return crc;
+}
+
+// Check that a level can be played: every lane has room for the frog,
+// every river channel has a log to jump on to, and the vehicles and logs
+// can be seen.
+static uint8_t playable(const Level* level) {
+	for(uint8_t i = 0; i < 3; i++) {
+		if(level->lanes[i] == UINT64_MAX ||
+				level->vehicle_colours[i] == COLOUR_BLACK) {
+			return 0;
+		}
+	}
+	for(uint8_t i = 0; i < 2; i++) {
+		if(level->logs[i] == 0) {
+			return 0;
+		}
+	}
+	return level->log_colour != COLOUR_BLACK;
+}
+
+static uint16_t ms_since_begin(void) {
+	uint32_t ms = get_current_time() - begin_time;
+	return ms > UINT16_MAX ? UINT16_MAX : ms;
+}
+
+void level_init(void) {
+	eeprom_read_block(&slot, (void*)LEVEL_SLOT_START, sizeof(slot));
+	if(slot.magic == LEVEL_MAGIC && slot.version == LEVEL_VERSION &&
+			slot.number < LEVEL_NUMBERS &&
+			crc(&slot.level, sizeof(slot.level)) == slot.crc &&
+			playable(&slot.level)) {
+		uploaded = slot.level;
+		uploaded_number = slot.number;
+		have_uploaded = 1;
+	}
+}
+
+uint8_t level_get(uint8_t number, Level* level) {
+	if(!have_uploaded || number != uploaded_number) {
+		return 0;
+	}
+	*level = uploaded;
+	return 1;
+}
+
+// Start writing the slot (or, if remove is set, just clearing it)
+static void begin_write(uint8_t remove) {
+	write_step = 0;
+	write_steps = remove ? 1 : sizeof(slot) + 1;
+}
+
+static void finish(uint8_t* reply) {
+	upload_ms = ms_since_begin();
+	if(received != sizeof(incoming)) {
+		reply[2] = LEVEL_ERROR_LENGTH;
+	} else if(crc(&incoming, sizeof(incoming)) != expected_crc) {
+		reply[2] = LEVEL_ERROR_CRC;
+	} else if(!playable(&incoming)) {
+		reply[2] = LEVEL_ERROR_UNPLAYABLE;
+	} else {
+		// Good - use it from the next time the level starts
+		uploaded = incoming;
+		uploaded_number = incoming_number;
+		have_uploaded = 1;
+		playable_ms = ms_since_begin();
+		if(destination == LEVEL_TO_EEPROM) {
+			slot.magic = LEVEL_MAGIC;
+			slot.version = LEVEL_VERSION;
+			slot.number = incoming_number;
+			slot.level = incoming;
+			slot.crc = expected_crc;
+			begin_write(0);
+			state = LEVEL_STATE_PLAYABLE;
+		} else {
+			stored_ms = playable_ms;
+			state = LEVEL_STATE_STORED;
+		}
+		reply[0] = LEVEL_ACK;
+		return;
+	}
+	state = LEVEL_STATE_FAILED;
+}
+
+void level_receive(const uint8_t* data, uint8_t length) {
+	uint8_t reply[3 + 3 * sizeof(uint16_t)];
+	uint8_t reply_length = 3;
+	reply[0] = LEVEL_NAK;
+	reply[1] = length ? data[0] : 0;
+	reply[2] = 0;
+
+	if(length == 0) {
+		// Nothing to do
+	} else if(data[0] == LEVEL_BEGIN) {
+		// (A new upload can't start while the last one is being written
+		// to EEPROM - slot is in use.)
+		if(length == 5 && data[1] < LEVEL_NUMBERS &&
+				data[2] <= LEVEL_TO_EEPROM && write_step >= write_steps) {
+			incoming_number = data[1];
+			destination = data[2];
+			expected_crc = data[3] | (data[4] << 8);
+			received = 0;
+			state = LEVEL_STATE_RECEIVING;
+			begin_time = get_current_time();
+			upload_ms = playable_ms = stored_ms = 0;
+			reply[0] = LEVEL_ACK;
+		}
+	} else if(data[0] == LEVEL_DATA) {
+		if(state == LEVEL_STATE_RECEIVING && length >= 2 && data[1] == received &&
+				received + length - 2 <= sizeof(incoming)) {
+			memcpy((uint8_t*)&incoming + received, data + 2, length - 2);
+			received += length - 2;
+			reply[0] = LEVEL_ACK;
+		}
+		reply[2] = received;
+	} else if(data[0] == LEVEL_FINISH) {
+		if(state == LEVEL_STATE_RECEIVING) {
+			finish(reply);
+		}
+	} else if(data[0] == LEVEL_REMOVE) {
+		if(write_step >= write_steps) {
+			have_uploaded = 0;
+			begin_write(1);
+			reply[0] = LEVEL_ACK;
+		}
+	} else if(data[0] == LEVEL_STATUS) {
+		reply[0] = LEVEL_ACK;
+		reply[2] = state;
+		memcpy(reply + 3, &upload_ms, sizeof(uint16_t));
+		memcpy(reply + 5, &playable_ms, sizeof(uint16_t));
+		memcpy(reply + 7, &stored_ms, sizeof(uint16_t));
+		reply_length += 3 * sizeof(uint16_t);
+	}
+	(void)frame_send(FRAME_BULK, reply, reply_length);
+}
+
+void level_task(void) {
+	while(write_step < write_steps && eeprom_is_ready()) {
+		uint8_t* address = (uint8_t*)LEVEL_SLOT_START;
+		uint8_t value;
+		if(write_step == 0) {
+			value = 0xFF;
+		} else if(write_step < sizeof(slot)) {
+			address += write_step;
+			value = ((uint8_t*)&slot)[write_step];
+		} else {
+			value = slot.magic;
+		}
+		// Only bytes that change are written, so this may get through
+		// several bytes before the EEPROM is busy
+		eeprom_update_byte(address, value);
+		write_step++;
+		if(write_step == write_steps && write_steps > 1) {
+			stored_ms = ms_since_begin();
+			state = LEVEL_STATE_STORED;
+		}
+	}
+}
+
+static const char state_idle_name[] PROGMEM = "idle";
+static const char state_receiving_name[] PROGMEM = "receiving";
+static const char state_playable_name[] PROGMEM = "playable";
+static const char state_stored_name[] PROGMEM = "stored";
+static const char state_failed_name[] PROGMEM = "failed";
+static const char* const state_names[] PROGMEM = {
+	state_idle_name, state_receiving_name, state_playable_name,
+	state_stored_name, state_failed_name
+};
+
+uint8_t level_print_stats(uint8_t line) {
+	uint8_t timed = state != LEVEL_STATE_IDLE && state != LEVEL_STATE_RECEIVING;
+	if(line == 0) {
+		printf_P(PSTR("level upload: %S"), (const char*)pgm_read_word(&state_names[state]));
+		if(timed) {
+			printf_P(PSTR(", %u bytes in %ums"), sizeof(Level), upload_ms);
+			if(upload_ms) {
+				printf_P(PSTR(" (%lu bytes/s)"), sizeof(Level) * 1000UL / upload_ms);
+			}
+		}
+	} else {
+		printf_P(PSTR("  playable after %ums, stored after %ums"), playable_ms,
+				stored_ms);
+	}
+	clear_to_end_of_line();
+	return line == 0 && timed;
+}
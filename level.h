@@ -0,0 +1,103 @@
+/*
+ * level.h
+ *
+ * Author: Xinyi Li
+ *
+ * Levels uploaded over the serial port, so a new layout can be tried
+ * without rebuilding the program. An uploaded level replaces one of the
+ * built in levels (see game.c) from the next time that level is started.
+ * It is kept in RAM, or in EEPROM (bytes LEVEL_SLOT_START to
+ * LEVEL_SLOT_END - 1) so it is still there after a reset. Only one level
+ * can be uploaded at a time.
+ *
+ * Levels are uploaded in FRAME_BULK frames (see frame.h). The first byte
+ * of each frame is a command; the board answers every command with a
+ * FRAME_BULK frame of LEVEL_ACK or LEVEL_NAK, the command and an
+ * argument:
+ * - LEVEL_BEGIN, level number (0 to 3), destination (LEVEL_TO_RAM or
+ *   LEVEL_TO_EEPROM), CRC-16 (CCITT, initial value 0xFFFF) of the Level.
+ *   Starts an upload. The argument is 0.
+ * - LEVEL_DATA, offset, data. The next chunk of the Level (the offset is
+ *   the number of bytes sent before it). Chunks can be any size that
+ *   fits in a frame and must be sent in order. The argument is the
+ *   number of bytes received so far (i.e. where the next chunk should
+ *   start - a chunk that doesn't start there is NAKed).
+ * - LEVEL_FINISH. Finishes the upload. The level is checked (length, CRC
+ *   and that it is playable) and used if it is good. The argument is 0
+ *   or the LEVEL_ERROR_ that made it NAK.
+ * - LEVEL_REMOVE. Goes back to the built in level (and removes the level
+ *   from EEPROM). The argument is 0.
+ * - LEVEL_STATUS. Asks for the upload timings. The argument is the
+ *   LEVEL_STATE_ and is followed by the upload time and the time until
+ *   the level was playable and until it was stored, in ms (16 bits each).
+ * Multi-byte values are little endian. The host sends each chunk once
+ * the last one has been ACKed, and resends it if it is NAKed or no answer
+ * comes.
+ */
+
+#ifndef LEVEL_H_
+#define LEVEL_H_
+
+#include <stdint.h>
+#include "pixel_colour.h"
+
+#define LEVEL_SLOT_START 512
+#define LEVEL_SLOT_END 600
+
+// The layout of a level
+typedef struct {
+	uint64_t lanes[3];		// vehicles - see lane_data in game.c
+	uint32_t logs[2];		// logs - see log_data in game.c
+	PixelColour vehicle_colours[3];
+	PixelColour log_colour;
+} __attribute__((packed)) Level;
+
+#define LEVEL_NUMBERS 4
+
+// Commands
+#define LEVEL_BEGIN 1
+#define LEVEL_DATA 2
+#define LEVEL_FINISH 3
+#define LEVEL_REMOVE 4
+#define LEVEL_STATUS 5
+
+// Answers
+#define LEVEL_ACK 0x06
+#define LEVEL_NAK 0x15
+
+#define LEVEL_TO_RAM 0
+#define LEVEL_TO_EEPROM 1
+
+// Why LEVEL_FINISH was NAKed
+#define LEVEL_ERROR_LENGTH 1	// not every byte was received
+#define LEVEL_ERROR_CRC 2
+#define LEVEL_ERROR_UNPLAYABLE 3
+
+// Upload states
+#define LEVEL_STATE_IDLE 0		// no upload since the last reset
+#define LEVEL_STATE_RECEIVING 1
+#define LEVEL_STATE_PLAYABLE 2	// being written to EEPROM
+#define LEVEL_STATE_STORED 3	// in RAM or written to EEPROM
+#define LEVEL_STATE_FAILED 4
+
+/* Load the level saved in EEPROM (if there is one and it is good) */
+void level_init(void);
+
+/* Get the uploaded level for the given level number. Returns 0 if there
+ * isn't one (use the built in level).
+ */
+uint8_t level_get(uint8_t number, Level* level);
+
+/* Handle a FRAME_BULK frame, sending the answer */
+void level_receive(const uint8_t* data, uint8_t length);
+
+/* Write an uploaded level to EEPROM in the background */
+void level_task(void);
+
+/* Print (to standard output) one line of the state and timings of the
+ * last upload, starting from line 0. Returns 1 if there are more lines to
+ * print.
+ */
+uint8_t level_print_stats(uint8_t line);
+
+#endif /* LEVEL_H_ */
@@ -0,0 +1,230 @@
+/*
+ * mirror.c
+ *
+ * Author: Xinyi Li
+ */
+
+#include <avr/pgmspace.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "mirror.h"
+#include "ledmatrix.h"
+#include "serialio.h"
+#include "terminalio.h"
+#include "fmt.h"
+
+#if MIRROR_LEFT_COLUMN + 2 * MATRIX_NUM_COLUMNS - 1 > 80
+#error "The LED matrix mirror doesn't fit on an 80 column terminal"
+#endif
+#if MIRROR_LEFT_COLUMN <= STATUS_COLUMNS
+#error "The LED matrix mirror overlaps the status lines"
+#endif
+
+static uint8_t enabled;
+
+// The matrix (pixels[y][x]) and a bit (1 << x) in dirty[y] for each LED
+// the terminal may not be showing.
+static PixelColour pixels[MATRIX_NUM_ROWS][MATRIX_NUM_COLUMNS];
+static uint16_t dirty[MATRIX_NUM_ROWS];
+
+static uint32_t bytes_sent;
+static uint16_t frames;
+static uint32_t coalesced;
+
+// mirror_flush() builds its output here and sends it as one write. The
+// first LED is always sent, and takes at most 25 bytes.
+#define MIRROR_FLUSH_MAX 64
+static char flush_buffer[MIRROR_FLUSH_MAX + 32];
+static uint8_t flush_length;
+
+void mirror_enable(uint8_t enable) {
+	enabled = enable;
+	mirror_invalidate();
+}
+
+uint8_t mirror_enabled(void) {
+	return enabled;
+}
+
+void mirror_set_pixel(uint8_t x, uint8_t y, PixelColour colour) {
+	if(x >= MATRIX_NUM_COLUMNS || y >= MATRIX_NUM_ROWS ||
+			pixels[y][x] == colour) {
+		return;
+	}
+	if(dirty[y] & (1 << x)) {
+		coalesced++;
+	}
+	pixels[y][x] = colour;
+	dirty[y] |= 1 << x;
+}
+
+void mirror_shift(int8_t dx, int8_t dy) {
+	// Go through the LEDs in the order that doesn't overwrite any before
+	// they have been moved.
+	for(uint8_t i = 0; i < MATRIX_NUM_ROWS; i++) {
+		uint8_t y = dy > 0 ? MATRIX_NUM_ROWS - 1 - i : i;
+		for(uint8_t j = 0; j < MATRIX_NUM_COLUMNS; j++) {
+			uint8_t x = dx > 0 ? MATRIX_NUM_COLUMNS - 1 - j : j;
+			int8_t from_x = x - dx, from_y = y - dy;
+			PixelColour colour = COLOUR_BLACK;
+			if(from_x >= 0 && from_x < MATRIX_NUM_COLUMNS &&
+					from_y >= 0 && from_y < MATRIX_NUM_ROWS) {
+				colour = pixels[from_y][from_x];
+			}
+			mirror_set_pixel(x, y, colour);
+		}
+	}
+}
+
+void mirror_clear(void) {
+	for(uint8_t y = 0; y < MATRIX_NUM_ROWS; y++) {
+		for(uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+			mirror_set_pixel(x, y, COLOUR_BLACK);
+		}
+	}
+}
+
+void mirror_invalidate(void) {
+	memset(dirty, 0xFF, sizeof(dirty));
+}
+
+/* The xterm 256 colour palette has a 6x6x6 colour cube at 16 + 36 * red +
+ * 6 * green + blue. The LEDs have 16 levels of red and green, which are
+ * rounded up to the cube's 6 levels so that dim LEDs still show.
+ */
+static uint8_t colour_index(PixelColour colour) {
+	uint8_t red = ((colour & 0x0F) * 5 + 14) / 15;
+	uint8_t green = ((colour >> 4) * 5 + 14) / 15;
+	return 16 + 36 * red + 6 * green;
+}
+
+static void mirror_putchar(char c) {
+	flush_buffer[flush_length++] = c;
+}
+
+static void mirror_put_number(uint8_t n) {
+	flush_length += fmt_unsigned(flush_buffer + flush_length, n, 0);
+}
+
+static uint8_t digits(uint8_t n) {
+	return n >= 100 ? 3 : n >= 10 ? 2 : 1;
+}
+
+static uint8_t terminal_row(uint8_t y) {
+	return MIRROR_TOP_ROW + MATRIX_NUM_ROWS - 1 - y;
+}
+
+static uint8_t terminal_column(uint8_t x) {
+	return MIRROR_LEFT_COLUMN + 2 * x;
+}
+
+uint8_t mirror_flush(uint8_t max_bytes) {
+	// Where the cursor is (the LED it is on) and the background colour,
+	// once we have set them
+	uint8_t started = 0;
+	uint8_t cursor_x = 0, cursor_y = 0;
+	uint8_t background = 0;
+
+	if(!enabled) {
+		return 1;
+	}
+	if(max_bytes > MIRROR_FLUSH_MAX) {
+		max_bytes = MIRROR_FLUSH_MAX;
+	}
+	flush_length = 0;
+
+	for(int8_t y = MATRIX_NUM_ROWS - 1; y >= 0; y--) {
+		if(!dirty[y]) {
+			continue;
+		}
+		for(uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+			if(!(dirty[y] & (1 << x))) {
+				continue;
+			}
+			// Cost of moving to the LED (nothing if we're there already,
+			// ESC [ n C along the row, otherwise ESC [ row ; column H),
+			// setting the colour (ESC [ 48 ; 5 ; n m) and drawing it
+			uint8_t index = colour_index(pixels[y][x]);
+			uint8_t move = 0;
+			if(!started || y != cursor_y) {
+				move = 4 + digits(terminal_row(y)) + digits(terminal_column(x));
+			} else if(x != cursor_x) {
+				move = 3 + digits(2 * (x - cursor_x));
+			}
+			uint8_t colour = (!started || index != background) ?
+					8 + digits(index) : 0;
+			// Leave room to restore the cursor (2 bytes). We always send
+			// at least one LED so we make progress.
+			if(started && flush_length + move + colour + 2 + 2 > max_bytes) {
+				break;
+			}
+			if(!started) {
+				// Save the cursor (and attributes)
+				mirror_putchar('\x1b');
+				mirror_putchar('7');
+			}
+			if(move) {
+				mirror_putchar('\x1b');
+				mirror_putchar('[');
+				if(!started || y != cursor_y) {
+					mirror_put_number(terminal_row(y));
+					mirror_putchar(';');
+					mirror_put_number(terminal_column(x));
+					mirror_putchar('H');
+				} else {
+					mirror_put_number(2 * (x - cursor_x));
+					mirror_putchar('C');
+				}
+			}
+			if(colour) {
+				memcpy_P(flush_buffer + flush_length, PSTR("\x1b[48;5;"), 7);
+				flush_length += 7;
+				mirror_put_number(index);
+				mirror_putchar('m');
+				background = index;
+			}
+			mirror_putchar(' ');
+			mirror_putchar(' ');
+			dirty[y] &= ~(1 << x);
+			started = 1;
+			cursor_x = x + 1;
+			cursor_y = y;
+		}
+		if(dirty[y]) {
+			// Out of room
+			break;
+		}
+	}
+	if(!started) {
+		return 1;
+	}
+	// Restoring the cursor restores the attributes too
+	mirror_putchar('\x1b');
+	mirror_putchar('8');
+	if(serial_write(flush_buffer, flush_length)) {
+		bytes_sent += flush_length;
+		frames++;
+	} else {
+		// The terminal is no longer known to show what we think
+		mirror_invalidate();
+	}
+	for(uint8_t y = 0; y < MATRIX_NUM_ROWS; y++) {
+		if(dirty[y]) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+uint8_t mirror_print_stats(uint8_t line) {
+	if(line == 0) {
+		printf_P(PSTR("mirror %S: %lu bytes in %u frames (%lu per frame)"),
+				enabled ? PSTR("on") : PSTR("off"), bytes_sent, frames,
+				frames ? bytes_sent / frames : 0);
+	} else {
+		printf_P(PSTR("  %lu LEDs coalesced"), coalesced);
+	}
+	clear_to_end_of_line();
+	return line == 0;
+}
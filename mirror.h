@@ -0,0 +1,56 @@
+/*
+ * mirror.h
+ *
+ * Author: Xinyi Li
+ *
+ * A copy of the LED matrix drawn on the serial terminal, for when the
+ * matrix is turned off or out of sight. Each LED is shown as two spaces
+ * with the nearest xterm 256 colour background, to the right of the
+ * status lines.
+ *
+ * ledmatrix.c tells the mirror about every change to the matrix. The
+ * mirror keeps a copy of the matrix and a dirty bit for each LED the
+ * terminal doesn't show yet, and mirror_flush() sends only the dirty
+ * LEDs (in one write, with the cursor saved and restored around them).
+ * A LED that changes again before it is sent is only sent once.
+ */
+
+#ifndef MIRROR_H_
+#define MIRROR_H_
+
+#include <stdint.h>
+#include "pixel_colour.h"
+
+// Where the top left LED is drawn on the terminal - just right of the
+// status lines, so the whole matrix fits on an 80 column terminal
+#define MIRROR_TOP_ROW 2
+#define MIRROR_LEFT_COLUMN 34
+
+/* Turn the mirror on or off. Turning it on draws the whole matrix. */
+void mirror_enable(uint8_t enable);
+uint8_t mirror_enabled(void);
+
+/* Called by ledmatrix.c when the matrix changes. (x, y) is in matrix
+ * coordinates - see ledmatrix.h. mirror_shift() moves everything by dx
+ * columns and dy rows, filling in with black.
+ */
+void mirror_set_pixel(uint8_t x, uint8_t y, PixelColour colour);
+void mirror_shift(int8_t dx, int8_t dy);
+void mirror_clear(void);
+
+/* The terminal has been cleared - draw everything again */
+void mirror_invalidate(void);
+
+/* Send the changed LEDs to the terminal, using no more than about
+ * max_bytes bytes (at least one LED is always sent). Returns 1 if the
+ * terminal is now up to date, 0 if there are more changes to send.
+ */
+uint8_t mirror_flush(uint8_t max_bytes);
+
+/* Print (to standard output) one line of the bytes and frames (flushes
+ * that sent something) sent and the average bytes per frame, starting
+ * from line 0. Returns 1 if there are more lines to print.
+ */
+uint8_t mirror_print_stats(uint8_t line);
+
+#endif /* MIRROR_H_ */
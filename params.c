@@ -0,0 +1,184 @@
+/*
+ * params.c
+ *
+ * Author: Xinyi Li
+ */
+
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+#include <util/crc16.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "params.h"
+#include "buttons.h"
+#include "terminalio.h"
+
+#define PARAMS_MAGIC 0x5A
+
+typedef struct {
+	const char* name;		// in program memory
+	uint8_t type;
+	uint16_t default_value;
+	uint16_t min;
+	uint16_t max;
+} ParamInfo;
+
+static const char lane0_name[] PROGMEM = "lane0";
+static const char lane1_name[] PROGMEM = "lane1";
+static const char lane2_name[] PROGMEM = "lane2";
+static const char log0_name[] PROGMEM = "log0";
+static const char log1_name[] PROGMEM = "log1";
+static const char countdown_name[] PROGMEM = "countdown";
+static const char repeat_delay_name[] PROGMEM = "repeat_delay";
+static const char repeat_interval_name[] PROGMEM = "repeat_interval";
+static const char move_sound_name[] PROGMEM = "move_sound";
+static const char game_over_sound_name[] PROGMEM = "game_over_sound";
+
+// In the same order as Param
+static const ParamInfo params[NUM_PARAMS] PROGMEM = {
+	{ lane0_name, PARAM_U8, 10, 1, 50 },
+	{ lane1_name, PARAM_U8, 13, 1, 50 },
+	{ lane2_name, PARAM_U8, 8, 1, 50 },
+	{ log0_name, PARAM_U8, 9, 1, 50 },
+	{ log1_name, PARAM_U8, 11, 1, 50 },
+	{ countdown_name, PARAM_U8, 15, 1, 99 },
+	{ repeat_delay_name, PARAM_U16, 500, 1, 5000 },
+	{ repeat_interval_name, PARAM_U16, 100, 1, 5000 },
+	{ move_sound_name, PARAM_U16, 200, 0, 5000 },
+	{ game_over_sound_name, PARAM_U16, 1000, 0, 5000 }
+};
+
+uint16_t param_values[NUM_PARAMS];
+
+/* The parameters in EEPROM: magic number, version, number of parameters,
+ * the values (one byte for a PARAM_U8, two for a PARAM_U16, low byte
+ * first) and a CRC-16 of everything before it. It is built in image and
+ * written from there by params_task().
+ */
+static uint8_t image[PARAMS_END - PARAMS_START];
+static uint8_t image_length;
+static uint8_t image_written;
+
+#if 3 + 2 * NUM_PARAMS + 2 > PARAMS_END - PARAMS_START
+#error "Too many parameters to save in EEPROM"
+#endif
+
+#define PARAM_INFO(index, field) pgm_read_word(&params[index].field)
+
+// Apply the parameters that are held somewhere else
+static void changed(void) {
+	set_button_repeat(param(PARAM_REPEAT_DELAY), param(PARAM_REPEAT_INTERVAL));
+}
+
+void params_defaults(void) {
+	for(uint8_t i = 0; i < NUM_PARAMS; i++) {
+		param_values[i] = PARAM_INFO(i, default_value);
+	}
+	changed();
+}
+
+static uint16_t crc(const uint8_t* data, uint8_t length) {
+	uint16_t crc = 0xFFFF;
+	while(length--) {
+		crc = _crc_ccitt_update(crc, *data++);
+	}
+	return crc;
+}
+
+uint8_t params_load(void) {
+	uint8_t length = 3;
+	uint16_t values[NUM_PARAMS];
+
+	// The values are decoded into values and only used once every check
+	// has passed, so a bad copy leaves the parameters as they were.
+	// (image is being written to EEPROM while saving.)
+	if(params_saving()) {
+		return 0;
+	}
+	eeprom_read_block(image, (void*)PARAMS_START, sizeof(image));
+	if(image[0] != PARAMS_MAGIC || image[1] != PARAMS_VERSION ||
+			image[2] != NUM_PARAMS) {
+		return 0;
+	}
+	for(uint8_t i = 0; i < NUM_PARAMS; i++) {
+		values[i] = image[length++];
+		if(pgm_read_byte(&params[i].type) == PARAM_U16) {
+			values[i] |= image[length++] << 8;
+		}
+		if(values[i] < PARAM_INFO(i, min) || values[i] > PARAM_INFO(i, max)) {
+			return 0;
+		}
+	}
+	if(crc(image, length) != (image[length] | (image[length + 1] << 8))) {
+		return 0;
+	}
+	memcpy(param_values, values, sizeof(param_values));
+	changed();
+	return 1;
+}
+
+int8_t param_find(const char* name) {
+	for(uint8_t i = 0; i < NUM_PARAMS; i++) {
+		if(strcmp_P(name, (const char*)pgm_read_word(&params[i].name)) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+uint8_t param_set(Param index, uint16_t value) {
+	if(index >= NUM_PARAMS || value < PARAM_INFO(index, min) ||
+			value > PARAM_INFO(index, max)) {
+		return 0;
+	}
+	param_values[index] = value;
+	changed();
+	return 1;
+}
+
+void params_save(void) {
+	uint8_t length = 0;
+	image[length++] = PARAMS_MAGIC;
+	image[length++] = PARAMS_VERSION;
+	image[length++] = NUM_PARAMS;
+	for(uint8_t i = 0; i < NUM_PARAMS; i++) {
+		image[length++] = param_values[i] & 0xFF;
+		if(pgm_read_byte(&params[i].type) == PARAM_U16) {
+			image[length++] = param_values[i] >> 8;
+		}
+	}
+	uint16_t check = crc(image, length);
+	image[length++] = check & 0xFF;
+	image[length++] = check >> 8;
+	image_length = length;
+	image_written = 0;
+}
+
+uint8_t params_saving(void) {
+	return image_written < image_length;
+}
+
+// Write the parameters to EEPROM a byte at a time as the EEPROM becomes
+// ready, so we never wait for it.
+void params_task(void) {
+	while(image_written < image_length && eeprom_is_ready()) {
+		// Only bytes that change are written, so this may get through
+		// several bytes before the EEPROM is busy
+		eeprom_update_byte((uint8_t*)PARAMS_START + image_written,
+				image[image_written]);
+		image_written++;
+	}
+}
+
+void param_print(Param index) {
+	printf_P(PSTR("%S = %u (%u to %u)"),
+			(const char*)pgm_read_word(&params[index].name), param(index),
+			PARAM_INFO(index, min), PARAM_INFO(index, max));
+	clear_to_end_of_line();
+}
+
+uint8_t params_print(uint8_t line) {
+	param_print(line);
+	return line < NUM_PARAMS - 1;
+}
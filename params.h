@@ -0,0 +1,95 @@
+/*
+ * params.h
+ *
+ * Author: Xinyi Li
+ *
+ * Game parameters that can be changed while the game is running, from
+ * the serial console (see console.c), instead of being compiled in. Each
+ * parameter has a name, a type and a range (kept in program memory) and
+ * a value (kept in RAM). Reading a value with param() is a single array
+ * access, so it costs about the same as using a constant.
+ *
+ * The values can be saved to EEPROM (bytes PARAMS_START to PARAMS_END - 1)
+ * and are loaded from there at start up. The saved values are tagged
+ * with PARAMS_VERSION and a CRC; if they don't match (e.g. nothing has
+ * been saved, or the parameters have changed since) the defaults are
+ * used. PARAMS_VERSION must be changed whenever a parameter is added,
+ * removed or reordered.
+ *
+ * A recorded game (see record.h) only replays the same way with the
+ * parameters it was recorded with.
+ */
+
+#ifndef PARAMS_H_
+#define PARAMS_H_
+
+#include <stdint.h>
+
+#define PARAMS_START 448
+#define PARAMS_END 512
+#define PARAMS_VERSION 1
+
+typedef enum {
+	// Lane and log channel cycle times, in 100ms steps (before the
+	// speed up for the level - see lane_task())
+	PARAM_LANE0_PERIOD,
+	PARAM_LANE1_PERIOD,
+	PARAM_LANE2_PERIOD,
+	PARAM_LOG0_PERIOD,
+	PARAM_LOG1_PERIOD,
+	// Time allowed to get each frog home, in seconds
+	PARAM_COUNTDOWN,
+	// Button auto repeat delay and interval, in ms
+	PARAM_REPEAT_DELAY,
+	PARAM_REPEAT_INTERVAL,
+	// Sound lengths, in ms
+	PARAM_MOVE_SOUND,
+	PARAM_GAME_OVER_SOUND,
+	NUM_PARAMS
+} Param;
+
+// Parameter types (the largest value they can have)
+#define PARAM_U8 0
+#define PARAM_U16 1
+
+// The parameter values. Use param() to read them and param_set() to
+// change them.
+extern uint16_t param_values[NUM_PARAMS];
+
+static inline uint16_t param(Param index) {
+	return param_values[index];
+}
+
+/* Load the parameters from EEPROM. Returns 1 if they were loaded, or 0
+ * (leaving every parameter unchanged) if none have been saved, the saved
+ * copy is bad or a save is still being written.
+ */
+uint8_t params_load(void);
+
+/* Set every parameter to its default value */
+void params_defaults(void);
+
+/* Find a parameter by name. Returns -1 if there is no such parameter. */
+int8_t param_find(const char* name);
+
+/* Set a parameter. Returns 0 (and leaves the parameter unchanged) if the
+ * value is out of range.
+ */
+uint8_t param_set(Param index, uint16_t value);
+
+/* Start saving the parameters to EEPROM. They are written in the
+ * background by params_task(). params_saving() returns 1 until the
+ * write has finished.
+ */
+void params_save(void);
+uint8_t params_saving(void);
+void params_task(void);
+
+/* Print (to standard output) a parameter as "name = value (min to max)".
+ * params_print() prints every parameter, one line at a time (line n is
+ * parameter n), and returns 1 if there are more lines to print.
+ */
+void param_print(Param index);
+uint8_t params_print(uint8_t line);
+
+#endif /* PARAMS_H_ */
@@ -9,6 +9,7 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <avr/pgmspace.h>
+#include <avr/power.h>
 #include <stdio.h>
 #include <math.h>
 
@@ -17,6 +18,8 @@
 #include "scrolling_char_display.h"
 #include "buttons.h"
 #include "serialio.h"
+#include "fmt.h"
+#include "frame.h"
 #include "terminalio.h"
 #include "score.h"
 #include "timer0.h"
@@ -25,47 +28,109 @@
 #include "joystick.h"
 #include "sound.h"
 #include "eeprom.h"
+#include "scheduler.h"
+#include "console.h"
+#include "pt.h"
+#include "input.h"
+#include "record.h"
+#include "latency.h"
+#include "telemetry.h"
+#include "mirror.h"
+#include "params.h"
+#include "level.h"
 
-#define F_CPU 8000000L
-#include <util/delay.h>
+#include "clock.h"
 
 // Function prototypes - these are defined below (after main()) in the order
 // given here
 void initialise_hardware(void);
-void splash_screen(void);
+static uint8_t splash_screen(Pt* pt);
+static uint8_t request_name(Pt* pt);
 void new_game(void);
 void play_game(void);
-void handle_game_over(void);
+void stop_game(void);
+static uint8_t handle_game_over(Pt* pt);
+static uint8_t next_input_event(InputEvent* event);
+static uint8_t screen_button_pushed(void);
 void init_life(void);
 void set_life(uint8_t life);
+void init_tasks(void);
 
 // ASCII code for Escape character
-#define ESCAPE_CHAR 27
 
 uint8_t seven_seg[10] = {63,6,91,79,102,109,125,7,127,111};
 
+// What the game is doing. The game task (see game_thread() below) steps
+// through these. The splash screen, level transition, game over and name
+// entry screens are protothreads which wait for timers and input without
+// blocking, so every other task keeps running while they are shown.
+typedef enum {
+	MODE_SPLASH,
+	MODE_PLAYING,
+	MODE_LEVEL_DONE,
+	MODE_GAME_OVER,
+	MODE_NAME_ENTRY,
+	NUM_MODES
+} GameMode;
+
+static const char mode_splash_name[] PROGMEM = "splash";
+static const char mode_playing_name[] PROGMEM = "playing";
+static const char mode_level_done_name[] PROGMEM = "level done";
+static const char mode_game_over_name[] PROGMEM = "game over";
+static const char mode_name_entry_name[] PROGMEM = "name entry";
+static const char* const mode_names[NUM_MODES] PROGMEM = {
+	mode_splash_name, mode_playing_name, mode_level_done_name,
+	mode_game_over_name, mode_name_entry_name
+};
+
+static GameMode mode;
+static Pt game_pt, screen_pt, name_pt;
+
+// Timer used by the screens to wait between animation steps
+static SoftTimer screen_timer;
+
+// Input latency - the longest time (in us) between one check for input
+// and the next, for each mode. The gap across a change of mode (e.g.
+// while a new game is drawn) is kept separately.
+static uint16_t input_latency_us[NUM_MODES];
+static uint16_t mode_change_latency_us;
+static uint32_t last_input_poll_us;
+static uint8_t mode_changed;
+
+// The name typed in on the name entry screen
+static uint8_t name[12];
+static uint8_t name_length;
+static int8_t high_score_slot;
+
 /////////////////////////////// main //////////////////////////////////
 int main(void) {
 	// Setup hardware and call backs. This will turn on 
 	// interrupts.
 	initialise_hardware();
-	// Show the splash screen message. Returns when display
-	// is complete
-	splash_screen();
+	// Everything else is done by the scheduler tasks. The game task
+	// shows the splash screen and then plays games over and over.
 	while(1) {
-		new_game();
-		play_game();
-		handle_game_over();
+		scheduler_run();
 	}
 }
 
 void initialise_hardware(void) {
 	ledmatrix_setup();
-	init_button_interrupts();
+	init_buttons();
+
+	// Load the saved game parameters, or use the defaults if there are
+	// none (this sets the button auto repeat), and any level that was
+	// uploaded to EEPROM
+	if(!params_load()) {
+		params_defaults();
+	}
+	level_init();
 
 	// Setup serial port for 19200 baud communication with no echo
 	// of incoming characters
-	init_serial_stdio(19200,0);
+	init_serial_stdio(SERIAL_BAUD,0);
+	// Serial input goes to the input queue along with the other inputs
+	serial_input_to_events(1);
 	
 	// Initialise joystick
 	initialise_joystick();
@@ -82,17 +147,60 @@ void initialise_hardware(void) {
 	// Setup sounds
 	init_sound();
 
+	// Setup the game tasks
+	init_tasks();
+
+	// Turn off the peripherals we don't use to save power
+	power_twi_disable();
+	power_usart1_disable();
+
 	// Turn on global interrupts
 	sei();
 }
 
-void splash_screen(void) {
+static void set_mode(GameMode new_mode) {
+	mode = new_mode;
+	mode_changed = 1;
+}
+
+// Record the time since input was last checked. This is called every
+// time input is checked, whatever the mode.
+static void input_polled(void) {
+	uint32_t now = get_current_time_us();
+	uint32_t gap = now - last_input_poll_us;
+	if(gap > UINT16_MAX) {
+		gap = UINT16_MAX;
+	}
+	last_input_poll_us = now;
+	if(mode_changed) {
+		mode_changed = 0;
+		if(gap > mode_change_latency_us) {
+			mode_change_latency_us = gap;
+		}
+	} else if(gap > input_latency_us[mode]) {
+		input_latency_us[mode] = gap;
+	}
+}
+
+uint8_t print_input_latency(uint8_t line) {
+	if(line == 0) {
+		printf_P(PSTR("input latency (us): mode change %u"), mode_change_latency_us);
+		mode_change_latency_us = 0;
+	} else {
+		printf_P(PSTR("  %-10S %5u"), (const char*)pgm_read_word(&mode_names[line - 1]),
+				input_latency_us[line - 1]);
+		input_latency_us[line - 1] = 0;
+	}
+	clear_to_end_of_line();
+	return line < NUM_MODES;
+}
+
+static uint8_t splash_screen(Pt* pt) {
+	PT_BEGIN(pt);
 	// Clear terminal screen and output a message
 	clear_terminal();
-	move_cursor(10,10);
-	printf_P(PSTR("Frogger"));
-	move_cursor(10,12);
-	printf_P(PSTR("CSSE2010/7201 project by Xinyi Li"));
+	print_at_P(10, 10, PSTR("Frogger"));
+	print_at_P(10, 12, PSTR("CSSE2010/7201 project by Xinyi Li"));
 	read_eeprom();
 	move_cursor(10,20);
 	// Output the scrolling message to the LED matrix
@@ -103,44 +211,50 @@ void splash_screen(void) {
 		// Scroll the message until it has scrolled off the 
 		// display or a button is pushed
 		while(scroll_display()) {
-			_delay_ms(150);
-			if(button_pushed() != NO_BUTTON_PUSHED) {
-				return;
+			soft_timer_arm(&screen_timer, 150, 0, 0);
+			PT_WAIT_UNTIL(pt, screen_timer.expired || screen_button_pushed());
+			if(!screen_timer.expired) {
+				soft_timer_cancel(&screen_timer);
+				PT_EXIT(pt);
 			}
 		}
 	}
+	PT_END(pt);
 }
 
-uint8_t* request_name(void) {
+static uint8_t request_name(Pt* pt) {
+	InputEvent event;
+	char serial_input;
+	PT_BEGIN(pt);
 	clear_terminal();
 	read_eeprom();
 	move_cursor(0, 0);
-	printf("\nYou achieved a new highscore!\n");
-	printf("Your name: ");
-	static uint8_t name[12];
-	int i = 0;
-	//int cursor_position = 12;
+	fmt_put_string_P(PSTR("\nYou achieved a new highscore!\n"));
+	fmt_put_string_P(PSTR("Your name: "));
+	name_length = 0;
 	while (1) {
-		if(serial_input_available()) {
-			char serial_input = fgetc(stdin);
-			if (serial_input == '\n') {
-				break;
-			} else if (serial_input == 127) {
-			} else if (serial_input == 68) {
+		PT_WAIT_UNTIL(pt, next_input_event(&event) && event.source == INPUT_SERIAL);
+		serial_input = event.code;
+		if (serial_input == '\n') {
+			break;
+		} else if (serial_input == '\b') {
+			if (name_length > 0) {
+				move_left();
+				serial_put_char(' ');
 				move_left();
-				i--;
-			} else {
-				if (i < 10) {
-					printf("%c", serial_input);
-					name[i] = serial_input;
-					i++;
-				}
+				name_length--;
+			}
+		} else if (serial_input >= ' ' && serial_input <= '~') {
+			if (name_length < 10) {
+				serial_put_char(serial_input);
+				name[name_length] = serial_input;
+				name_length++;
 			}
 		}
 	}
-	name[12] = '\0';
+	name[name_length] = '\0';
 	clear_terminal();
-	return name;
+	PT_END(pt);
 }
 
 // Set up life tracker with PORT D0 - D4.
@@ -159,19 +273,24 @@ void set_life(uint8_t life) {
 	PORTA = new_life;
 }
 
+// The score, level and lives are shown in the status lines, which are
+// sent to the terminal by status_task().
+void print_score(void) {
+	status_print_number_P(STATUS_SCORE, PSTR("Your score is: "), get_score(), 9);
+}
+
 void print_stats() {
-	move_cursor(10,1);
-	printf("\nYour score is: %9lu\n", get_score());
-	move_cursor(10,2);
-	printf("\nCurrent Level: %9i \n", current_level + 1);
-	move_cursor(10,3);
-	printf("\nLives remaining: %7i\n", current_life);
+	print_score();
+	status_print_number_P(STATUS_LEVEL, PSTR("Current Level: "), current_level + 1, 9);
+	status_print_number_P(STATUS_LIVES, PSTR("Lives remaining: "), current_life, 7);
 }
 
 void new_game(void) {
+	RecordStart start;
 
-	// Initialise the game and display
-	initialise_game();
+	// The LED matrix checksum covers everything the game displays (see
+	// record.h)
+	ledmatrix_reset_checksum();
 	
 	// Clear the serial terminal
 	clear_terminal();
@@ -181,7 +300,16 @@ void new_game(void) {
 	
 	// Enable Joystick
 	joystick_enable = 1;
-	if (!on_same_game) {
+	if (replay_begin(&start)) {
+		// Start from where the recorded game started
+		current_level = start.level;
+		current_life = start.lives;
+		on_same_game = start.on_same_game;
+		paused = start.paused;
+		set_life(current_life);
+		set_score(start.score);
+		status_print_P(STATUS_SCORE, PSTR("Replaying recorded game"));
+	} else if (!on_same_game) {
 		// If all lives are expended, reset the lives to start a fresh game.
 		current_level = 0;
 		current_life = STARTING_LIVES;
@@ -189,387 +317,573 @@ void new_game(void) {
 		// Initialise the score
 		init_score();
 	} else {
-		move_cursor(10,1);
-		printf("\nYour score is: %9lu\n", get_score());
+		print_score();
 	}
-	// Clear a button push or serial input if any are waiting
-	// (The cast to void means the return value is ignored.)
-	(void)button_pushed();
-	clear_serial_input_buffer();
+
+	// Initialise the game and display (once the level is known - the
+	// level decides what is displayed)
+	initialise_game();
+
+	// Clear any button pushes, serial input or joystick moves that are
+	// waiting
+	input_flush();
 }
 
-void play_game(void) {
-	uint32_t current_time, last_move_time, last_button_down, last_joy_held, sound_play_time;
-	uint8_t button; 
-	uint8_t pressed_button = NO_BUTTON_PUSHED;
-	char serial_input, escape_sequence_char;
-	uint8_t characters_into_escape_sequence = 0;
-	int count_ms = 0;
-	uint8_t tone_at = 0;
-	// Get the current time and remember this as the last time the vehicles
-	// and logs were moved.
-	current_time = get_current_time();
-	last_move_time = current_time;
-	sound_play_time = current_time;
-	
-	// Get the current time and remember the last time the button was pushed.
-	last_button_down = current_time + 500;
-	
-	// We play the game while the frog is alive and we haven't filled up the 
-	// far riverbank
-	
-	//Joystick control variables
-	last_joy_held = current_time + 500;
-	uint8_t x_or_y = 0;
-	int x = 500;
-	int y = 500;
-	int last_direction = 0;
-	int joy_held = 0;
-	int is_first_pass = 1;
-	
-	// Setup array of counters;
-	int counters[7] = {0, 0, 0, 0, 0, 0, 0};
-	while(!is_frog_dead() && !is_riverbank_full()) {
-		
-		// Display the time remaining
-		if (time_remaining_s >= 10) {
+// State shared by the game tasks below. These were local variables of
+// play_game() when it was one big polling loop.
+static int count_ms;
+
+// The game tick - the number of passes the play tasks have made since
+// the game started. Recorded events are stamped with it (rather than the
+// time) and the countdown and lanes step on it, so a replay steps the
+// game exactly as it was recorded even if the scheduler skipped ticks.
+static uint32_t game_tick;
+
+// The countdown and lanes step every GAME_STEP_TICKS game ticks
+#define GAME_STEP_TICKS 100
+
+// Start of game tones: frequency (Hz), duration (ms) and the delay (ms)
+// until the next tone (0 for the last tone).
+static const uint16_t intro_tones[][3] = {
+	{500, 200, 200},
+	{800, 300, 300},
+	{1500, 500, 0}
+};
+static uint8_t tone_at;
+static SoftTimer tone_timer;
+
+
+// Counters for the lanes and countdown. These tick up every 100ms so we
+// can effectively set custom cycle times by adjusting the max value
+// each counter should tick up to.
+static int lane_counters[5];
+static int countdown_counter;
+
+// Show the time remaining on the seven segment display. (The display
+// digit is multiplexed using cc, which is toggled every tick.)
+static void render_task(void) {
+	if (time_remaining_ms == 0) {
+		display_digit(seven_seg[0], 0, 0);
+	} else if (time_remaining_s >= 10) {
+		if (cc)
+			display_digit(seven_seg[1], 1, 0);
+		else
+			display_digit(seven_seg[time_remaining_s % 10], 0, 0);
+	} else if (time_remaining_s > 1)
+		display_digit(seven_seg[time_remaining_s % 10], 0, 0);
+	else {
+		count_ms = 1;
+		if (time_remaining_ms > 10) {
+				display_digit(seven_seg[1], 0, 0);
+		} else {
 			if (cc)
-				display_digit(seven_seg[1], 1, 0);
+				display_digit(seven_seg[0], 1, 1);
 			else
-				display_digit(seven_seg[time_remaining_s % 10], 0, 0);
-		} else if (time_remaining_s > 1)
-			display_digit(seven_seg[time_remaining_s % 10], 0, 0);
-		else {
-			count_ms = 1;
-			if (time_remaining_ms > 10) {
-					display_digit(seven_seg[1], 0, 0);
-			} else {
-				if (cc)
-					display_digit(seven_seg[0], 1, 1);
-				else
-					display_digit(seven_seg[time_remaining_ms > 0 ? time_remaining_ms - 1 : 0], 0, 0);
-				
-			}
+				display_digit(seven_seg[time_remaining_ms > 0 ? time_remaining_ms - 1 : 0], 0, 0);
+			
 		}
-		
-		// Game over if timer has reached 0
-		if (time_remaining_ms == 0) {
-			display_digit(seven_seg[0], 0, 0);
-			count_ms = 0;
-			frog_dead = 1;
-			redraw_frog();
-			break;
+	}
+}
+
+// Take the next event off the input queue. Serial input that is part of
+// a console command is given to the console here (except while a name
+// is being typed), so the console can be used whatever the game is doing.
+static uint8_t next_input_event(InputEvent* event) {
+	while(input_get(event)) {
+		if(event->source == INPUT_SERIAL && mode != MODE_NAME_ENTRY &&
+				console_input(event->code)) {
+			continue;
 		}
+		return 1;
+	}
+	return 0;
+}
 
-		if(!is_frog_dead() && frog_has_reached_riverbank()) {
-			// Frog reached the other side successfully but the
-			// riverbank isn't full, put a new frog at the start
-			put_frog_in_start_position();
+// Handle the input waiting on the splash and game over screens. Returns 1
+// if a button was pushed. (Any other input is ignored.)
+static uint8_t screen_button_pushed(void) {
+	InputEvent event;
+	while(next_input_event(&event)) {
+		if(event.source == INPUT_BUTTON &&
+				(event.code & BUTTON_EVENT_TYPE_MASK) != BUTTON_EVENT_RELEASE) {
+			return 1;
 		}
-		
-		// Check for input - which could be a button push or serial input.
-		// Serial input may be part of an escape sequence, e.g. ESC [ D
-		// is a left cursor key press. At most one of the following three
-		// variables will be set to a value other than -1 if input is available.
-		// (We don't initalise button to -1 since button_pushed() will return -1
-		// if no button pushes are waiting to be returned.)
-		// Button pushes take priority over serial input. If there are both then
-		// we'll retrieve the serial input the next time through this loop
-		serial_input = -1;
-		escape_sequence_char = -1;
-		button = button_pushed();
-
-		if(button == 255) {
-			// No push button was pushed, see if there is any serial input
-			if(serial_input_available()) {
-				// Serial data was available - read the data from standard input
-				serial_input = fgetc(stdin);
-				// Check if the character is part of an escape sequence
-				if(characters_into_escape_sequence == 0 && serial_input == ESCAPE_CHAR) {
-					// We've hit the first character in an escape sequence (escape)
-					characters_into_escape_sequence++;
-					serial_input = -1; // Don't further process this character
-				} else if(characters_into_escape_sequence == 1 && serial_input == '[') {
-					// We've hit the second character in an escape sequence
-					characters_into_escape_sequence++;
-					serial_input = -1; // Don't further process this character
-				} else if(characters_into_escape_sequence == 2) {
-					// Third (and last) character in the escape sequence
-					escape_sequence_char = serial_input;
-					serial_input = -1;  // Don't further process this character - we
-										// deal with it as part of the escape sequence
-					characters_into_escape_sequence = 0;
-				} else {
-					// Character was not part of an escape sequence (or we received
-					// an invalid second character in the sequence). We'll process 
-					// the data in the serial_input variable.
-					characters_into_escape_sequence = 0;
-				}
-			}
+	}
+	return 0;
+}
+
+static void move_frog_in_direction(JoystickDirection direction) {
+	switch (direction) {
+		case JOYSTICK_FORWARD:
+			move_frog_forward();
+			break;
+		case JOYSTICK_BACKWARD:
+			move_frog_backward();
+			break;
+		case JOYSTICK_LEFT:
+			move_frog_to_left();
+			break;
+		case JOYSTICK_RIGHT:
+			move_frog_to_right();
+			break;
+		case JOYSTICK_UP_LEFT:
+			move_frog_up_left();
+			break;
+		case JOYSTICK_UP_RIGHT:
+			move_frog_up_right();
+			break;
+		case JOYSTICK_DOWN_LEFT:
+			move_frog_down_left();
+			break;
+		case JOYSTICK_DOWN_RIGHT:
+			move_frog_down_right();
+			break;
+		case JOYSTICK_CENTRE:
+			break;
+	}
+}
+
+// Handle one input event - a button push, serial input or a joystick
+// move - and move the frog.
+static void handle_input_event(InputEvent* event) {
+	int8_t button = -1;
+	uint8_t serial_input = 0;
+
+	if(event->source == INPUT_JOYSTICK) {
+		move_frog_in_direction(event->code);
+		return;
+	} else if(event->source == INPUT_BUTTON) {
+		// Auto repeats of a held button (see buttons.c) move the frog
+		// again. Releases are ignored.
+		if((event->code & BUTTON_EVENT_TYPE_MASK) == BUTTON_EVENT_RELEASE) {
+			return;
 		}
+		button = event->code & BUTTON_EVENT_BUTTON_MASK;
+	} else {
+		// A key - the cursor keys have already been decoded from their
+		// escape sequences (see serialio.c)
+		serial_input = event->code;
+	}
+	
+	// Process the input. 
+	if(button==3 || serial_input==KEY_LEFT || serial_input=='L' || serial_input=='l') {
+		// Attempt to move left
+		move_frog_to_left();
 		
-		if(x_or_y == 0) {
-			ADMUX = (1<<REFS0) | (1<<MUX2) | (1<<MUX0);
-			y = ADC;
-		} else {
-			ADMUX = (1<<REFS0) | (1<<MUX2) | (1<<MUX1);
-			x = ADC;
-		}
-		ADCSRA |= (1<<ADSC);
+	} else if(button==2 || serial_input==KEY_UP || serial_input=='U' || serial_input=='u') {
+		// Attempt to move forward
+		move_frog_forward();
 		
-		// On the first cycle of the loop the joy stick is in a unusual configuration.
-		if (is_first_pass) {
-			x = 500;
-			y = 500;
-			play_sound(500, 200);
-		}
+	} else if(button==1 || serial_input==KEY_DOWN || serial_input=='D' || serial_input=='d') {
+		// Attempt to move down
+		move_frog_backward();
 		
-		uint32_t mag = sqrt(pow(x - 500, 2) + pow(y - 500, 2));
-		int angle = atan2(y - 500, x - 500) * (180/M_PI);
+	} else if(button==0 || serial_input==KEY_RIGHT || serial_input=='R' || serial_input=='r') {
+		// Attempt to move right
+		move_frog_to_right();
 		
-		if (mag > 400) {
-			if (last_direction != 1 && angle > 60 && angle < 120) {
-				move_frog_forward();
-				last_direction = 1;
-			} else if (last_direction != 2 && angle < -60 && angle > -120) {
-				move_frog_backward();
-				last_direction = 2;
-			} else if (last_direction != 3 && angle > -30 && angle < 30) {
-				move_frog_to_left();
-				last_direction = 3;
-			} else if (last_direction != 4 && (angle < -150 || angle > 150)) {
-				move_frog_to_right();
-				last_direction = 4;
-			} else if (last_direction != 5 && angle > 30 && angle < 60) {
-				move_frog_up_left();
-				last_direction = 5;
-			} else if (last_direction != 6 && angle > 120 && angle < 150) {
-				move_frog_up_right();
-				last_direction = 6;
-			} else if (last_direction != 7 && angle < -30 && angle > -60) {
-				move_frog_down_left();
-				last_direction = 7;
-			} else if (last_direction != 8 && angle < -120 && angle > -150) {
-				move_frog_down_right();
-				last_direction = 8;
+	} else if(serial_input == 'p' || serial_input == 'P') {
+		paused = !paused;
+	} 
+	// else - invalid input - do nothing
+}
+
+// Handle every input event waiting in the input queue, in the order they
+// happened.
+// While a recorded game is being replayed the recorded events are handled
+// instead, on the tick they were recorded on.
+static void input_task(void) {
+	InputEvent event;
+	uint32_t tick = ++game_tick;
+
+	input_polled();
+	while(!is_frog_dead() && !is_riverbank_full()) {
+		if(frog_has_reached_riverbank()) {
+			// Frog reached the other side successfully but the
+			// riverbank isn't full, put a new frog at the start
+			put_frog_in_start_position();
+		}
+		if(replay_active()) {
+			// Live input is ignored (apart from console commands)
+			while(next_input_event(&event)) {
 			}
-			if (!joy_held && last_direction != 0) {
-				joy_held = 1;
+			if(!replay_next_event(&event, tick)) {
+				break;
 			}
 		} else {
-			last_direction = 0;
-			joy_held = 0;
-		}
-		
-		if (!joy_held) {
-			last_joy_held = current_time + 500;
-		}
-		
-		if (current_time >= last_joy_held && joy_held) {
-			last_joy_held = current_time + 100;
-			switch (last_direction) {
-				case 1:
-					move_frog_forward();
-					break;
-				case 2:
-					move_frog_backward();
-					break;
-				case 3:
-					move_frog_to_left();
-					break;
-				case 4:
-					move_frog_to_right();
-					break;
-				case 5:
-					move_frog_up_left();
-					break;
-				case 6:
-					move_frog_up_right();
-					break;
-				case 7:
-					move_frog_down_left();
-					break;
-				case 8:
-					move_frog_down_right();
-					break;
+			if(!next_input_event(&event)) {
+				break;
 			}
+			record_event(&event, tick);
 		}
-		
-		x_or_y = !x_or_y;
-		
-		if (is_first_pass)
-			is_first_pass = 0;
-		
-		// Add a delay to the hold before triggering auto delay.
-		if (!button_down) {
-			last_button_down = current_time + 500;
+		uint8_t row = get_frog_row(), column = get_frog_column();
+		// Measure the time from the input to the display changing
+		latency_begin(event.source, event.timestamp_us);
+		handle_input_event(&event);
+		latency_end();
+		// A move for the telemetry stream is anything that moved (or
+		// killed) the frog
+		if(row != get_frog_row() || column != get_frog_column() || is_frog_dead()) {
+			telemetry_event(TELEMETRY_EVENT_MOVE);
 		}
+	}
+}
 
-		// Auto repeat when a button is held down.
-		if (current_time >= last_button_down && button_down) {
-			last_button_down = current_time + 100;
-			// Account for unusual intervals which causes the button to be a unexpected value.
-			if (pressed_button <= 3) {
-				switch (pressed_button)
-				{
-					case 3:
-						move_frog_to_left();
-						break;
-					case 2:
-						move_frog_forward();
-						break;
-					case 1:
-						move_frog_backward();
-						break;
-					case 0:
-						move_frog_to_right();
-						break;
-				}
-			}
+// Play the next start of game tone.
+static void intro_tone(SoftTimer* timer) {
+	play_sound(intro_tones[tone_at][0], intro_tones[tone_at][1]);
+	if (intro_tones[tone_at][2]) {
+		soft_timer_rearm(timer, intro_tones[tone_at][2]);
+	}
+	tone_at++;
+}
+
+// Count down the time remaining. Game over if the timer reaches 0.
+static void countdown_task(void) {
+	if (game_tick % GAME_STEP_TICKS || is_frog_dead() || paused) {
+		return;
+	}
+	// Count down the timer in seconds
+	if (countdown_counter > 10) {
+		time_remaining_s--;
+		countdown_counter = 0;
+	}
+	// Count down the timer in ms
+	if (countdown_counter > 1 && count_ms) {
+		time_remaining_ms--;
+	}
+	countdown_counter++;
+
+	if (time_remaining_ms == 0) {
+		count_ms = 0;
+		frog_dead = 1;
+		redraw_frog();
+	}
+}
+
+// Move the vehicles and logs.
+static void lane_task(void) {
+	if (game_tick % GAME_STEP_TICKS || is_frog_dead() || paused) {
+		return;
+	}
+	// Reduce the cycle times as the level increases
+	double scale = current_level < 6 ? current_level : current_level * (1.1);
+	// Cycle times are set in 100ms steps by the lane and log parameters
+	// (by default 1000ms, 1300ms, 800ms, 900ms and 1100ms)
+	if (lane_counters[0] > (param(PARAM_LANE0_PERIOD) - scale)) {
+		scroll_vehicle_lane(0, 1);
+		lane_counters[0] = 0;
+	}
+	if (lane_counters[1] > (param(PARAM_LANE1_PERIOD) - scale)) {
+		scroll_vehicle_lane(1, -1);
+		lane_counters[1] = 0;
+	}
+	if (lane_counters[2] > (param(PARAM_LANE2_PERIOD) - scale)) {
+		scroll_vehicle_lane(2, 1);
+		lane_counters[2] = 0;
+	}
+	if (lane_counters[3] > (param(PARAM_LOG0_PERIOD) - scale)) {
+		scroll_river_channel(0, -1);
+		lane_counters[3] = 0;
+	}
+	if (lane_counters[4] > (param(PARAM_LOG1_PERIOD) - scale)) {
+		scroll_river_channel(1, 1);
+		lane_counters[4] = 0;
+	}
+	// Increment each counter every cycle.
+	for (int i = 0; i < (sizeof(lane_counters) / sizeof(int)); i++) {
+		lane_counters[i]++;
+	}
+}
+
+// Step the game through its modes. Runs every tick from the game task.
+static uint8_t game_thread(Pt* pt) {
+	static uint8_t outcome;
+	PT_BEGIN(pt);
+	set_mode(MODE_SPLASH);
+	PT_INIT(&screen_pt);
+	PT_WAIT_THREAD(pt, splash_screen(&screen_pt));
+	while(1) {
+		new_game();
+		play_game();
+		// We play the game while the frog is alive and we haven't filled up the 
+		// far riverbank. The other tasks do the playing.
+		PT_WAIT_UNTIL(pt, is_frog_dead() || is_riverbank_full() || replay_pending());
+		// We get here if the frog is dead or the riverbank is full
+		// The game is over. (Or a replay was asked for, in which case we
+		// abandon this game and start the replay.)
+		stop_game();
+		outcome = is_frog_dead() ? RECORD_FROG_DEAD :
+				is_riverbank_full() ? RECORD_RIVERBANK_FULL : 0;
+		if(is_frog_dead()) {
+			telemetry_event(TELEMETRY_EVENT_DEATH);
 		}
-		
-		// Process the input. 
-		if(button==3 || escape_sequence_char=='D' || serial_input=='L' || serial_input=='l') {
-			// Attempt to move left
-			// Remember the button pressed.
-			pressed_button = button;
-			move_frog_to_left();
-			
-		} else if(button==2 || escape_sequence_char=='A' || serial_input=='U' || serial_input=='u') {
-			// Attempt to move forward
-			// Remember the button pressed
-			pressed_button = button;
-			move_frog_forward();
-			
-		} else if(button==1 || escape_sequence_char=='B' || serial_input=='D' || serial_input=='d') {
-			// Attempt to move down
-			// Remember the button pressed.
-			pressed_button = button;
-			move_frog_backward();
-			
-		} else if(button==0 || escape_sequence_char=='C' || serial_input=='R' || serial_input=='r') {
-			// Attempt to move right
-			// Remember the button pressed.
-			pressed_button = button;
-			move_frog_to_right();
-			
-		} else if(serial_input == 'p' || serial_input == 'P') {
-			paused = !paused;
-		} 
-		// else - invalid input or we're part way through an escape sequence -
-		// do nothing
-		
-		// Reset the pressed button if no button is being held.
-		if (!button_down) {
-			pressed_button = NO_BUTTON_PUSHED;
+		if(replay_active()) {
+			set_mode(MODE_GAME_OVER);
+			serial_set_priority(SERIAL_DEBUG);
+			move_cursor(1, CONSOLE_ROW + 1);
+			(void)replay_finish(game_tick, outcome);
+			serial_set_priority(SERIAL_CRITICAL);
+			print_at_P(10, 15, PSTR("Press a button to start again"));
+			PT_WAIT_UNTIL(pt, screen_button_pushed());
+			on_same_game = 0;
+			continue;
 		}
-		
-		current_time = get_current_time();
-		
-		if (tone_at < 2) {
-			if (current_time >= sound_play_time + 200) {
-				play_sound(800, 300);
-				tone_at = 1;
-			}
-			
-			if (current_time >= sound_play_time + 500) {
-				play_sound(1500, 500);
-				tone_at = 2;
-			}
+		if(replay_pending()) {
+			// (This game can't have been being recorded - a replay
+			// can't be asked for while a recording is being made.)
+			continue;
 		}
-		
-		// Reduce the cycle times times	
-		if(!is_frog_dead() && current_time >= last_move_time + 100) {
-			// Since the counters tick up every 100ms we can effectively set custom cycle times
-			// by adjusting the max value the counter should tick up to.
-			// 1000ms (10 * 100) cycle
-			double scale = current_level < 6 ? current_level : current_level * (1.1);
-			if (!paused) {
-				if (counters[0] > (10 - scale)) {
-					scroll_vehicle_lane(0, 1);
-					counters[0] = 0;
-				}
-				// 1300ms (13 * 100) cycle
-				if (counters[1] > (13 - scale)) {
-					scroll_vehicle_lane(1, -1);
-					counters[1] = 0;
-				}
-				// 800ms (8 * 100) cycle
-				if (counters[2] > (8 - scale)) {
-					scroll_vehicle_lane(2, 1);
-					counters[2] = 0;
-				}
-				// 900ms (9 * 100) cycle
-				if (counters[3] > (9 - scale)) {
-					scroll_river_channel(0, -1);
-					counters[3] = 0;
-				}
-				// 1000ms (10 * 100) cycle
-				if (counters[4] > (11 - scale)) {
-					scroll_river_channel(1, 1);
-					counters[4] = 0;
-				}
-				// Count down the timer in seconds
-				if (counters[5] > 10) {
-					time_remaining_s--;
-					counters[5] = 0;
-				}
-				// Count down the timer in ms
-				if (counters[5] > 1 && count_ms) {
-					time_remaining_ms--;
-					counters[6] = 0;
-				}
-				// Increment each counter every cycle.
-				for (int i = 0; i < (sizeof(counters) / sizeof(int)); i++) {
-					counters[i]++;
-				}
-				last_move_time = current_time;
-			}
+		record_end(game_tick, outcome);
+		PT_INIT(&screen_pt);
+		PT_WAIT_THREAD(pt, handle_game_over(&screen_pt));
+	}
+	PT_END(pt);
+}
+
+static void game_task(void) {
+	if(mode != MODE_PLAYING) {
+		// The input task is stopped - input is checked by the screen
+		// protothreads.
+		input_polled();
+	}
+	(void)game_thread(&game_pt);
+}
+
+// Send changes to the status lines to the terminal. At 19200 baud 40
+// bytes every 20ms is about 40% of the serial port. We only send what
+// fits in the serial output buffer (STATUS_FLUSH_MIN is enough for any
+// single change) so the status lines never wait for the serial port,
+// and a change that can't be sent yet is replaced by any newer one.
+#define STATUS_FLUSH_BYTES 40
+#define STATUS_FLUSH_MIN 16
+static void status_task(void) {
+	uint8_t space = serial_output_space(SERIAL_STATUS);
+	if(space < STATUS_FLUSH_MIN) {
+		return;
+	}
+	uint8_t priority = serial_set_priority(SERIAL_STATUS);
+	(void)status_flush(space < STATUS_FLUSH_BYTES ? space : STATUS_FLUSH_BYTES);
+	serial_set_priority(priority);
+}
+
+// Send changes to the LED matrix mirror to the terminal, in the same way
+// as the status lines. A LED takes 3 to 25 bytes (a lane scroll usually
+// changes 4 to 8 LEDs), so 48 bytes every 40ms - about 60% of the serial
+// port at 19200 baud at most - keeps up with the lanes. Anything that
+// doesn't fit is sent next time. (MIRROR_FLUSH_MIN is enough for any
+// single LED.)
+#define MIRROR_FLUSH_BYTES 48
+#define MIRROR_FLUSH_MIN 32
+static void mirror_task(void) {
+	uint8_t space = serial_output_space(SERIAL_STATUS);
+	if(!mirror_enabled() || space < MIRROR_FLUSH_MIN) {
+		return;
+	}
+	uint8_t priority = serial_set_priority(SERIAL_STATUS);
+	(void)mirror_flush(space < MIRROR_FLUSH_BYTES ? space : MIRROR_FLUSH_BYTES);
+	serial_set_priority(priority);
+}
+
+// Answer the binary frames sent to us (see frame.h). (Input frames are
+// handled as they arrive.)
+static void link_task(void) {
+	uint8_t channel, length;
+	uint8_t payload[FRAME_MAX_PAYLOAD];
+	if(!frame_get(&channel, payload, &length)) {
+		return;
+	}
+	if(channel == FRAME_STATE) {
+		FrameState state;
+		state.mode = mode;
+		state.level = current_level;
+		state.lives = current_life;
+		state.paused = paused;
+		state.frog_row = get_frog_row();
+		state.frog_column = get_frog_column();
+		state.frog_dead = is_frog_dead();
+		state.score = get_score();
+		(void)frame_send(FRAME_STATE, &state, sizeof(state));
+	} else if(channel == FRAME_STATS) {
+		FrameStats stats;
+		stats.cpu_busy = scheduler_utilisation();
+		stats.input_dropped = input_overflows();
+		stats.serial_sent = serial_bytes_sent();
+		stats.serial_dropped = serial_dropped_bytes(SERIAL_CRITICAL) +
+				serial_dropped_bytes(SERIAL_STATUS) +
+				serial_dropped_bytes(SERIAL_DEBUG);
+		stats.frames_received = frames_received();
+		stats.frame_errors = frame_errors();
+		stats.frames_dropped = frames_dropped();
+		(void)frame_send(FRAME_STATS, &stats, sizeof(stats));
+	} else if(channel == FRAME_BULK) {
+		level_receive(payload, length);
+	}
+}
+
+// Sample the game state for the telemetry stream (see telemetry.h)
+static void telemetry_task(void) {
+	TelemetryState state;
+	if(!telemetry_enabled()) {
+		return;
+	}
+	state.frog_row = get_frog_row();
+	state.frog_column = get_frog_column();
+	for(uint8_t i = 0; i < sizeof(state.lanes); i++) {
+		state.lanes[i] = get_lane_position(i);
+	}
+	for(uint8_t i = 0; i < sizeof(state.logs); i++) {
+		state.logs[i] = get_log_position(i);
+	}
+	state.riverbank = get_riverbank_status();
+	state.countdown = time_remaining_s > UINT8_MAX ? UINT8_MAX : time_remaining_s;
+	state.score = get_score();
+	state.level = current_level;
+	state.lives = current_life;
+	state.mode = mode;
+	state.paused = paused;
+	telemetry_sample(&state);
+}
+
+// Tasks that only run while a game is being played
+static int8_t play_tasks[4];
+
+// Number of tasks the scheduler had no room for
+static uint8_t tasks_not_added;
+
+static int8_t add_task(const char* name, TaskFunction function,
+		uint16_t period_ms, uint16_t deadline_ms, uint32_t budget_cycles) {
+	int8_t task = scheduler_add_task(name, function, period_ms, deadline_ms,
+			budget_cycles);
+	if(task < 0) {
+		tasks_not_added++;
+	}
+	return task;
+}
+
+// Register the game tasks with the scheduler. Periods and deadlines
+// are in ms, budgets in clock cycles. (Moves and lane updates are
+// dominated by SPI transfers to the LED matrix, which take about 1000
+// cycles per byte.)
+void init_tasks(void) {
+	add_task(PSTR("timers"), run_soft_timers, 1, 1, 2000);
+	add_task(PSTR("game"), game_task, 1, 2, 24000);
+	play_tasks[0] = add_task(PSTR("render"), render_task, 1, 1, 1000);
+	play_tasks[1] = add_task(PSTR("input"), input_task, 1, 2, 24000);
+	// (The countdown and lanes run on every pass, after the input task,
+	// and step on the game tick.)
+	play_tasks[2] = add_task(PSTR("countdown"), countdown_task, 1, 100, 2000);
+	play_tasks[3] = add_task(PSTR("lanes"), lane_task, 1, 20, 100000);
+	add_task(PSTR("record"), record_task, 1, 1, 2000);
+	add_task(PSTR("status"), status_task, 20, 20, 20000);
+	add_task(PSTR("console"), console_task, 10, 10, 20000);
+	add_task(PSTR("serial"), serial_task, 1, 1, 1000);
+	add_task(PSTR("link"), link_task, 5, 5, 20000);
+	add_task(PSTR("mirror"), mirror_task, 40, 40, 40000);
+	add_task(PSTR("params"), params_task, 10, 10, 2000);
+	add_task(PSTR("level"), level_task, 10, 10, 2000);
+	add_task(PSTR("telemetry"), telemetry_task, TELEMETRY_PERIOD_MS,
+			TELEMETRY_PERIOD_MS, 20000);
+	// A task that didn't fit would never run - don't start without it
+	if(tasks_not_added) {
+		sei();
+		printf_P(PSTR("\n%u tasks don't fit in the scheduler - raise "
+				"SCHEDULER_MAX_TASKS\n"), tasks_not_added);
+		while(1) {
+			;
 		}
 	}
+	stop_game();
+	PT_INIT(&game_pt);
+}
+
+void play_game(void) {
+	// Start playing the start of game tones
+	tone_at = 0;
+	soft_timer_arm(&tone_timer, 1, 0, intro_tone);
+	count_ms = 0;
+	
+	joystick_reset_move();
 	
+	// Reset the lane and countdown counters
+	for (int i = 0; i < (sizeof(lane_counters) / sizeof(int)); i++) {
+		lane_counters[i] = 0;
+	}
+	countdown_counter = 0;
 
-	// We get here if the frog is dead or the riverbank is full
-	// The game is over.
+	// Start the game tasks. They start in phase with each other, and the
+	// game ticks are counted from here.
+	for (uint8_t i = 0; i < sizeof(play_tasks); i++) {
+		scheduler_set_enabled(play_tasks[i], 1);
+	}
+	(void)scheduler_restart();
+	game_tick = 0;
+	set_mode(MODE_PLAYING);
+	telemetry_event(TELEMETRY_EVENT_NEW_GAME);
+	
+	RecordStart start = {
+		current_level, current_life, on_same_game, paused, get_score()
+	};
+	record_begin(&start);
 }
 
-void handle_game_over() {
+void stop_game(void) {
+	for (uint8_t i = 0; i < sizeof(play_tasks); i++) {
+		scheduler_set_enabled(play_tasks[i], 0);
+	}
+	joystick_reset_move();
+}
+
+static uint8_t handle_game_over(Pt* pt) {
+	static uint8_t i;
+	PT_BEGIN(pt);
 	// Reduce lives until it reaches 0 before proceeding with the normal procedure of
 	// game over handle.
 	on_same_game = 1;
-	play_sound(1000, 1000);
+	play_sound(1000, param(PARAM_GAME_OVER_SOUND));
 	if (is_riverbank_full()) {
+		set_mode(MODE_LEVEL_DONE);
 		display_digit(seven_seg[(current_level % 10) + 1], 1, 0);
 		move_cursor(10,14);
-		printf("\n Current Level: %i \n", current_level);
+		fmt_put_string_P(PSTR("\n Current Level: "));
+		fmt_put_signed(current_level, 0);
+		fmt_put_string_P(PSTR(" \n"));
 		set_scrolling_display_text("", 0);
-		int i = 0;
-		while(scroll_display() && i < 15) {
-			_delay_ms(100);
-			i++;
+		for(i = 0; scroll_display() && i < 15; i++) {
+			soft_timer_arm(&screen_timer, 100, 0, 0);
+			PT_WAIT_UNTIL(pt, screen_timer.expired);
 		}
-		_delay_ms(100);
+		soft_timer_arm(&screen_timer, 100, 0, 0);
+		PT_WAIT_UNTIL(pt, screen_timer.expired);
 		current_level++;
+		telemetry_event(TELEMETRY_EVENT_LEVEL_UP);
 		if (current_life < 5)
 			set_life(++current_life);
 	} else {
+		set_mode(MODE_GAME_OVER);
 		display_digit(seven_seg[0], 1, 0);
 		set_life(--current_life);
 		if (current_life <= 0) {
 			on_same_game = 0;
 			move_cursor(10,5);
-			if (get_score() > 0)
-				compare_and_update(get_score());
+			high_score_slot = get_score() > 0 ? find_high_score_slot(get_score()) : -1;
+			if (high_score_slot >= 0) {
+				set_mode(MODE_NAME_ENTRY);
+				PT_INIT(&name_pt);
+				PT_WAIT_THREAD(pt, request_name(&name_pt));
+				// Write the entry a byte at a time as the EEPROM becomes
+				// ready, rather than waiting for each byte.
+				begin_write_eeprom(name, get_score(), high_score_slot);
+				PT_WAIT_UNTIL(pt, continue_write_eeprom());
+				set_mode(MODE_GAME_OVER);
+			}
 			read_eeprom();
-			move_cursor(10,14);
-			printf_P(PSTR("GAME OVER"));
-			move_cursor(10,15);
-			printf_P(PSTR("Press a button to start again"));
+			print_at_P(10, 14, PSTR("GAME OVER"));
+			print_at_P(10, 15, PSTR("Press a button to start again"));
 		}
 		joystick_enable = 0;
 		print_stats();
-		while(button_pushed() == NO_BUTTON_PUSHED) {
-			; // wait
-		}
+		PT_WAIT_UNTIL(pt, screen_button_pushed());
 	}
-}
\ No newline at end of file
+	PT_END(pt);
+}
@@ -6,7 +6,13 @@
  */ 
 
 #define STARTING_LIVES 3;
-uint8_t* request_name(void);
+// Show the score (or the score, level and lives) in the status lines
+void print_score(void);
+void print_stats(void);
+// Print the longest time input went unchecked in each game mode, and clear it.
+// Prints one line at a time (starting from line 0) and returns 1 if there
+// are more lines to print.
+uint8_t print_input_latency(uint8_t line);
 // Global variables
 // Initial lives of the player
 uint8_t current_life;
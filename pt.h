@@ -0,0 +1,76 @@
+/*
+ * pt.h
+ *
+ * Author: Xinyi Li
+ *
+ * Protothreads - very small stackless coroutines (after Adam Dunkels'
+ * protothreads library). A protothread is a function that is called
+ * repeatedly (e.g. once every tick). It can wait for a condition to
+ * become true, in which case it returns and carries on from the same
+ * place the next time it is called. This lets a long sequence of steps
+ * be written as straight line code without blocking the rest of the
+ * system.
+ *
+ * The place to continue from is stored as a line number in the Pt
+ * structure and the function body is one big switch statement, so:
+ * - local variables are NOT kept between calls - use static variables
+ *   for anything that must survive a wait, and
+ * - a protothread can't contain a switch statement of its own that
+ *   waits inside one of its cases.
+ *
+ * A protothread function returns PT_WAITING while it is waiting and
+ * PT_ENDED once it has finished (after which it starts again from the
+ * beginning the next time it is called).
+ */
+
+#ifndef PT_H_
+#define PT_H_
+
+#include <stdint.h>
+
+typedef struct {
+	uint16_t line;
+} Pt;
+
+#define PT_WAITING 0
+#define PT_ENDED 1
+
+// Start the protothread from the beginning the next time it is called.
+#define PT_INIT(pt) ((pt)->line = 0)
+
+#define PT_BEGIN(pt) switch((pt)->line) { case 0:
+
+#define PT_END(pt) } (pt)->line = 0; return PT_ENDED
+
+// Wait until the condition is true. The condition is checked straight
+// away, so this doesn't wait at all if it is already true.
+#define PT_WAIT_UNTIL(pt, condition) \
+	do { \
+		(pt)->line = __LINE__; case __LINE__: \
+		if(!(condition)) { \
+			return PT_WAITING; \
+		} \
+	} while(0)
+
+#define PT_WAIT_WHILE(pt, condition) PT_WAIT_UNTIL(pt, !(condition))
+
+// Run a child protothread (which must have been initialised with
+// PT_INIT) until it ends.
+#define PT_WAIT_THREAD(pt, thread) PT_WAIT_WHILE(pt, (thread) == PT_WAITING)
+
+// Return now and carry on from here the next time we're called.
+#define PT_YIELD(pt) \
+	do { \
+		(pt)->line = __LINE__; \
+		return PT_WAITING; \
+		case __LINE__: ; \
+	} while(0)
+
+// Finish the protothread early.
+#define PT_EXIT(pt) \
+	do { \
+		(pt)->line = 0; \
+		return PT_ENDED; \
+	} while(0)
+
+#endif /* PT_H_ */
@@ -0,0 +1,308 @@
+/*
+ * record.c
+ *
+ * Author: Xinyi Li
+ */
+
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+#include <stdio.h>
+
+#include "record.h"
+#include "ledmatrix.h"
+#include "score.h"
+#include "terminalio.h"
+#include "timer0.h"
+
+#define RECORD_MAGIC 0xA5
+#define RECORD_VERSION 3		// 3: events are stamped with game ticks
+
+// The recording starts with this header. The magic number is only
+// written once the rest of the recording is complete.
+typedef struct {
+	uint8_t magic;
+	uint8_t version;
+	RecordStart start;
+	uint16_t length;		// bytes of events that follow the header
+	uint32_t end_tick;
+	uint32_t end_score;
+	uint16_t checksum;		// LED matrix checksum when the game ended
+	uint8_t outcome;
+	uint8_t truncated;		// 1 if there wasn't room for every event
+} RecordHeader;
+
+#define EVENTS_START (RECORD_START + sizeof(RecordHeader))
+#define EVENTS_SIZE (RECORD_END - EVENTS_START)
+
+// Each event is the number of ticks since the previous event - one byte
+// if less than 128, otherwise two bytes (most significant first) with the
+// top bit set - followed by a code:
+//   0x00 to 0x7F	serial character
+//   0x80 to 0xBF	0x80 + button event code
+//   0xC0 to 0xCF	0xC0 + joystick direction
+//   0xE0 to 0xE3	0xE0 + cursor key (KEY_UP to KEY_LEFT) - 0x80
+//   0xFF			nothing (fills gaps of more than MAX_DELTA ticks)
+#define CODE_BUTTON 0x80
+#define CODE_JOYSTICK 0xC0
+#define CODE_KEY 0xE0
+#define CODE_NOTHING 0xFF
+#define MAX_DELTA 0x7FFF
+
+static uint8_t enabled;
+
+// Recording. Event bytes are put in fifo (the indices run freely) and
+// written by record_task(). Once the game has finished and every event
+// byte has been written the header is written, last byte first, so the
+// magic number is written last. invalidate is set when a new recording
+// starts - the magic number of the old one is cleared before anything
+// else is written.
+#define FIFO_SIZE 32
+static uint8_t fifo[FIFO_SIZE];
+static uint8_t fifo_head;
+static uint8_t fifo_tail;
+static uint8_t recording;
+static uint8_t invalidate;
+static uint16_t events_queued;
+static uint16_t events_written;
+static uint32_t last_tick;
+static RecordHeader header;
+static uint8_t header_to_write;
+
+// Replay. The next event (if have_next is set) is read ahead.
+static uint8_t pending;
+static uint8_t replaying;
+static RecordHeader replay_header;
+static uint16_t replay_offset;
+static uint8_t have_next;
+static uint32_t next_tick;
+static uint8_t next_code;
+
+void record_enable(uint8_t enable) {
+	enabled = enable;
+	if(!enable) {
+		recording = 0;
+	}
+}
+
+uint8_t record_enabled(void) {
+	return enabled;
+}
+
+void record_begin(const RecordStart* start) {
+	if(!enabled || replaying) {
+		return;
+	}
+	header.start = *start;
+	header.truncated = 0;
+	fifo_head = fifo_tail = 0;
+	events_queued = events_written = 0;
+	last_tick = 0;
+	header_to_write = 0;
+	invalidate = 1;
+	recording = 1;
+}
+
+// Add an event to the fifo. If there isn't room (in the fifo or the
+// EEPROM) the recording is marked as truncated and 0 is returned.
+static uint8_t queue_event(uint16_t delta, uint8_t code) {
+	if((uint8_t)(fifo_head - fifo_tail) > FIFO_SIZE - 3 ||
+			events_queued > EVENTS_SIZE - 3) {
+		header.truncated = 1;
+		return 0;
+	}
+	if(delta >= 0x80) {
+		fifo[fifo_head++ % FIFO_SIZE] = 0x80 | (delta >> 8);
+		fifo[fifo_head++ % FIFO_SIZE] = delta & 0xFF;
+		events_queued += 2;
+	} else {
+		fifo[fifo_head++ % FIFO_SIZE] = delta;
+		events_queued++;
+	}
+	fifo[fifo_head++ % FIFO_SIZE] = code;
+	events_queued++;
+	last_tick += delta;
+	return 1;
+}
+
+void record_event(const InputEvent* event, uint32_t tick) {
+	uint8_t code;
+	if(!recording || header.truncated) {
+		return;
+	}
+	if(event->source == INPUT_BUTTON) {
+		code = CODE_BUTTON | event->code;
+	} else if(event->source == INPUT_JOYSTICK) {
+		code = CODE_JOYSTICK | event->code;
+	} else if(event->code < 0x80) {
+		code = event->code;
+	} else if(event->code <= KEY_LEFT) {
+		code = CODE_KEY | (event->code - KEY_UP);
+	} else {
+		// The game ignores characters above 127 just like DEL
+		code = 0x7F;
+	}
+	while(tick - last_tick > MAX_DELTA) {
+		if(!queue_event(MAX_DELTA, CODE_NOTHING)) {
+			return;
+		}
+	}
+	(void)queue_event(tick - last_tick, code);
+}
+
+void record_end(uint32_t tick, uint8_t outcome) {
+	if(!recording) {
+		return;
+	}
+	recording = 0;
+	header.magic = RECORD_MAGIC;
+	header.version = RECORD_VERSION;
+	header.length = events_queued;
+	header.end_tick = tick;
+	header.end_score = get_score();
+	header.checksum = ledmatrix_checksum();
+	header.outcome = outcome;
+	header_to_write = sizeof(header);
+}
+
+void record_task(void) {
+	while(eeprom_is_ready()) {
+		if(invalidate) {
+			eeprom_update_byte((uint8_t*)RECORD_START, 0);
+			invalidate = 0;
+		} else if(fifo_tail != fifo_head) {
+			eeprom_update_byte((uint8_t*)(EVENTS_START + events_written),
+					fifo[fifo_tail++ % FIFO_SIZE]);
+			events_written++;
+		} else if(header_to_write) {
+			header_to_write--;
+			eeprom_update_byte((uint8_t*)RECORD_START + header_to_write,
+					((uint8_t*)&header)[header_to_write]);
+		} else {
+			return;
+		}
+	}
+}
+
+// Bytes of the raw recording on each line of record_dump()
+#define DUMP_BYTES_PER_LINE 24
+
+uint8_t record_dump(uint8_t line) {
+	RecordHeader saved;
+	eeprom_read_block(&saved, (void*)RECORD_START, sizeof(saved));
+	uint16_t total = sizeof(saved) + saved.length;
+	if(saved.magic != RECORD_MAGIC || saved.version != RECORD_VERSION) {
+		printf_P(PSTR("no recording"));
+		clear_to_end_of_line();
+		return 0;
+	}
+	if(line == 0) {
+		printf_P(PSTR("level %u lives %u score %lu, %u event bytes%S"),
+				saved.start.level, saved.start.lives, saved.start.score,
+				saved.length, saved.truncated ? PSTR(" (truncated)") : PSTR(""));
+	} else if(line == 1) {
+		printf_P(PSTR("ended on tick %lu score %lu checksum %04x"),
+				saved.end_tick, saved.end_score, saved.checksum);
+	} else {
+		// The raw recording, header first
+		uint16_t start = (line - 2) * DUMP_BYTES_PER_LINE;
+		for(uint16_t i = start; i < total && i < start + DUMP_BYTES_PER_LINE; i++) {
+			printf_P(PSTR("%02x"), eeprom_read_byte((uint8_t*)RECORD_START + i));
+		}
+	}
+	clear_to_end_of_line();
+	return (line - 1) * DUMP_BYTES_PER_LINE < total;
+}
+
+uint8_t replay_request(void) {
+	// The last recording must have been completely written
+	if(recording || invalidate || header_to_write || fifo_tail != fifo_head) {
+		return 0;
+	}
+	eeprom_read_block(&replay_header, (void*)RECORD_START, sizeof(replay_header));
+	if(replay_header.magic != RECORD_MAGIC || replay_header.version != RECORD_VERSION) {
+		return 0;
+	}
+	pending = 1;
+	return 1;
+}
+
+uint8_t replay_pending(void) {
+	return pending;
+}
+
+// Read the next event of the recording into next_tick and next_code,
+// skipping events that do nothing.
+static void read_next_event(void) {
+	have_next = 0;
+	while(replay_offset < replay_header.length) {
+		uint8_t* address = (uint8_t*)EVENTS_START + replay_offset;
+		uint16_t delta = eeprom_read_byte(address++);
+		if(delta & 0x80) {
+			delta = ((delta & 0x7F) << 8) | eeprom_read_byte(address++);
+		}
+		uint8_t code = eeprom_read_byte(address++);
+		replay_offset = address - (uint8_t*)EVENTS_START;
+		next_tick += delta;
+		if(code != CODE_NOTHING) {
+			next_code = code;
+			have_next = 1;
+			return;
+		}
+	}
+}
+
+uint8_t replay_begin(RecordStart* start) {
+	if(!pending) {
+		return 0;
+	}
+	pending = 0;
+	replaying = 1;
+	replay_offset = 0;
+	next_tick = 0;
+	read_next_event();
+	*start = replay_header.start;
+	return 1;
+}
+
+uint8_t replay_active(void) {
+	return replaying;
+}
+
+uint8_t replay_next_event(InputEvent* event, uint32_t tick) {
+	if(!replaying || !have_next || next_tick > tick) {
+		return 0;
+	}
+	if(next_code < CODE_BUTTON) {
+		event->source = INPUT_SERIAL;
+		event->code = next_code;
+	} else if(next_code < CODE_JOYSTICK) {
+		event->source = INPUT_BUTTON;
+		event->code = next_code & ~CODE_BUTTON;
+	} else if(next_code < CODE_KEY) {
+		event->source = INPUT_JOYSTICK;
+		event->code = next_code & ~CODE_JOYSTICK;
+	} else {
+		event->source = INPUT_SERIAL;
+		event->code = KEY_UP + (next_code & ~CODE_KEY);
+	}
+	event->timestamp_us = get_current_time_us();
+	read_next_event();
+	return 1;
+}
+
+uint8_t replay_finish(uint32_t tick, uint8_t outcome) {
+	uint16_t checksum = ledmatrix_checksum();
+	uint32_t score = get_score();
+	uint8_t matched = tick == replay_header.end_tick &&
+			checksum == replay_header.checksum &&
+			score == replay_header.end_score &&
+			outcome == replay_header.outcome;
+	replaying = 0;
+	printf_P(PSTR("replay %S: ended on tick %lu (recorded %lu), checksum %04x (%04x), score %lu (%lu)%S"),
+			matched ? PSTR("matched") : PSTR("DIFFERED"),
+			tick, replay_header.end_tick, checksum, replay_header.checksum,
+			score, replay_header.end_score,
+			replay_header.truncated ? PSTR(" - recording was truncated") : PSTR(""));
+	clear_to_end_of_line();
+	return matched;
+}
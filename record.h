@@ -0,0 +1,107 @@
+/*
+ * record.h
+ *
+ * Author: Xinyi Li
+ *
+ * Recording and replay of games. While recording is turned on, every
+ * game (i.e. every life) is recorded into EEPROM: the state the game
+ * started in, then every input event the game handled with the game
+ * tick it was handled on, and finally how the game ended. Only the last
+ * game is kept. The game tick counts the passes of the game tasks since
+ * the game started (one per ms unless the scheduler skipped ticks).
+ *
+ * A replay restores the start state and feeds the recorded events back
+ * to the game on the same ticks, in place of the live input. The game
+ * is deterministic apart from its input, so a replay should end on the
+ * same tick with the same score and the same LED matrix checksum (see
+ * ledmatrix_checksum()). Everything the game does is stepped on the game
+ * tick rather than the time, so this holds even if the recording or the
+ * replay skipped ticks.
+ *
+ * The recording is written to EEPROM in the background by record_task(),
+ * which never waits for the EEPROM.
+ */
+
+#ifndef RECORD_H_
+#define RECORD_H_
+
+#include <stdint.h>
+#include "input.h"
+
+// Where the recording is kept in EEPROM (bytes RECORD_START to
+// RECORD_END - 1)
+#define RECORD_START 128
+#define RECORD_END 448
+
+// How a game ended
+#define RECORD_FROG_DEAD 1
+#define RECORD_RIVERBANK_FULL 2
+
+// The state of the game when it started
+typedef struct {
+	uint8_t level;
+	uint8_t lives;
+	uint8_t on_same_game;
+	uint8_t paused;
+	uint32_t score;
+} RecordStart;
+
+/* Turn recording on or off. (Turning it off part way through a game
+ * abandons the recording of that game.)
+ */
+void record_enable(uint8_t enable);
+uint8_t record_enabled(void);
+
+/* Start recording a game (if recording is on and we're not replaying).
+ * This must be called as the game starts - event ticks are counted from
+ * here.
+ */
+void record_begin(const RecordStart* start);
+
+/* Record an input event handled by the game on the given tick */
+void record_event(const InputEvent* event, uint32_t tick);
+
+/* Finish recording the game, which ended on the given tick. outcome is
+ * RECORD_FROG_DEAD or RECORD_RIVERBANK_FULL.
+ */
+void record_end(uint32_t tick, uint8_t outcome);
+
+/* Write the recording to EEPROM. This should be run regularly (e.g. as a
+ * scheduler task) - it writes as much as it can without waiting.
+ */
+void record_task(void);
+
+/* Print the recording (in hex) to standard output, one line at a time
+ * starting from line 0. Returns 1 if there are more lines to print.
+ */
+uint8_t record_dump(uint8_t line);
+
+/* Ask for the recording to be replayed. Returns 0 if there is no complete
+ * recording. The game should then start a new game, calling replay_begin()
+ * to get the start state.
+ */
+uint8_t replay_request(void);
+
+/* 1 if a replay has been asked for but hasn't started yet */
+uint8_t replay_pending(void);
+
+/* If a replay was asked for, start it - fill in the start state and
+ * return 1. Returns 0 otherwise.
+ */
+uint8_t replay_begin(RecordStart* start);
+
+/* 1 while a replay is running */
+uint8_t replay_active(void);
+
+/* Get the next recorded event if it is due on or before the given tick.
+ * Returns 0 if no event is due.
+ */
+uint8_t replay_next_event(InputEvent* event, uint32_t tick);
+
+/* Finish the replay, which ended on the given tick with the given
+ * outcome. Prints a comparison with the recording and returns 1 if the
+ * replay ended the same way as the recording.
+ */
+uint8_t replay_finish(uint32_t tick, uint8_t outcome);
+
+#endif /* RECORD_H_ */
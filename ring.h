@@ -0,0 +1,120 @@
+/*
+ * ring.h
+ *
+ * Author: Xinyi Li
+ *
+ * Single producer, single consumer ring buffers. The producer (e.g. an
+ * interrupt handler) only changes head and the consumer only changes
+ * tail, so neither side has to turn interrupts off. The indices run
+ * freely and are masked when they are used, so the number of items in
+ * the ring is always head - tail and a full ring can be told from an
+ * empty one.
+ *
+ * The ring only holds the indices - the items are kept in an array of
+ * RING size elements next to it. The size must be a power of two no
+ * bigger than 128 (check it with RING_SIZE_VALID at compile time).
+ *
+ * Several interrupt handlers may share the producer side as long as none
+ * of them lets other interrupts in while it runs (i.e. no ISR_NOBLOCK
+ * handlers) - they can't interrupt each other so they act as a single
+ * producer.
+ */
+
+#ifndef RING_H_
+#define RING_H_
+
+#include <stdint.h>
+
+#define RING_SIZE_VALID(size) \
+	((size) > 0 && (size) <= 128 && ((size) & ((size) - 1)) == 0)
+
+typedef struct {
+	volatile uint8_t head;	// next item to add
+	volatile uint8_t tail;	// next item to remove
+} Ring;
+
+// Stop the compiler moving reads or writes of the items across an index
+// update.
+#define RING_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+static inline void ring_init(Ring* ring) {
+	ring->head = 0;
+	ring->tail = 0;
+}
+
+static inline uint8_t ring_count(const Ring* ring) {
+	return ring->head - ring->tail;
+}
+
+static inline uint8_t ring_is_empty(const Ring* ring) {
+	return ring->head == ring->tail;
+}
+
+static inline uint8_t ring_is_full(const Ring* ring, uint8_t size) {
+	return ring_count(ring) >= size;
+}
+
+/* Producer side: fill in the item at ring_head_index() and then call
+ * ring_push() to make it visible to the consumer. The ring must not be
+ * full.
+ */
+static inline uint8_t ring_head_index(const Ring* ring, uint8_t size) {
+	return ring->head & (size - 1);
+}
+
+static inline void ring_push(Ring* ring) {
+	RING_BARRIER();
+	ring->head = ring->head + 1;
+}
+
+// Make n items filled in from ring_head_index() onwards visible at once
+static inline void ring_push_n(Ring* ring, uint8_t n) {
+	RING_BARRIER();
+	ring->head = ring->head + n;
+}
+
+/* Consumer side: read the item at ring_tail_index() and then call
+ * ring_pop() to give its space back to the producer. The ring must not
+ * be empty.
+ */
+static inline uint8_t ring_tail_index(const Ring* ring, uint8_t size) {
+	return ring->tail & (size - 1);
+}
+
+static inline void ring_pop(Ring* ring) {
+	RING_BARRIER();
+	ring->tail = ring->tail + 1;
+}
+
+// Discard everything in the ring (consumer side)
+static inline void ring_flush(Ring* ring) {
+	ring->tail = ring->head;
+}
+
+/* Add a byte to a ring of bytes. Returns 1 if it was added, 0 if the
+ * ring was full.
+ */
+static inline uint8_t ring_put_byte(Ring* ring, uint8_t* buffer, uint8_t size,
+		uint8_t c) {
+	if(ring_is_full(ring, size)) {
+		return 0;
+	}
+	buffer[ring_head_index(ring, size)] = c;
+	ring_push(ring);
+	return 1;
+}
+
+/* Take the oldest byte from a ring of bytes. Returns 1 if there was a
+ * byte, 0 if the ring was empty.
+ */
+static inline uint8_t ring_get_byte(Ring* ring, const uint8_t* buffer,
+		uint8_t size, uint8_t* c) {
+	if(ring_is_empty(ring)) {
+		return 0;
+	}
+	*c = buffer[ring_tail_index(ring, size)];
+	ring_pop(ring);
+	return 1;
+}
+
+#endif /* RING_H_ */
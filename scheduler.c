@@ -0,0 +1,204 @@
+/*
+ * scheduler.c
+ *
+ * Author: Xinyi Li
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <avr/sleep.h>
+#include <stdio.h>
+
+#include "scheduler.h"
+#include "timer0.h"
+#include "terminalio.h"
+
+typedef struct {
+	const char* name;		// in program memory
+	TaskFunction function;
+	uint16_t period;		// ms
+	uint16_t deadline;		// ms after the task became due
+	uint16_t budget;		// timer 0 counts
+	uint8_t enabled;
+	uint32_t due;			// clock tick at which the task next runs
+	// Statistics - all times are in timer 0 counts
+	uint32_t runs;
+	uint32_t total_time;
+	uint16_t max_time;
+	uint16_t misses;		// finished after the deadline
+	uint16_t overruns;		// took longer than the budget
+} Task;
+
+static Task tasks[SCHEDULER_MAX_TASKS];
+static uint8_t num_tasks;
+
+// The tick at which scheduler_run() last ran the tasks and the number
+// of ticks on which it couldn't run because an earlier pass took too long.
+static uint32_t last_tick;
+static uint32_t ticks_skipped;
+
+// CPU utilisation. We count the time (in timer 0 counts) spent asleep
+// waiting for the next tick, both since the statistics were last reset
+// and over a window of UTILISATION_WINDOW ticks. utilisation is the
+// percentage of the last complete window the CPU was busy.
+#define UTILISATION_WINDOW 1000
+static uint32_t stats_start;
+static uint32_t idle_time;
+static uint32_t window_start;
+static uint32_t window_idle_time;
+static uint8_t utilisation;
+
+int8_t scheduler_add_task(const char* name, TaskFunction function,
+		uint16_t period_ms, uint16_t deadline_ms, uint32_t budget_cycles) {
+	if(num_tasks >= SCHEDULER_MAX_TASKS) {
+		return -1;
+	}
+	Task* task = &tasks[num_tasks];
+	task->name = name;
+	task->function = function;
+	task->period = period_ms;
+	task->deadline = deadline_ms;
+	task->budget = budget_cycles / TIMER0_CYCLES_PER_COUNT;
+	task->enabled = 1;
+	task->due = get_current_time() + period_ms;
+	return num_tasks++;
+}
+
+void scheduler_set_enabled(uint8_t task, uint8_t enabled) {
+	if(task < num_tasks) {
+		tasks[task].enabled = enabled;
+		tasks[task].due = get_current_time() + tasks[task].period;
+	}
+}
+
+uint32_t scheduler_restart(void) {
+	uint32_t now = get_current_time();
+	for(uint8_t i = 0; i < num_tasks; i++) {
+		tasks[i].due = now + tasks[i].period;
+	}
+	last_tick = now;
+	return now;
+}
+
+void scheduler_run(void) {
+	uint32_t now;
+
+	// Wait for the next tick. This gives the game loop a fixed cadence
+	// of one pass per millisecond. While we wait we put the CPU to sleep
+	// (idle mode) - any interrupt wakes it up again.
+	if(get_current_time() == last_tick) {
+		uint32_t sleep_start = get_clock_counts();
+		set_sleep_mode(SLEEP_MODE_IDLE);
+		for(;;) {
+			// Interrupts are turned off while we check the time so that
+			// the tick can't happen between the check and going to sleep.
+			// The instruction after sei() is always executed before any
+			// pending interrupt, so sleep_cpu() is reached and the
+			// interrupt then wakes us.
+			cli();
+			if(get_current_time() != last_tick) {
+				sei();
+				break;
+			}
+			sleep_enable();
+			sei();
+			sleep_cpu();
+			sleep_disable();
+		}
+		uint32_t idle = get_clock_counts() - sleep_start;
+		idle_time += idle;
+		window_idle_time += idle;
+	}
+	now = get_current_time();
+	ticks_skipped += now - last_tick - 1;
+	last_tick = now;
+
+	if(now - window_start >= UTILISATION_WINDOW) {
+		uint32_t window = (now - window_start) * TIMER0_COUNTS_PER_TICK;
+		utilisation = 100 - window_idle_time * 100 / window;
+		window_start = now;
+		window_idle_time = 0;
+	}
+
+	for(uint8_t i = 0; i < num_tasks; i++) {
+		Task* task = &tasks[i];
+		if(!task->enabled || (int32_t)(now - task->due) < 0) {
+			continue;
+		}
+		uint32_t start = get_clock_counts();
+		task->function();
+		uint32_t finish = get_clock_counts();
+
+		// (A run can take longer than a 16 bit count can hold, so max_time
+		// is saturated rather than letting the time wrap.)
+		uint32_t time = finish - start;
+		task->runs++;
+		task->total_time += time;
+		if(time > task->max_time) {
+			task->max_time = time > UINT16_MAX ? UINT16_MAX : time;
+		}
+		if(time > task->budget) {
+			task->overruns++;
+		}
+		if(finish - task->due * TIMER0_COUNTS_PER_TICK >
+				(uint32_t)task->deadline * TIMER0_COUNTS_PER_TICK) {
+			task->misses++;
+		}
+
+		// Work out when the task is next due. We keep the task in phase
+		// unless we've fallen more than a whole period behind, in which
+		// case the missed runs are dropped.
+		task->due += task->period;
+		if((int32_t)(now - task->due) >= 0) {
+			task->due = now + task->period;
+		}
+	}
+}
+
+uint8_t scheduler_print_stats(uint8_t line) {
+	if(line == 0) {
+		printf_P(PSTR("task        runs  avg cyc  max cyc  miss  over"));
+	} else if(line <= num_tasks) {
+		Task* task = &tasks[line - 1];
+		uint32_t average = task->runs ? task->total_time / task->runs : 0;
+		printf_P(PSTR("%-8S %7lu %8lu %8lu %5u %5u"), task->name,
+				task->runs, average * TIMER0_CYCLES_PER_COUNT,
+				(uint32_t)task->max_time * TIMER0_CYCLES_PER_COUNT,
+				task->misses, task->overruns);
+	} else if(line == num_tasks + 1) {
+		printf_P(PSTR("skipped ticks: %lu"), ticks_skipped);
+	} else {
+		uint32_t total = get_clock_counts() - stats_start;
+		if(line == num_tasks + 2) {
+			printf_P(PSTR("cpu busy: %u%% (last second %u%%)"),
+					(uint8_t)(100 - idle_time / (total / 100 + 1)), utilisation);
+		} else {
+			printf_P(PSTR("idle %lu cycles, busy %lu cycles"),
+					idle_time * TIMER0_CYCLES_PER_COUNT,
+					(total - idle_time) * TIMER0_CYCLES_PER_COUNT);
+			clear_to_end_of_line();
+			scheduler_reset_stats();
+			return 0;
+		}
+	}
+	clear_to_end_of_line();
+	return 1;
+}
+
+void scheduler_reset_stats(void) {
+	for(uint8_t i = 0; i < num_tasks; i++) {
+		tasks[i].runs = 0;
+		tasks[i].total_time = 0;
+		tasks[i].max_time = 0;
+		tasks[i].misses = 0;
+		tasks[i].overruns = 0;
+	}
+	ticks_skipped = 0;
+	idle_time = 0;
+	stats_start = get_clock_counts();
+}
+
+uint8_t scheduler_utilisation(void) {
+	return utilisation;
+}
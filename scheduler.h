@@ -0,0 +1,64 @@
+/*
+ * scheduler.h
+ *
+ * Author: Xinyi Li
+ *
+ * A small cooperative scheduler driven by the timer 0 millisecond tick.
+ * Each task is a function that is run every period milliseconds. It is
+ * expected to finish within deadline milliseconds of the time it was
+ * due and to take no more than its budget of clock cycles. Every run
+ * is timed with timer 0 and the number of deadline misses and budget
+ * overruns is recorded for each task.
+ *
+ * Tasks are run in the order they were added. Tasks must not block -
+ * anything that has to wait should remember where it was and return.
+ */
+
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include <stdint.h>
+
+#define SCHEDULER_MAX_TASKS 18
+
+typedef void (*TaskFunction)(void);
+
+/* Add a task to the scheduler. name must be a string in program memory
+ * (e.g. PSTR("render")) and is only used when printing statistics.
+ * Returns the task number or -1 if there is no room for the task.
+ * The task is enabled and first becomes due one period from now.
+ */
+int8_t scheduler_add_task(const char* name, TaskFunction function,
+		uint16_t period_ms, uint16_t deadline_ms, uint32_t budget_cycles);
+
+/* Enable or disable the given task. A task that is enabled starts a new
+ * period, i.e. it will next run one period from now.
+ */
+void scheduler_set_enabled(uint8_t task, uint8_t enabled);
+
+/* Restart the period of every task from the current time. This is used
+ * at the start of a game so that the game tasks start in phase. Returns
+ * the tick the periods were restarted from.
+ */
+uint32_t scheduler_restart(void);
+
+/* Wait for the next clock tick and then run every enabled task that is
+ * due. This should be called repeatedly from the main loop - it returns
+ * once per millisecond (or later if the tasks took longer than that).
+ * The CPU sleeps (in idle mode) while waiting for the tick.
+ */
+void scheduler_run(void);
+
+/* Return the percentage of time the CPU was busy (not asleep waiting
+ * for the next tick) over the last second.
+ */
+uint8_t scheduler_utilisation(void);
+
+/* Print (to standard output) one line of the statistics for every task,
+ * starting from line 0. Returns 1 if there are more lines to print; the
+ * statistics are cleared once the last line has been printed.
+ */
+uint8_t scheduler_print_stats(uint8_t line);
+void scheduler_reset_stats(void);
+
+#endif /* SCHEDULER_H_ */
@@ -18,6 +18,10 @@ void add_to_score(uint16_t value) {
 	score += value;
 }
 
+void set_score(uint32_t value) {
+	score = value;
+}
+
 uint32_t get_score(void) {
 	return score;
 }
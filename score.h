@@ -11,6 +11,7 @@
 
 void init_score(void);
 void add_to_score(uint16_t value);
+void set_score(uint32_t value);
 uint32_t get_score(void);
 
 #endif /* SCORE_H_ */
\ No newline at end of file
@@ -10,13 +10,18 @@
  * to print many characters at once to the buffer and have them 
  * output by the UART as speed permits.) If the buffer fills up, the
  * put method will either
- * (1) if interrupts are enabled, block until there is room in it, or
- * (2) if interrupts are disabled, will discard the character.
+ * (1) if interrupts are enabled and the output is SERIAL_CRITICAL,
+ * block until there is room in it, or
+ * (2) otherwise, discard the character.
+ * Lower priority output also leaves room in the buffer for higher
+ * priority output (see serialio.h).
  * Input is blocking - requesting input from stdin will block
  * until a character is available. If interrupts are disabled when 
  * input is sought, then this will block forever.
  * The function input_available() can be used to test whether there is
  * input available to read from stdin.
+ * Both buffers are single producer, single consumer rings (see ring.h)
+ * so neither side turns interrupts off to use them.
  *
  */
 
@@ -25,46 +30,99 @@
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 
-/* System clock rate in Hz. (L at the end indicates this is a long constant) */
-#define SYSCLK 8000000L
+/* System clock rate (F_CPU) */
+#include "clock.h"
+#include "timer0.h"
+#include "input.h"
+#include "ring.h"
+#include "serialio.h"
+#include "frame.h"
 
 /* Global variables */
-/* Circular buffer to hold outgoing characters. The insert_pos variable
- * keeps track of the position (0 to OUTPUT_BUFFER_SIZE-1) that the next
- * outgoing character should be written to. bytes_in_buffer keeps
- * count of the number of characters currently stored in the buffer 
- * (ranging from 0 to OUTPUT_BUFFER_SIZE). This number of bytes immediately
- * prior to the current insert_pos are the bytes waiting to be output.
- * If the insert_pos reaches the end of the buffer it will wrap around
- * to the beginning (assuming those bytes have been output).
- * NOTE - OUTPUT_BUFFER_SIZE can not be larger than 255 without changing
- * the type of the variables below (currently defined as 8 bit unsigned ints).
+/* Ring buffer to hold outgoing characters. Characters are added by
+ * uart_put_char() and removed by the UART Data Register Empty interrupt
+ * handler.
+ * NOTE - OUTPUT_BUFFER_SIZE must be a power of two no larger than 128
+ * (see ring.h).
  */
-#define OUTPUT_BUFFER_SIZE 255
-volatile char out_buffer[OUTPUT_BUFFER_SIZE];
-volatile uint8_t out_insert_pos;
-volatile uint8_t bytes_in_out_buffer;
+#define OUTPUT_BUFFER_SIZE 128
+static uint8_t out_buffer[OUTPUT_BUFFER_SIZE];
+static Ring out_ring;
 
-/* Circular buffer to hold incoming characters. Works on same principle
- * as output buffer
+/* Ring buffer to hold incoming characters. Characters are added by the
+ * UART Receive Complete interrupt handler and removed by uart_get_char().
  */
 #define INPUT_BUFFER_SIZE 16
-volatile char input_buffer[INPUT_BUFFER_SIZE];
-volatile uint8_t input_insert_pos;
-volatile uint8_t bytes_in_input_buffer;
+static uint8_t input_buffer[INPUT_BUFFER_SIZE];
+static Ring input_ring;
 volatile uint8_t input_overrun;
 
+/* Characters added to the output buffer (only changed by uart_put_char()
+ * outside interrupt handlers).
+ */
+static uint32_t bytes_sent;
+
+/* Priority of the output being written and the number of characters
+ * of each priority that have been dropped.
+ */
+static uint8_t output_priority;
+static uint16_t dropped[3];
+static const uint8_t output_limit[3] = {
+	OUTPUT_BUFFER_SIZE,
+	OUTPUT_BUFFER_SIZE - SERIAL_STATUS_HEADROOM,
+	OUTPUT_BUFFER_SIZE - SERIAL_DEBUG_HEADROOM
+};
+
+#if !RING_SIZE_VALID(OUTPUT_BUFFER_SIZE) || !RING_SIZE_VALID(INPUT_BUFFER_SIZE)
+#error "Serial buffer sizes must be powers of two no bigger than 128"
+#endif
+
+/* A baud rate change (see serial_set_baud()). While change_pending is
+ * set the UDR Empty interrupt handler only sends the bytes_before_change
+ * characters that were waiting when the change was asked for, and then
+ * holds the rest back. tx_busy is set whenever a character is written to
+ * UDR0 (TXC0 is only meaningful once something has been sent), so the
+ * rate is changed once the held back point has been reached and either
+ * nothing has been sent or TXC0 shows the last character has gone.
+ */
+static uint32_t pending_baud;
+static volatile uint8_t change_pending;
+static volatile uint8_t bytes_before_change;
+static volatile uint8_t tx_busy;
+
 /* Variable to keep track of whether incoming characters are to be echoed
  * back or not.
  */
 static int8_t do_echo;
 
+/* Whether incoming characters go to the input event queue rather than
+ * the input buffer (see serial_input_to_events()).
+ */
+static volatile uint8_t to_events;
+
+/* State of the decoder that turns the characters received into key
+ * events (see input.h). Only the receive interrupt uses these.
+ * decode_state is where we are in an escape sequence, and last_was_cr is
+ * set after a carriage return so that the linefeed of a CR LF pair can
+ * be skipped.
+ */
+#define DECODE_NORMAL 0
+#define DECODE_ESCAPE 1		// had ESC
+#define DECODE_CSI 2		// had ESC [ (and maybe some parameters)
+#define DECODE_SS3 3		// had ESC O
+static uint8_t decode_state;
+static uint8_t last_was_cr;
+
 /* Function prototypes 
  */
 void init_serial_stdio(long baudrate, int8_t echo);
 static int uart_put_char(char, FILE*);
 static int uart_get_char(FILE*);
+static uint8_t make_room(uint8_t length);
+static void start_sending(void);
+static void decode_input(char c);
 
 /* Setup a stream that uses the uart get and put functions. We will
  * make standard input and output use this stream below.
@@ -72,15 +130,57 @@ static int uart_get_char(FILE*);
 static FILE myStream = FDEV_SETUP_STREAM(uart_put_char, uart_get_char,
 		_FDEV_SETUP_RW);
 
+/* Work out the UBRR value for a baud rate with the UART clocked at
+ * F_CPU/divisor (16 in normal mode, 8 in double speed mode). Returns the
+ * error in tenths of a percent.
+ */
+static uint16_t baud_setting(uint32_t baud, uint8_t divisor, uint16_t* ubrr) {
+	/* (This differs from the datasheet formula so that we get 
+	 * rounding to the nearest integer while using integer division
+	 * (which truncates)).
+	*/
+	uint32_t value = (F_CPU / (divisor / 2 * baud) + 1) / 2;
+	if(value == 0) {
+		value = 1;
+	} else if(value > 4096) {
+		value = 4096;
+	}
+	*ubrr = value - 1;
+	uint32_t actual = F_CPU / (divisor * value);
+	uint32_t difference = actual > baud ? actual - baud : baud - actual;
+	return difference * 1000 / baud;
+}
+
+/* Set the baud rate, using double speed mode if that is more accurate.
+ * Returns 0 (and changes nothing) if neither mode is accurate to
+ * SERIAL_MAX_BAUD_ERROR_PERMILLE.
+ */
+static uint8_t set_baud(uint32_t baud) {
+	uint16_t ubrr, ubrr_u2x;
+	uint16_t error = baud_setting(baud, 16, &ubrr);
+	uint16_t error_u2x = baud_setting(baud, 8, &ubrr_u2x);
+	if(error <= error_u2x) {
+		if(error > SERIAL_MAX_BAUD_ERROR_PERMILLE) {
+			return 0;
+		}
+		UCSR0A = 0;
+		UBRR0 = ubrr;
+	} else {
+		if(error_u2x > SERIAL_MAX_BAUD_ERROR_PERMILLE) {
+			return 0;
+		}
+		UCSR0A = (1 << U2X0);
+		UBRR0 = ubrr_u2x;
+	}
+	return 1;
+}
+
 void init_serial_stdio(long baudrate, int8_t echo) {
-	uint16_t ubrr;
 	/*
 	 * Initialise our buffers
 	*/
-	out_insert_pos = 0;
-	bytes_in_out_buffer = 0;
-	input_insert_pos = 0;
-	bytes_in_input_buffer = 0;
+	ring_init(&out_ring);
+	ring_init(&input_ring);
 	input_overrun = 0;
 	
 	/*
@@ -89,12 +189,7 @@ void init_serial_stdio(long baudrate, int8_t echo) {
 	do_echo = echo;
 	
 	/* Configure the serial port baud rate */
-	/* (This differs from the datasheet formula so that we get 
-	 * rounding to the nearest integer while using integer division
-	 * (which truncates)).
-	*/
-	ubrr = ((SYSCLK / (8 * baudrate)) + 1)/2 - 1;
-	UBRR0 = ubrr;
+	(void)set_baud(baudrate);
 	
 	/*
 	 * Enable transmission and receiving via UART. We don't enable
@@ -118,19 +213,189 @@ void init_serial_stdio(long baudrate, int8_t echo) {
 	stdin = &myStream;
 }
 
+void serial_input_to_events(uint8_t enable) {
+	decode_state = DECODE_NORMAL;
+	to_events = enable;
+}
+
+uint8_t serial_set_priority(uint8_t priority) {
+	uint8_t previous = output_priority;
+	if(priority <= SERIAL_DEBUG) {
+		output_priority = priority;
+	}
+	return previous;
+}
+
+uint8_t serial_output_space(uint8_t priority) {
+	uint8_t count = ring_count(&out_ring);
+	uint8_t limit = output_limit[priority];
+	return count < limit ? limit - count : 0;
+}
+
+uint16_t serial_dropped_bytes(uint8_t priority) {
+	return dropped[priority];
+}
+
+void serial_put_char(char c) {
+	(void)uart_put_char(c, 0);
+}
+
+/* Wait until there is room in the output buffer for length characters
+ * of the current priority. Returns 1 when there is room, or 0 if the
+ * characters have to be dropped (they are counted as dropped).
+ * Only critical output waits, and only if interrupts are enabled (the
+ * buffer will never be emptied if they are disabled).
+ */
+static uint8_t make_room(uint8_t length) {
+	uint8_t limit = output_limit[output_priority];
+	if(length <= limit) {
+		while((uint16_t)ring_count(&out_ring) + length > limit) {
+			if(output_priority != SERIAL_CRITICAL || bit_is_clear(SREG, SREG_I)) {
+				dropped[output_priority] += length;
+				return 0;
+			}
+			/* The output may be held back for a baud rate change, which
+			 * has to be made before there will be room.
+			 */
+			serial_task();
+		}
+		return 1;
+	}
+	dropped[output_priority] += length;
+	return 0;
+}
+
+/* Make sure the UDR Empty interrupt is enabled so that it will fire and
+ * deal with the characters we've added. (The ISR only disables it when
+ * it finds the buffer empty, and it can't run in the middle of this
+ * update, so the interrupt can't be left off with characters waiting.)
+ */
+static void start_sending(void) {
+	UCSR0B |= (1 << UDRIE0);
+}
+
+uint8_t serial_writev(const SerialChunk* chunks, uint8_t count) {
+	uint16_t total = 0;
+	for(uint8_t i = 0; i < count; i++) {
+		total += chunks[i].length;
+	}
+	if(total > OUTPUT_BUFFER_SIZE) {
+		dropped[output_priority] += total;
+		return 0;
+	}
+	if(!make_room(total)) {
+		return 0;
+	}
+	// Copy everything in and then make it visible to the ISR in one go
+	uint8_t index = ring_head_index(&out_ring, OUTPUT_BUFFER_SIZE);
+	for(uint8_t i = 0; i < count; i++) {
+		const uint8_t* data = chunks[i].data;
+		uint8_t length = chunks[i].length;
+		if(chunks[i].in_progmem) {
+			while(length--) {
+				out_buffer[index] = pgm_read_byte(data++);
+				index = (index + 1) & (OUTPUT_BUFFER_SIZE - 1);
+			}
+		} else {
+			while(length--) {
+				out_buffer[index] = *data++;
+				index = (index + 1) & (OUTPUT_BUFFER_SIZE - 1);
+			}
+		}
+	}
+	ring_push_n(&out_ring, total);
+	bytes_sent += total;
+	start_sending();
+	return 1;
+}
+
+uint8_t serial_write(const void* data, uint8_t length) {
+	SerialChunk chunk = { data, length, 0 };
+	return serial_writev(&chunk, 1);
+}
+
+uint8_t serial_write_P(const char* data, uint8_t length) {
+	SerialChunk chunk = { data, length, 1 };
+	return serial_writev(&chunk, 1);
+}
+
+uint32_t serial_bytes_sent(void) {
+	return bytes_sent;
+}
+
+uint32_t serial_bytes_per_second(void) {
+	static uint32_t last_time;
+	static uint32_t last_bytes;
+	uint32_t now = get_current_time();
+	uint32_t rate = now != last_time ?
+			(bytes_sent - last_bytes) * 1000 / (now - last_time) : 0;
+	last_time = now;
+	last_bytes = bytes_sent;
+	return rate;
+}
+
+uint8_t serial_baud_supported(uint32_t baud) {
+	uint16_t ubrr;
+	// (baud_setting() divides by the rate)
+	return baud != 0 && (baud_setting(baud, 16, &ubrr) <= SERIAL_MAX_BAUD_ERROR_PERMILLE ||
+			baud_setting(baud, 8, &ubrr) <= SERIAL_MAX_BAUD_ERROR_PERMILLE);
+}
+
+uint8_t serial_set_baud(uint32_t baud) {
+	if(!serial_baud_supported(baud)) {
+		return 0;
+	}
+	/* Everything waiting is sent at the old rate. (If a change is already
+	 * pending, its point in the output is kept and only the rate changes.)
+	 */
+	uint8_t interrupts_were_enabled = begin_critical_section();
+	if(!change_pending) {
+		bytes_before_change = ring_count(&out_ring);
+		change_pending = 1;
+	}
+	pending_baud = baud;
+	end_critical_section(interrupts_were_enabled);
+	return 1;
+}
+
+uint8_t serial_baud_pending(void) {
+	return change_pending;
+}
+
+void serial_task(void) {
+	if(!change_pending || bytes_before_change) {
+		return;
+	}
+	/* (The receive interrupt may echo a character, so the check and the
+	 * change are done with interrupts off.)
+	 */
+	uint8_t interrupts_were_enabled = begin_critical_section();
+	if(!tx_busy || bit_is_set(UCSR0A, TXC0)) {
+		(void)set_baud(pending_baud);
+		change_pending = 0;
+		tx_busy = 0;
+		if(!ring_is_empty(&out_ring)) {
+			start_sending();
+		}
+	}
+	end_critical_section(interrupts_were_enabled);
+}
+
+uint32_t serial_baud(void) {
+	uint8_t divisor = bit_is_set(UCSR0A, U2X0) ? 8 : 16;
+	return F_CPU / (divisor * (UBRR0 + 1UL));
+}
+
 int8_t serial_input_available(void) {
-	return (bytes_in_input_buffer != 0);
+	return !ring_is_empty(&input_ring);
 }
 
 void clear_serial_input_buffer(void) {
 	/* Just adjust our buffer data so it looks empty */
-	input_insert_pos = 0;
-	bytes_in_input_buffer = 0;
+	ring_flush(&input_ring);
 }
 
 static int uart_put_char(char c, FILE* stream) {
-	uint8_t interrupts_enabled;
-	
 	/* Add the character to the buffer for transmission (if there 
 	 * is space to do so). If not we wait until the buffer has space.
 	 * If the character is \n, we output \r (carriage return)
@@ -140,76 +405,25 @@ static int uart_put_char(char c, FILE* stream) {
 		uart_put_char('\r', stream);
 	}
 	
-	/* If the buffer is full and interrupts are disabled then we
-	 * abort - we don't output the character since the buffer will
-	 * never be emptied if interrupts are disabled. If the buffer is full
-	 * and interrupts are enabled then we loop until the buffer has 
-	 * enough space. The bytes_in_buffer variable will get modified by the
-	 * ISR which extracts bytes from the buffer.
+	/* If there is no room for the character then we drop it, unless it
+	 * is critical and interrupts are enabled, in which case we loop
+	 * until the ISR which extracts bytes from the buffer has made space.
 	*/
-	interrupts_enabled = bit_is_set(SREG, SREG_I);
-	while(bytes_in_out_buffer >= OUTPUT_BUFFER_SIZE) {
-		if(!interrupts_enabled) {
-			return 1;
-		}		
-		/* else do nothing */
-	}
-	
-	/* Add the character to the buffer for transmission if there
-	 * is space to do so. We advance the insert_pos to the next
-	 * character position. If this is beyond the end of the buffer
-	 * we wrap around back to the beginning of the buffer 
-	 * NOTE: we disable interrupts before modifying the buffer. This
-	 * prevents the ISR from modifying the buffer at the same time.
-	 * We reenable them if they were enabled when we entered the
-	 * function.
-	*/	
-	cli();
-	out_buffer[out_insert_pos++] = c;
-	bytes_in_out_buffer++;
-	if(out_insert_pos == OUTPUT_BUFFER_SIZE) {
-		/* Wrap around buffer pointer if necessary */
-		out_insert_pos = 0;
-	}
-	/* Reenable interrupts (UDR Empty interrupt may have been
-	 * disabled) - we ensure it is now enabled so that it will
-	 * fire and deal with the next character in the buffer. */
-	UCSR0B |= (1 << UDRIE0);
-	if(interrupts_enabled) {
-		sei();
+	if(!make_room(1)) {
+		return 1;
 	}
+	(void)ring_put_byte(&out_ring, out_buffer, OUTPUT_BUFFER_SIZE, c);
+	bytes_sent++;
+	start_sending();
 	return 0;
 }
 
 int uart_get_char(FILE* stream) {
+	uint8_t c;
 	/* Wait until we've received a character */
-	while(bytes_in_input_buffer == 0) {
+	while(!ring_get_byte(&input_ring, input_buffer, INPUT_BUFFER_SIZE, &c)) {
 		/* do nothing */
 	}
-	
-	/*
-	 * Turn interrupts off and remove a character from the input
-	 * buffer. We reenable interrupts if they were on.
-	 * The pending character is the one which is byte_in_input_buffer
-	 * characters before the insert position (taking into account
-	 * that we may need to wrap around).
-	 */
-	uint8_t interrupts_enabled = bit_is_set(SREG, SREG_I);
-	cli();
-	char c;
-	if(input_insert_pos - bytes_in_input_buffer < 0) {
-		/* Need to wrap around */
-		c = input_buffer[input_insert_pos - bytes_in_input_buffer
-				+ INPUT_BUFFER_SIZE];
-	} else {
-		c = input_buffer[input_insert_pos - bytes_in_input_buffer];
-	}
-	
-	/* Decrement our count of bytes in the input buffer */
-	bytes_in_input_buffer--;
-	if(interrupts_enabled) {
-		sei();
-	}	
 	return c;
 }
 
@@ -219,29 +433,27 @@ int uart_get_char(FILE* stream) {
  */
 ISR(USART0_UDRE_vect) 
 {
-	/* Check if we have data in our buffer */
-	if(bytes_in_out_buffer > 0) {
-		/* Yes we do - remove the pending byte and output it
-		 * via the UART. The pending byte (character) is the
-		 * one which is "bytes_in_buffer" characters before the 
-		 * insert_pos (taking into account that we may 
-		 * need to wrap around to the end of the buffer).
+	uint8_t c;
+	if(change_pending && bytes_before_change == 0) {
+		/* The rest waits for the new baud rate - serial_task() turns the
+		 * interrupt back on once it has been changed.
 		 */
-		char c;
-		if(out_insert_pos - bytes_in_out_buffer < 0) {
-			/* Need to wrap around */
-			c = out_buffer[out_insert_pos - bytes_in_out_buffer
-				+ OUTPUT_BUFFER_SIZE];
-		} else {
-			c = out_buffer[out_insert_pos - bytes_in_out_buffer];
-		}
-		/* Decrement our count of the number of bytes in the 
-		 * buffer 
+		UCSR0B &= ~(1<<UDRIE0);
+		return;
+	}
+	/* Check if we have data in our buffer */
+	if(ring_get_byte(&out_ring, out_buffer, OUTPUT_BUFFER_SIZE, &c)) {
+		/* Yes we do - output it via the UART. (Clear the transmit
+		 * complete flag too, so that it shows when the last character
+		 * has gone - see serial_task(). The other flags in UCSR0A
+		 * must be written as zero.)
 		 */
-		bytes_in_out_buffer--;
-		
-		/* Output the character via the UART */
 		UDR0 = c;
+		UCSR0A = (UCSR0A & (1 << U2X0)) | (1 << TXC0);
+		tx_busy = 1;
+		if(change_pending) {
+			bytes_before_change--;
+		}
 	} else {
 		/* No data in the buffer. We disable the UART Data
 		 * Register Empty interrupt because otherwise it 
@@ -265,39 +477,105 @@ ISR(USART0_RX_vect)
 	char c;
 	c = UDR0;
 		
-	if(do_echo && bytes_in_out_buffer < OUTPUT_BUFFER_SIZE) {
-		/* If echoing is enabled and there is output buffer
-		 * space, echo the received character back to the UART.
-		 * (If there is no output buffer space, characters
-		 * will be lost.)
+	if(do_echo && ring_is_empty(&out_ring) && bit_is_set(UCSR0A, UDRE0)) {
+		/* If echoing is enabled and nothing else is being output,
+		 * echo the received character straight back to the UART.
+		 * (We can't add it to the output buffer - the main program
+		 * may be part way through adding a character, and the buffer
+		 * only has one producer. If output is in progress the
+		 * character isn't echoed.) The transmit complete flag is
+		 * cleared as it is for any other character.
 		 */
-		uart_put_char(c, 0);
+		UDR0 = c;
+		UCSR0A = (UCSR0A & (1 << U2X0)) | (1 << TXC0);
+		tx_busy = 1;
+	}
+	
+	if(to_events) {
+		// Binary frames (see frame.h) are mixed in with the key presses
+		if(!frame_receive(c)) {
+			decode_input(c);
+		}
+		return;
+	}
+	
+	/* If the character is a carriage return, turn it into a
+	 * linefeed 
+	*/
+	if (c == '\r') {
+		c = '\n';
 	}
 	
 	/* 
-	 * Check if we have space in our buffer. If not, set the overrun
-	 * flag and throw away the character. (We never clear the 
-	 * overrun flag - it's up to the programmer to check/clear
+	 * Add the character to the buffer if there is space. If not, set
+	 * the overrun flag and throw away the character. (We never clear
+	 * the overrun flag - it's up to the programmer to check/clear
 	 * this flag if desired.)
 	 */
-	if(bytes_in_input_buffer >= INPUT_BUFFER_SIZE) {
+	if(!ring_put_byte(&input_ring, input_buffer, INPUT_BUFFER_SIZE, c)) {
 		input_overrun = 1;
-	} else {
-		/* If the character is a carriage return, turn it into a
-		 * linefeed 
-		*/
-		if (c == '\r') {
-			c = '\n';
-		}
-		
-		/* 
-		 * There is room in the input buffer 
-		 */
-		input_buffer[input_insert_pos++] = c;
-		bytes_in_input_buffer++;
-		if(input_insert_pos == INPUT_BUFFER_SIZE) {
-			/* Wrap around buffer pointer if necessary */
-			input_insert_pos = 0;
+	}
+}
+
+/*
+ * Decode one received character, posting an INPUT_SERIAL event if it
+ * completes a key. This is called from the receive interrupt handler so
+ * a burst of characters (e.g. pasted text or a held cursor key) is
+ * decoded as it arrives rather than being buffered for the game.
+ */
+static void decode_input(char c) {
+	uint8_t cr = last_was_cr;
+	last_was_cr = 0;
+
+	switch(decode_state) {
+		case DECODE_ESCAPE:
+			if(c == '[') {
+				decode_state = DECODE_CSI;
+				return;
+			} else if(c == 'O') {
+				decode_state = DECODE_SS3;
+				return;
+			}
+			// ESC on its own - send it and then handle this character
+			// normally
+			decode_state = DECODE_NORMAL;
+			input_post(INPUT_SERIAL, ESCAPE_CHAR);
+			break;
+		case DECODE_CSI:
+			if(c >= 0x20 && c < 0x40) {
+				// Parameter (e.g. the 1;5 of ESC [ 1 ; 5 A) - ignored
+				return;
+			}
+			decode_state = DECODE_NORMAL;
+			if(c >= 'A' && c <= 'D') {
+				input_post(INPUT_SERIAL, KEY_UP + (c - 'A'));
+				return;
+			} else if(c >= 0x40 && c < 0x7F) {
+				// Some other key we don't use
+				return;
+			}
+			// Not a valid sequence - handle this character normally
+			break;
+		case DECODE_SS3:
+			decode_state = DECODE_NORMAL;
+			if(c >= 'A' && c <= 'D') {
+				input_post(INPUT_SERIAL, KEY_UP + (c - 'A'));
+			}
+			return;
+	}
+
+	if(c == ESCAPE_CHAR) {
+		decode_state = DECODE_ESCAPE;
+	} else if(c == '\r') {
+		last_was_cr = 1;
+		input_post(INPUT_SERIAL, '\n');
+	} else if(c == '\n') {
+		if(!cr) {
+			input_post(INPUT_SERIAL, '\n');
 		}
+	} else if(c == '\b' || c == 127) {
+		input_post(INPUT_SERIAL, '\b');
+	} else {
+		input_post(INPUT_SERIAL, c);
 	}
 }
@@ -25,6 +25,107 @@
  */
 void init_serial_stdio(long baudrate, int8_t echo);
 
+/* Send incoming characters to the input event queue (see input.h) as
+ * INPUT_SERIAL key events instead of keeping them for standard input.
+ * Binary frames (see frame.h) are picked out of the input first.
+ * Escape sequences, line endings and backspace are decoded as the
+ * characters arrive (see input.h for the key codes).
+ */
+void serial_input_to_events(uint8_t enable);
+
+/* Output priorities. Everything written to standard output has the
+ * priority last set with serial_set_priority().
+ * - SERIAL_CRITICAL output waits for room in the output buffer (if
+ *   interrupts are on) so none of it is lost. This is the default.
+ * - SERIAL_STATUS and SERIAL_DEBUG output never waits - characters that
+ *   don't fit are dropped. They also can't use the last
+ *   SERIAL_STATUS_HEADROOM or SERIAL_DEBUG_HEADROOM bytes of the buffer,
+ *   which are kept for higher priority output.
+ * The game only writes SERIAL_STATUS and SERIAL_DEBUG output while it is
+ * being played, so it is never held up by the serial port.
+ */
+#define SERIAL_CRITICAL 0
+#define SERIAL_STATUS 1
+#define SERIAL_DEBUG 2
+#define SERIAL_STATUS_HEADROOM 16
+#define SERIAL_DEBUG_HEADROOM 64
+
+/* Set the priority of the output that follows. Returns the previous
+ * priority (so it can be put back).
+ */
+uint8_t serial_set_priority(uint8_t priority);
+
+/* Number of characters of the given priority that can be written now
+ * without any being dropped.
+ */
+uint8_t serial_output_space(uint8_t priority);
+
+/* Number of characters of the given priority that have been dropped */
+uint16_t serial_dropped_bytes(uint8_t priority);
+
+/* Write a character to the serial port (at the current output priority)
+ * without going through standard output. A linefeed is sent as
+ * carriage return, linefeed.
+ */
+void serial_put_char(char c);
+
+/* Write characters to the serial port (at the current output priority)
+ * in one go - the space is reserved once and the characters copied
+ * straight into the output buffer. Nothing is translated (a linefeed is
+ * just sent as a linefeed). A write is all or nothing: if there isn't
+ * room for the whole write it is dropped (or, for critical output,
+ * waits for room). Writes can't be longer than the output buffer (128
+ * characters). Returns 1 if the characters were written, 0 if they were
+ * dropped.
+ * serial_write_P() writes from program memory. serial_writev() writes
+ * several pieces (each in RAM or program memory) as one write, e.g. a
+ * cursor movement and the text to show there.
+ */
+typedef struct {
+	const void* data;
+	uint8_t length;
+	uint8_t in_progmem;
+} SerialChunk;
+
+uint8_t serial_write(const void* data, uint8_t length);
+uint8_t serial_write_P(const char* data, uint8_t length);
+uint8_t serial_writev(const SerialChunk* chunks, uint8_t count);
+
+/* Change the baud rate (e.g. to 115200, 250000 or 500000). Double speed
+ * mode (U2X) is used if it is more accurate at this clock speed.
+ * This never waits: anything already waiting to be sent is sent at the
+ * old rate, and the rate is changed by serial_task() once the last of it
+ * has gone. Output written after this is held back until then.
+ * serial_baud_pending() returns 1 until the rate has changed. Returns 0,
+ * and leaves the rate unchanged, if the rate can't be generated to
+ * within 2% (see clock.h).
+ */
+uint8_t serial_set_baud(uint32_t baud);
+uint8_t serial_baud_pending(void);
+
+/* Returns 1 if serial_set_baud() would take the rate (it isn't 0 and can
+ * be generated to within 2%), 0 if not.
+ */
+uint8_t serial_baud_supported(uint32_t baud);
+
+/* Make a baud rate change asked for with serial_set_baud(). This should
+ * be run regularly (e.g. as a scheduler task).
+ */
+void serial_task(void);
+
+/* The baud rate actually in use */
+uint32_t serial_baud(void);
+
+/* Average number of characters sent to the UART output buffer per
+ * second since this was last called.
+ */
+uint32_t serial_bytes_per_second(void);
+
+/* Number of characters sent to the UART output buffer (including the
+ * carriage returns added before linefeeds).
+ */
+uint32_t serial_bytes_sent(void);
+
 /* Test if input is available from the serial port. Return 0 if not,
  * non-zero otherwise. If there is input available then it can be read
  * with a suitable standard IO library function, e.g. fgetc().
@@ -6,7 +6,7 @@
  */ 
 #include <avr/io.h>
 #include <avr/interrupt.h>
-#define F_CPU 8000000UL	// 8MHz
+#include "clock.h"
 #include <util/delay.h>
 #include <stdio.h>
 
@@ -17,12 +17,19 @@ int global_disable_sound = 0;
 int sound_on = 0;
 int sound_quiet = 0;
 int playing_sound = 0;
-uint32_t current_time;
-uint32_t last_play_time;
 
+// Timer used to stop the sound once it has played for its duration.
+static SoftTimer sound_timer;
+
+// Timer 1 is clocked at TIMER1_HZ (F_CPU / 8)
+// (A frequency of 0 gives the longest period - what the AVR's division
+// gives for a division by zero.)
 uint16_t freq_to_clock_period(uint16_t freq) {
-	return (1000000UL / freq);	// UL makes the constant an unsigned long (32 bits)
-	// and ensures we do 32 bit arithmetic, not 16
+	if (freq == 0) {
+		return UINT16_MAX;
+	}
+	return (TIMER1_HZ / freq);	// TIMER1_HZ is an unsigned long (32 bits)
+	// which ensures we do 32 bit arithmetic, not 16
 }
 
 // Return the width of a pulse (in clock cycles) given a duty cycle (%) and
@@ -43,6 +50,16 @@ void disable_sound(void) {
 	playing_sound = 0;
 }
 
+// Called when a sound has played for its duration. While the game is
+// paused the sound is held (silently) until the game resumes.
+static void sound_timeout(SoftTimer* timer) {
+	if (paused) {
+		soft_timer_rearm(timer, 1);
+	} else {
+		disable_sound();
+	}
+}
+
 void init_sound(void) {
 	DDRD |= (1 << PORTD4);
 	DDRD &= ~(1 << PIND3) | ~(1 << PIND5);
@@ -78,35 +95,26 @@ void play_sound(uint16_t freq, uint32_t duration) {
 	
 	enable_sound();
 
-	current_time = get_current_time();
-	last_play_time = get_current_time() + duration;
+	soft_timer_arm(&sound_timer, duration, 0, sound_timeout);
 }
 
-uint32_t hold_time = 0;
-
-ISR(TIMER1_COMPA_vect) {
+// The sound interrupts don't block other interrupts (in particular the
+// timer tick) while they run.
+ISR(TIMER1_COMPA_vect, ISR_NOBLOCK) {
 	if (playing_sound) {
 		if (paused) {
 			OCR1B = 0;
-			current_time = get_current_time();
-			last_play_time = get_current_time() + hold_time;
 		} else {
 			if (pulsewidth > 0) {
 				OCR1B = pulsewidth - 1;
 				} else {
 				OCR1B = 0;
 			}
-			current_time = get_current_time();
-			hold_time = last_play_time - current_time;
-		}
-		if (current_time >= last_play_time) {
-			disable_sound();
-			last_play_time = current_time;
 		}
 	}
 }
 
-ISR(PCINT3_vect) {
+ISR(PCINT3_vect, ISR_NOBLOCK) {
 	sound_on = bit_is_set(PIND, PIND3) == 8 ? 1 : 0;
 	sound_quiet = bit_is_set(PIND, PIND5) == 32 ? 1 : 0;
 	if (!paused) {
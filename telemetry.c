@@ -0,0 +1,186 @@
+/*
+ * telemetry.c
+ *
+ * Author: Xinyi Li
+ */
+
+#include <avr/pgmspace.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "telemetry.h"
+#include "frame.h"
+#include "terminalio.h"
+
+// Longest record: both header bytes and every field
+#define TELEMETRY_MAX_RECORD 19
+
+static uint8_t enabled;
+static uint8_t pending_events;
+
+// The last state sent (what the receiver has)
+static TelemetryState last;
+static uint8_t need_key;
+static uint16_t since_key;
+
+// The batch of records waiting to be sent. batch[0] is the number of the
+// first record.
+static uint8_t batch[FRAME_MAX_PAYLOAD];
+static uint8_t batch_length;
+static uint8_t batch_records;
+static uint8_t record_number;
+
+// Counters
+static uint32_t records;
+static uint32_t bytes_sent;
+static uint16_t frames_sent;
+static uint16_t frames_lost;
+
+void telemetry_enable(uint8_t enable) {
+	enabled = enable;
+	need_key = 1;
+	batch_length = 0;
+	batch_records = 0;
+	pending_events = 0;
+}
+
+uint8_t telemetry_enabled(void) {
+	return enabled;
+}
+
+void telemetry_event(uint8_t event) {
+	// (Events while telemetry is off would otherwise turn up in the
+	// first record once it is turned on.)
+	if(enabled) {
+		pending_events |= event;
+	}
+}
+
+static uint8_t* put_bytes(uint8_t* out, const void* value, uint8_t length) {
+	memcpy(out, value, length);
+	return out + length;
+}
+
+// Add a record of what changed between last and state to the batch
+static void add_record(const TelemetryState* state) {
+	uint8_t* header = batch + batch_length;
+	uint8_t* out = header + 1;
+	uint8_t changed = 0, more = 0;
+
+	if(need_key || state->frog_row != last.frog_row ||
+			state->frog_column != last.frog_column) {
+		changed |= TELEMETRY_FROG;
+	}
+	if(need_key || memcmp(state->lanes, last.lanes, sizeof(state->lanes))) {
+		changed |= TELEMETRY_LANES;
+	}
+	if(need_key || memcmp(state->logs, last.logs, sizeof(state->logs))) {
+		changed |= TELEMETRY_LOGS;
+	}
+	if(need_key || state->riverbank != last.riverbank) {
+		changed |= TELEMETRY_RIVERBANK;
+	}
+	if(need_key || state->countdown != last.countdown) {
+		changed |= TELEMETRY_COUNTDOWN;
+	}
+	if(need_key || state->score != last.score) {
+		changed |= TELEMETRY_SCORE;
+	}
+	if(need_key || pending_events) {
+		changed |= TELEMETRY_EVENTS;
+	}
+	if(need_key || state->level != last.level) {
+		more |= TELEMETRY_LEVEL;
+	}
+	if(need_key || state->lives != last.lives) {
+		more |= TELEMETRY_LIVES;
+	}
+	if(need_key || state->mode != last.mode || state->paused != last.paused) {
+		more |= TELEMETRY_MODE;
+	}
+	if(more) {
+		changed |= TELEMETRY_MORE;
+		*out++ = more;
+	}
+	*header = changed;
+
+	if(changed & TELEMETRY_FROG) {
+		*out++ = state->frog_row << 4 | state->frog_column;
+	}
+	if(changed & TELEMETRY_LANES) {
+		out = put_bytes(out, state->lanes, sizeof(state->lanes));
+	}
+	if(changed & TELEMETRY_LOGS) {
+		out = put_bytes(out, state->logs, sizeof(state->logs));
+	}
+	if(changed & TELEMETRY_RIVERBANK) {
+		out = put_bytes(out, &state->riverbank, sizeof(state->riverbank));
+	}
+	if(changed & TELEMETRY_COUNTDOWN) {
+		*out++ = state->countdown;
+	}
+	if(changed & TELEMETRY_SCORE) {
+		out = put_bytes(out, &state->score, sizeof(state->score));
+	}
+	if(changed & TELEMETRY_EVENTS) {
+		*out++ = pending_events;
+	}
+	if(more & TELEMETRY_LEVEL) {
+		*out++ = state->level;
+	}
+	if(more & TELEMETRY_LIVES) {
+		*out++ = state->lives;
+	}
+	if(more & TELEMETRY_MODE) {
+		*out++ = state->mode << 1 | (state->paused ? 1 : 0);
+	}
+
+	batch_length = out - batch;
+	batch_records++;
+	record_number++;
+	records++;
+	pending_events = 0;
+	last = *state;
+	if(need_key) {
+		need_key = 0;
+		since_key = 0;
+	} else if(++since_key >= TELEMETRY_KEY_PERIOD) {
+		need_key = 1;
+	}
+}
+
+void telemetry_sample(const TelemetryState* state) {
+	if(!enabled) {
+		return;
+	}
+	if(batch_records == 0) {
+		batch[0] = record_number;
+		batch_length = 1;
+	}
+	add_record(state);
+	if(batch_records < TELEMETRY_BATCH &&
+			batch_length + TELEMETRY_MAX_RECORD <= FRAME_MAX_PAYLOAD) {
+		return;
+	}
+	if(frame_send(FRAME_TELEMETRY, batch, batch_length)) {
+		frames_sent++;
+		bytes_sent += batch_length;
+	} else {
+		// The receiver can't follow the changes in the next frame
+		frames_lost++;
+		need_key = 1;
+	}
+	batch_records = 0;
+}
+
+uint8_t telemetry_print_stats(uint8_t line) {
+	if(line == 0) {
+		printf_P(PSTR("telemetry %S: %lu records"),
+				enabled ? PSTR("on") : PSTR("off"), records);
+	} else {
+		printf_P(PSTR("  %lu bytes in %u frames, %u dropped"), bytes_sent,
+				frames_sent, frames_lost);
+	}
+	clear_to_end_of_line();
+	return line == 0;
+}
@@ -0,0 +1,111 @@
+/*
+ * telemetry.h
+ *
+ * Author: Xinyi Li
+ *
+ * A machine readable stream of what the game is doing, for balancing the
+ * game and keeping an eye on it. While telemetry is turned on the game
+ * state is sampled every TELEMETRY_PERIOD_MS and a record of what changed
+ * since the last sample is sent in FRAME_TELEMETRY frames (see frame.h).
+ *
+ * A record starts with a header byte with a bit for each field that
+ * changed, followed by the new values of those fields in bit order:
+ *   bit 0  TELEMETRY_FROG       1 byte: frog row << 4 | frog column
+ *   bit 1  TELEMETRY_LANES      3 bytes: traffic lane positions (lanes 0-2)
+ *   bit 2  TELEMETRY_LOGS       2 bytes: log channel positions (channels 0-1)
+ *   bit 3  TELEMETRY_RIVERBANK  2 bytes: riverbank status
+ *   bit 4  TELEMETRY_COUNTDOWN  1 byte: seconds remaining
+ *   bit 5  TELEMETRY_SCORE      4 bytes: score
+ *   bit 6  TELEMETRY_EVENTS     1 byte: TELEMETRY_EVENT_ bits for events
+ *                               since the last record
+ *   bit 7  TELEMETRY_MORE       1 byte: a second header byte follows (before
+ *                               any values) for the rarely changing fields
+ * Second header byte:
+ *   bit 0  TELEMETRY_LEVEL      1 byte: level (from 0)
+ *   bit 1  TELEMETRY_LIVES      1 byte: lives remaining
+ *   bit 2  TELEMETRY_MODE       1 byte: game mode << 1 | paused
+ * Multi-byte values are little endian. A tick where nothing changed is a
+ * single zero byte.
+ *
+ * A frame holds a run of consecutive records: the number of the first
+ * record (modulo 256) and then the records. A frame is sent once it holds
+ * TELEMETRY_BATCH records or has no room for another. A key record (every
+ * field marked as changed) is sent first, every TELEMETRY_KEY_PERIOD
+ * records and after a frame is dropped, so a receiver that starts part
+ * way through or misses a frame (which shows as a gap in the record
+ * numbers) can rebuild the state from the next key record.
+ *
+ * Bandwidth: an idle game costs a 1 byte record per tick plus about 7
+ * bytes of framing per batch - about 85 bytes/s at 50 records/s. While
+ * playing, the lanes, logs and countdown add about 40 bytes/s and moves
+ * 2 bytes each, so a busy game sends 150 to 200 bytes/s: about 10% of
+ * the serial port at 19200 baud and under 2% at 115200 baud. The telemetry
+ * counters (see telemetry_print_stats()) give the actual figures.
+ */
+
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+#include <stdint.h>
+
+#define TELEMETRY_PERIOD_MS 20
+#define TELEMETRY_BATCH 10
+#define TELEMETRY_KEY_PERIOD 250
+
+// Header bits
+#define TELEMETRY_FROG (1 << 0)
+#define TELEMETRY_LANES (1 << 1)
+#define TELEMETRY_LOGS (1 << 2)
+#define TELEMETRY_RIVERBANK (1 << 3)
+#define TELEMETRY_COUNTDOWN (1 << 4)
+#define TELEMETRY_SCORE (1 << 5)
+#define TELEMETRY_EVENTS (1 << 6)
+#define TELEMETRY_MORE (1 << 7)
+// Second header bits
+#define TELEMETRY_LEVEL (1 << 0)
+#define TELEMETRY_LIVES (1 << 1)
+#define TELEMETRY_MODE (1 << 2)
+
+// Events
+#define TELEMETRY_EVENT_MOVE (1 << 0)		// the player moved the frog
+#define TELEMETRY_EVENT_DEATH (1 << 1)
+#define TELEMETRY_EVENT_LEVEL_UP (1 << 2)
+#define TELEMETRY_EVENT_NEW_GAME (1 << 3)	// a new life or game started
+
+// A sample of the game state
+typedef struct {
+	uint8_t frog_row;
+	uint8_t frog_column;
+	uint8_t lanes[3];
+	uint8_t logs[2];
+	uint16_t riverbank;
+	uint8_t countdown;
+	uint32_t score;
+	uint8_t level;
+	uint8_t lives;
+	uint8_t mode;
+	uint8_t paused;
+} TelemetryState;
+
+/* Turn telemetry on or off. It starts with a key record. */
+void telemetry_enable(uint8_t enable);
+uint8_t telemetry_enabled(void);
+
+/* Note that an event happened. It is sent with the next record (or
+ * ignored while telemetry is off).
+ */
+void telemetry_event(uint8_t event);
+
+/* Add a record for the latest sample of the game state, and send the
+ * batch of records if it is full. Called every TELEMETRY_PERIOD_MS while
+ * telemetry is on.
+ */
+void telemetry_sample(const TelemetryState* state);
+
+/* Print (to standard output) one line of the number of records, bytes
+ * and frames sent and dropped, starting from line 0. Returns 1 if there
+ * are more lines to print.
+ */
+uint8_t telemetry_print_stats(uint8_t line);
+
+#endif /* TELEMETRY_H_ */
@@ -6,61 +6,106 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 
 #include <avr/pgmspace.h>
 
 #include "terminalio.h"
+#include "fmt.h"
+#include "serialio.h"
+#include "mirror.h"
+
+// Escape sequences are written with fmt (see fmt.h) rather than printf.
+
+// Longest ESC [ y ; x H sequence
+#define MOVE_CURSOR_LENGTH (4 + 2 * FMT_MAX_DIGITS)
+
+// Put the escape sequence to move the cursor to x, y in buffer and return
+// its length.
+static uint8_t cursor_sequence(char* buffer, int x, int y) {
+	uint8_t length = 0;
+	buffer[length++] = '\x1b';
+	buffer[length++] = '[';
+	length += fmt_signed(buffer + length, y, 0);
+	buffer[length++] = ';';
+	length += fmt_signed(buffer + length, x, 0);
+	buffer[length++] = 'H';
+	return length;
+}
 
 void move_cursor(int x, int y) {
-    printf_P(PSTR("\x1b[%d;%dH"), y, x);
+	char sequence[MOVE_CURSOR_LENGTH];
+	(void)serial_write(sequence, cursor_sequence(sequence, x, y));
+}
+
+void print_at_P(int x, int y, const char* text) {
+	char sequence[MOVE_CURSOR_LENGTH];
+	SerialChunk chunks[2];
+	chunks[0].data = sequence;
+	chunks[0].length = cursor_sequence(sequence, x, y);
+	chunks[0].in_progmem = 0;
+	chunks[1].data = text;
+	chunks[1].length = strlen_P(text);
+	chunks[1].in_progmem = 1;
+	(void)serial_writev(chunks, 2);
 }
 
 void move_left(void) {
-	printf_P(PSTR("\x1b[%dD"), 1);
+	fmt_put_string_P(PSTR("\x1b[1D"));
 }
 
 void normal_display_mode(void) {
-	printf_P(PSTR("\x1b[0m"));
+	fmt_put_string_P(PSTR("\x1b[0m"));
 }
 
 void reverse_video(void) {
-	printf_P(PSTR("\x1b[7m"));
+	fmt_put_string_P(PSTR("\x1b[7m"));
 }
 
+static void clear_status(void);
+
 void clear_terminal(void) {
-	printf_P(PSTR("\x1b[2J"));
+	fmt_put_string_P(PSTR("\x1b[2J"));
+	clear_status();
+	mirror_invalidate();
 }
 
 void clear_to_end_of_line(void) {
-	printf_P(PSTR("\x1b[K"));
+	fmt_put_string_P(PSTR("\x1b[K"));
 }
 
 void set_display_attribute(DisplayParameter parameter) {
-	printf_P(PSTR("\x1b[%dm"), parameter);
+	fmt_put_string_P(PSTR("\x1b["));
+	fmt_put_unsigned(parameter, 0);
+	serial_put_char('m');
 }
 
 void hide_cursor() {
-	printf_P(PSTR("\x1b[?25l"));
+	fmt_put_string_P(PSTR("\x1b[?25l"));
 }
 
 void show_cursor() {
-	printf_P(PSTR("\x1b[?25h"));
+	fmt_put_string_P(PSTR("\x1b[?25h"));
 }
 
 void enable_scrolling_for_whole_display(void) {
-	printf_P(PSTR("\x1b[r"));
+	fmt_put_string_P(PSTR("\x1b[r"));
 }
 
 void set_scroll_region(int8_t y1, int8_t y2) {
-	printf_P(PSTR("\x1b[%d;%dr"), y1, y2);
+	fmt_put_string_P(PSTR("\x1b["));
+	fmt_put_signed(y1, 0);
+	serial_put_char(';');
+	fmt_put_signed(y2, 0);
+	serial_put_char('r');
 }
 
 void scroll_down(void) {
-	printf_P(PSTR("\x1bM"));	// ESC-M
+	fmt_put_string_P(PSTR("\x1bM"));	// ESC-M
 }
 
 void scroll_up(void) {
-	printf_P(PSTR("\x1b\x44"));	// ESC-D
+	fmt_put_string_P(PSTR("\x1b\x44"));	// ESC-D
 }
 
 void draw_horizontal_line(int8_t y, int8_t start_x, int8_t end_x) {
@@ -68,10 +113,7 @@ void draw_horizontal_line(int8_t y, int8_t start_x, int8_t end_x) {
 	move_cursor(start_x, y);
 	reverse_video();
 	for(i=start_x; i <= end_x; i++) {
-		printf(" ");	/* No need to use printf_P - printing 
-						 * a single character gets optimised
-						 * to a putchar call 
-						 */
+		serial_put_char(' ');
 	}
 	normal_display_mode();
 }
@@ -81,10 +123,247 @@ void draw_vertical_line(int8_t x, int8_t start_y, int8_t end_y) {
 	move_cursor(x, start_y);
 	reverse_video();
 	for(i=start_y; i < end_y; i++) {
-		printf(" ");
+		serial_put_char(' ');
 		/* Move down one and back to the left one */
-		printf_P(PSTR("\x1b[B\x1b[D"));
+		fmt_put_string_P(PSTR("\x1b[B\x1b[D"));
 	}
-	printf(" ");
+	serial_put_char(' ');
 	normal_display_mode();
 }
+
+/*
+ * Status display. status holds the lines we want shown and shown holds
+ * what the terminal is showing. Cursor positions below are in status
+ * coordinates (line, column from 0).
+ */
+static char status[STATUS_LINES][STATUS_COLUMNS];
+static char shown[STATUS_LINES][STATUS_COLUMNS];
+static uint32_t status_bytes;
+static uint32_t status_coalesced;
+
+// status_flush() builds its output here and sends it as one write. (The
+// first change is always made so there is room for one change on top of
+// the largest budget.)
+#define STATUS_FLUSH_MAX 64
+static char flush_buffer[STATUS_FLUSH_MAX + 16];
+static uint8_t flush_length;
+
+static void clear_status(void) {
+	memset(status, ' ', sizeof(status));
+	memset(shown, ' ', sizeof(shown));
+}
+
+// Set a status line to text (length characters long) followed by spaces
+static void set_status_line(uint8_t line, char* text, uint8_t length) {
+	if(line >= STATUS_LINES) {
+		return;
+	}
+	memset(text + length, ' ', STATUS_COLUMNS - length);
+	// Count the changes still waiting to be sent that this replaces
+	for(uint8_t column = 0; column < STATUS_COLUMNS; column++) {
+		if(status[line][column] != shown[line][column] &&
+				text[column] != status[line][column]) {
+			status_coalesced++;
+		}
+	}
+	memcpy(status[line], text, STATUS_COLUMNS);
+}
+
+// Copy text from program memory to buffer, up to STATUS_COLUMNS
+// characters. Returns its length.
+static uint8_t copy_text_P(char* buffer, const char* text) {
+	uint8_t length = 0;
+	char c;
+	while(length < STATUS_COLUMNS && (c = pgm_read_byte(text + length)) != '\0') {
+		buffer[length++] = c;
+	}
+	return length;
+}
+
+void status_print_P(uint8_t line, const char* text) {
+	char buffer[STATUS_COLUMNS];
+	set_status_line(line, buffer, copy_text_P(buffer, text));
+}
+
+void status_print_number_P(uint8_t line, const char* text, uint32_t value,
+		uint8_t width) {
+	// (Leave room for the number - it is cut off at the end of the line.)
+	char buffer[STATUS_COLUMNS + FMT_MAX_DIGITS + 1];
+	uint8_t length = copy_text_P(buffer, text);
+	if(width > FMT_MAX_DIGITS) {
+		width = FMT_MAX_DIGITS;
+	}
+	length += fmt_unsigned(buffer + length, value, width);
+	if(length > STATUS_COLUMNS) {
+		length = STATUS_COLUMNS;
+	}
+	set_status_line(line, buffer, length);
+}
+
+uint32_t status_bytes_sent(void) {
+	return status_bytes;
+}
+
+uint32_t status_bytes_coalesced(void) {
+	return status_coalesced;
+}
+
+static void status_putchar(char c) {
+	flush_buffer[flush_length++] = c;
+}
+
+static uint8_t digits(uint8_t n) {
+	return n >= 100 ? 3 : n >= 10 ? 2 : 1;
+}
+
+static void status_put_number(uint8_t n) {
+	if(n >= 100) {
+		status_putchar('0' + n / 100);
+	}
+	if(n >= 10) {
+		status_putchar('0' + n / 10 % 10);
+	}
+	status_putchar('0' + n % 10);
+}
+
+// ESC [ n final - a relative cursor movement
+static void status_put_move(uint8_t n, char final) {
+	status_putchar('\x1b');
+	status_putchar('[');
+	status_put_number(n);
+	status_putchar(final);
+}
+
+/* Bytes needed to move the cursor along a line from column from to
+ * column to. Moving right we can either send the characters in between
+ * again (they are already showing - we only move past characters that
+ * haven't changed) or send ESC [ n C. Moving left we can send backspaces,
+ * ESC [ n D or a carriage return and then move right.
+ */
+static uint8_t column_move_cost(uint8_t from, uint8_t to) {
+	uint8_t n, cost;
+	if(to >= from) {
+		n = to - from;
+		cost = 3 + digits(n);
+		return n < cost ? n : cost;
+	}
+	n = from - to;
+	cost = 3 + digits(n);
+	if(n < cost) {
+		cost = n;
+	}
+	if(1 + column_move_cost(0, to) < cost) {
+		cost = 1 + column_move_cost(0, to);
+	}
+	return cost;
+}
+
+static void column_move(uint8_t line, uint8_t from, uint8_t to) {
+	uint8_t n;
+	if(to >= from) {
+		n = to - from;
+		if(n <= 3 + digits(n)) {
+			while(from < to) {
+				status_putchar(status[line][from++]);
+			}
+		} else {
+			status_put_move(n, 'C');
+		}
+		return;
+	}
+	n = from - to;
+	if(1 + column_move_cost(0, to) < n && 1 + column_move_cost(0, to) < 3 + digits(n)) {
+		status_putchar('\r');
+		column_move(line, 0, to);
+	} else if(n <= 3 + digits(n)) {
+		while(n--) {
+			status_putchar('\b');
+		}
+	} else {
+		status_put_move(n, 'D');
+	}
+}
+
+// Bytes needed to move the cursor anywhere with ESC [ row ; column H
+static uint8_t absolute_move_cost(uint8_t line, uint8_t column) {
+	return 4 + digits(STATUS_TOP_ROW + line) + digits(column + 1);
+}
+
+// Send what status_flush() has built up. If it can't be sent the
+// terminal is no longer known to match shown, so everything is redrawn
+// next time.
+static void send_flush_buffer(void) {
+	if(serial_write(flush_buffer, flush_length)) {
+		status_bytes += flush_length;
+	} else {
+		memset(shown, 0, sizeof(shown));
+	}
+}
+
+uint8_t status_flush(uint8_t max_bytes) {
+	// Where the cursor is - only known once we have moved it
+	uint8_t cursor_known = 0;
+	uint8_t cursor_line = 0, cursor_column = 0;
+
+	if(max_bytes > STATUS_FLUSH_MAX) {
+		max_bytes = STATUS_FLUSH_MAX;
+	}
+	flush_length = 0;
+
+	for(uint8_t line = 0; line < STATUS_LINES; line++) {
+		for(uint8_t column = 0; column < STATUS_COLUMNS; column++) {
+			char c = status[line][column];
+			if(c == shown[line][column]) {
+				continue;
+			}
+			// Work out the cheapest way to get to this character. Moving
+			// between lines is done with ESC [ n B (the status lines
+			// are only updated in order so we never move up).
+			uint8_t cost = absolute_move_cost(line, column);
+			uint8_t relative = 0;
+			if(cursor_known) {
+				uint8_t move = column_move_cost(cursor_column, column);
+				if(line != cursor_line) {
+					move += 3 + digits(line - cursor_line);
+				}
+				if(move <= cost) {
+					cost = move;
+					relative = 1;
+				}
+			}
+			// Leave room to restore the cursor (2 bytes). We always make
+			// at least one change so we make progress.
+			if(cursor_known && flush_length + cost + 1 + 2 > max_bytes) {
+				status_putchar('\x1b');
+				status_putchar('8');
+				send_flush_buffer();
+				return 0;
+			}
+			if(!cursor_known) {
+				// Save the cursor
+				status_putchar('\x1b');
+				status_putchar('7');
+			}
+			if(!relative) {
+				flush_length += cursor_sequence(flush_buffer + flush_length,
+						column + 1, STATUS_TOP_ROW + line);
+			} else {
+				if(line != cursor_line) {
+					status_put_move(line - cursor_line, 'B');
+				}
+				column_move(line, cursor_column, column);
+			}
+			status_putchar(c);
+			shown[line][column] = c;
+			cursor_known = 1;
+			cursor_line = line;
+			cursor_column = column + 1;
+		}
+	}
+	if(cursor_known) {
+		status_putchar('\x1b');
+		status_putchar('8');
+		send_flush_buffer();
+	}
+	return 1;
+}
@@ -55,6 +55,8 @@ typedef enum {
 } DisplayParameter;
 
 void move_cursor(int x, int y);
+// Move the cursor and show text from program memory there (in one write)
+void print_at_P(int x, int y, const char* text);
 void move_left(void);
 void normal_display_mode(void);
 void reverse_video(void);
@@ -87,4 +89,37 @@ void scroll_up(void);
 void draw_horizontal_line(int8_t y, int8_t startx, int8_t endx);
 void draw_vertical_line(int8_t x, int8_t starty, int8_t endy);
 
+/* Status display. The STATUS_LINES lines from row STATUS_TOP_ROW of the
+ * terminal are drawn from a buffer of characters. status_print_P()
+ * changes a line of the buffer without sending anything, and
+ * status_flush() sends just the characters that differ from what the
+ * terminal is showing, using the shortest cursor movements it can. The
+ * cursor is saved and restored around the update so other output isn't
+ * disturbed. clear_terminal() blanks the status lines too.
+ */
+#define STATUS_TOP_ROW 2
+#define STATUS_LINES 3
+#define STATUS_COLUMNS 32
+
+#define STATUS_SCORE 0
+#define STATUS_LEVEL 1
+#define STATUS_LIVES 2
+
+// Set a status line to text from program memory, or to the text followed
+// by a number right aligned in width characters. The line is cut off at
+// STATUS_COLUMNS characters.
+void status_print_P(uint8_t line, const char* text);
+void status_print_number_P(uint8_t line, const char* text, uint32_t value,
+		uint8_t width);
+
+// Send the changes to the status lines, using no more than about
+// max_bytes bytes (at least one change is always sent). Returns 1 if the
+// terminal is now up to date, 0 if there are more changes to send.
+uint8_t status_flush(uint8_t max_bytes);
+
+// Number of bytes status_flush() has sent, and the number of changed
+// characters that were replaced by a newer change before being sent
+uint32_t status_bytes_sent(void);
+uint32_t status_bytes_coalesced(void);
+
 #endif /* TERMINAL_IO_H */
\ No newline at end of file
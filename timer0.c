@@ -12,16 +12,41 @@
 #include <avr/interrupt.h>
 
 #include "timer0.h"
+#include "buttons.h"
 
 /* Our internal clock tick count - incremented every 
  * millisecond. Will overflow every ~49 days. */
 static volatile uint32_t clockTicks;
 
+/* Tick loss and latency measurement. match_reference is the timer 2 time
+ * of the last compare match we serviced (in 1/256ths of a timer 2 count).
+ * The timer 0 counter values are kept as counts and converted to us when
+ * read.
+ */
+static uint16_t match_reference;
+static uint8_t reference_valid;
+static volatile uint32_t lost_ticks;
+static volatile uint8_t max_latency;
+static volatile uint16_t max_critical_section;
+static uint32_t critical_section_start;
+
+/* Timing wheel for the software timers. Level L has 16 slots each
+ * covering 16^L milliseconds, so level 0 holds timers due in the next
+ * 16ms, level 1 those due in the next 256ms and so on. wheel_time is
+ * the tick the wheel has been advanced to.
+ */
+#define WHEEL_BITS 4
+#define WHEEL_SLOTS (1<<WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS-1)
+#define WHEEL_LEVELS 4
+static SoftTimer* wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+static uint32_t wheel_time;
+
 /* Set up timer 0 to generate an interrupt every 1ms. 
- * We will divide the clock by 64 and count up to 124.
- * We will therefore get an interrupt every 64 x 125
- * clock cycles, i.e. every 1 milliseconds with an 8MHz
- * clock. 
+ * We will divide the clock by TIMER0_PRESCALER and count up to
+ * TIMER0_COUNTS_PER_TICK-1 (see clock.h). With an 8MHz clock
+ * we divide by 64 and count up to 124, so we get an interrupt
+ * every 64 x 125 clock cycles, i.e. every 1 millisecond.
  * The counter will be reset to 0 when it reaches it's
  * output compare value.
  */
@@ -30,19 +55,24 @@ void init_timer0(void) {
 	 * constant. 
 	 */
 	clockTicks = 0L;
+	wheel_time = 0L;
 	
 	/* Clear the timer */
 	TCNT0 = 0;
 
-	/* Set the output compare value to be 124 */
-	OCR0A = 124;
+	/* Set the output compare value */
+	OCR0A = TIMER0_COUNTS_PER_TICK - 1;
 	
 	/* Set the timer to clear on compare match (CTC mode)
-	 * and to divide the clock by 64. This starts the timer
-	 * running.
+	 * and to divide the clock by the prescaler. This starts
+	 * the timer running.
 	 */
 	TCCR0A = (1<<WGM01);
+#if TIMER0_PRESCALER == 64
 	TCCR0B = (1<<CS01)|(1<<CS00);
+#else
+	TCCR0B = (1<<CS02);
+#endif
 
 	/* Enable an interrupt on output compare match. 
 	 * Note that interrupts have to be enabled globally
@@ -54,27 +84,251 @@ void init_timer0(void) {
 	 * 1 to it.
 	 */
 	TIFR0 &= (1<<OCF0A);
+	
+	/* Set timer 2 running freely (normal mode) dividing the clock
+	 * by 1024. It is our reference for detecting lost ticks. The
+	 * first tick interrupt just takes a reference time.
+	 */
+	TCCR2A = 0;
+	TCCR2B = (1<<CS22)|(1<<CS21)|(1<<CS20);
+	reference_valid = 0;
+	reset_tick_stats();
 }
 
-uint32_t get_current_time(void) {
-	uint32_t returnValue;
+void get_tick_stats(TickStats* stats) {
+	uint8_t interrupts_were_enabled = begin_critical_section();
+	stats->lost_ticks = lost_ticks;
+	stats->max_latency = ((uint32_t)max_latency * TIMER0_US_PER_COUNT_Q8) >> 8;
+	stats->max_critical_section = ((uint32_t)max_critical_section * TIMER0_US_PER_COUNT_Q8) >> 8;
+	end_critical_section(interrupts_were_enabled);
+}
 
-	/* Disable interrupts so we can be sure that the interrupt
-	 * doesn't fire when we've copied just a couple of bytes
-	 * of the value. Interrupts are re-enabled if they were
-	 * enabled at the start.
-	 */
-	uint8_t interruptsOn = bit_is_set(SREG, SREG_I);
+void reset_tick_stats(void) {
+	uint8_t interrupts_were_enabled = begin_critical_section();
+	lost_ticks = 0;
+	max_latency = 0;
+	max_critical_section = 0;
+	end_critical_section(interrupts_were_enabled);
+}
+
+uint8_t begin_critical_section(void) {
+	uint8_t interrupts_were_enabled = bit_is_set(SREG, SREG_I);
 	cli();
-	returnValue = clockTicks;
-	if(interruptsOn) {
+	if(interrupts_were_enabled) {
+		critical_section_start = get_clock_counts();
+	}
+	return interrupts_were_enabled;
+}
+
+void end_critical_section(uint8_t interrupts_were_enabled) {
+	/* Only the outermost critical section (the one that turned
+	 * interrupts off) is timed.
+	 */
+	if(interrupts_were_enabled) {
+		uint32_t length = get_clock_counts() - critical_section_start;
+		if(length > max_critical_section) {
+			max_critical_section = length;
+		}
 		sei();
 	}
+}
+
+uint32_t get_current_time(void) {
+	uint32_t returnValue;
+
+	/* We don't disable interrupts to read the 4 bytes of the tick
+	 * count. Instead we read it until we get the same value twice in a
+	 * row - if the interrupt fires part way through a read the two
+	 * values will differ and we try again. (The interrupt can't fire
+	 * twice in the time it takes to read the value twice so this
+	 * terminates quickly. If interrupts are off, e.g. we're called from
+	 * an interrupt handler, the value can't change at all.)
+	 */
+	do {
+		returnValue = clockTicks;
+	} while(returnValue != clockTicks);
 	return returnValue;
 }
 
+/* Read the tick count and the timer 0 counter consistently. As for
+ * get_current_time() we retry if the interrupt fires while we're
+ * reading. If the compare match has already happened but the interrupt
+ * hasn't been serviced yet (e.g. we've been called with interrupts off)
+ * then the tick count is one behind the counter so we add the missing
+ * tick and re-read the counter (it may have been read just before it
+ * was cleared).
+ */
+static uint8_t read_clock(uint32_t* ticks) {
+	uint8_t counts, pending;
+	do {
+		*ticks = clockTicks;
+		counts = TCNT0;
+		pending = bit_is_set(TIFR0, OCF0A);
+		if(pending) {
+			counts = TCNT0;
+		}
+	} while(*ticks != clockTicks);
+	if(pending) {
+		(*ticks)++;
+	}
+	return counts;
+}
+
+uint32_t get_clock_counts(void) {
+	uint32_t ticks;
+	uint8_t counts = read_clock(&ticks);
+	return ticks * TIMER0_COUNTS_PER_TICK + counts;
+}
+
+uint32_t get_current_time_us(void) {
+	uint32_t ticks;
+	uint8_t counts = read_clock(&ticks);
+	return ticks * 1000 + (((uint32_t)counts * TIMER0_US_PER_COUNT_Q8) >> 8);
+}
+
+// Put a timer into the wheel slot for its expiry time.
+static void wheel_insert(SoftTimer* timer) {
+	uint32_t delta = timer->expires - wheel_time;
+	uint8_t level;
+	if(delta < (1UL<<WHEEL_BITS)) {
+		level = 0;
+	} else if(delta < (1UL<<(2*WHEEL_BITS))) {
+		level = 1;
+	} else if(delta < (1UL<<(3*WHEEL_BITS))) {
+		level = 2;
+	} else {
+		level = 3;
+	}
+	SoftTimer** slot = &wheel[level][(timer->expires >> (level*WHEEL_BITS)) & WHEEL_MASK];
+	timer->next = *slot;
+	if(timer->next) {
+		timer->next->pprev = &timer->next;
+	}
+	timer->pprev = slot;
+	*slot = timer;
+}
+
+static void wheel_remove(SoftTimer* timer) {
+	*timer->pprev = timer->next;
+	if(timer->next) {
+		timer->next->pprev = timer->pprev;
+	}
+	timer->pprev = 0;
+}
+
+// Move all the timers in the given slot down to lower levels of the wheel.
+static void wheel_cascade(uint8_t level, uint8_t index) {
+	SoftTimer* timer = wheel[level][index];
+	wheel[level][index] = 0;
+	while(timer) {
+		SoftTimer* next = timer->next;
+		wheel_insert(timer);
+		timer = next;
+	}
+}
+
+void soft_timer_arm(SoftTimer* timer, uint16_t delay_ms, uint16_t period_ms,
+		SoftTimerCallback callback) {
+	timer->period = period_ms;
+	timer->callback = callback;
+	soft_timer_rearm(timer, delay_ms);
+}
+
+void soft_timer_rearm(SoftTimer* timer, uint16_t delay_ms) {
+	if(timer->pprev) {
+		wheel_remove(timer);
+	}
+	if(delay_ms == 0) {
+		delay_ms = 1;
+	}
+	timer->expired = 0;
+	timer->expires = get_current_time() + delay_ms;
+	wheel_insert(timer);
+}
+
+void soft_timer_cancel(SoftTimer* timer) {
+	if(timer->pprev) {
+		wheel_remove(timer);
+	}
+	timer->expired = 0;
+}
+
+uint8_t soft_timer_armed(SoftTimer* timer) {
+	return timer->pprev != 0;
+}
+
+void run_soft_timers(void) {
+	uint32_t now = get_current_time();
+	while(wheel_time != now) {
+		wheel_time++;
+		
+		// Every 16 ticks bring the next slot of timers down from the
+		// level above (and so on up the wheel)
+		if((wheel_time & WHEEL_MASK) == 0) {
+			if(((wheel_time >> WHEEL_BITS) & WHEEL_MASK) == 0) {
+				if(((wheel_time >> (2*WHEEL_BITS)) & WHEEL_MASK) == 0) {
+					wheel_cascade(3, (wheel_time >> (3*WHEEL_BITS)) & WHEEL_MASK);
+				}
+				wheel_cascade(2, (wheel_time >> (2*WHEEL_BITS)) & WHEEL_MASK);
+			}
+			wheel_cascade(1, (wheel_time >> WHEEL_BITS) & WHEEL_MASK);
+		}
+		
+		// Every timer in the current level 0 slot has expired. We take
+		// them off the list one at a time since a callback may cancel
+		// or rearm other timers.
+		SoftTimer** slot = &wheel[0][wheel_time & WHEEL_MASK];
+		SoftTimer* timer;
+		while((timer = *slot) != 0) {
+			wheel_remove(timer);
+			if(timer->expires != wheel_time) {
+				// Timer is on a later revolution of the wheel (it was
+				// armed while the wheel was a long way behind)
+				wheel_insert(timer);
+				continue;
+			}
+			timer->expired = 1;
+			if(timer->period) {
+				timer->expires += timer->period;
+				wheel_insert(timer);
+			}
+			if(timer->callback) {
+				timer->callback(timer);
+			}
+		}
+	}
+}
+
 ISR(TIMER0_COMPA_vect) {
+	/* The counter has kept counting since the compare match, so its
+	 * value is how late this interrupt is. From this and timer 2 we
+	 * work out the (timer 2) time of the compare match. 
+	 */
+	uint8_t latency = TCNT0;
+	uint16_t reference = ((uint16_t)TCNT2 << 8) - latency * (uint16_t)TIMER0_COUNT_Q8;
+	if(latency > max_latency) {
+		max_latency = latency;
+	}
+
+	/* Consecutive compare matches should be one tick apart. If more than
+	 * one and a half ticks have passed since the last one we serviced
+	 * then we have missed compare matches (the interrupt was held off
+	 * for more than a tick). Count them and add them to the clock.
+	 */
+	uint16_t elapsed = reference - match_reference;
+	match_reference = reference;
+	if(reference_valid) {
+		while(elapsed > TIMER0_TICK_Q8 + TIMER0_TICK_Q8 / 2) {
+			elapsed -= TIMER0_TICK_Q8;
+			clockTicks++;
+			lost_ticks++;
+		}
+	}
+	reference_valid = 1;
+
 	/* Increment our clock tick count */
 	clockTicks++;
 	cc = !cc;
+	
+	sample_buttons();
 }
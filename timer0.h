@@ -19,6 +19,7 @@
 #define TIMER0_H_
 
 #include <stdint.h>
+#include "clock.h"
 
 /* Set up our timer to give us an interrupt every millisecond
  * and update our time reference.
@@ -26,10 +27,106 @@
 void init_timer0(void);
 
 /* Return the current clock tick value - milliseconds since the timer was
- * initialised.
+ * initialised. This doesn't disable interrupts so it can be called freely,
+ * including from interrupt handlers.
  */
 uint32_t get_current_time(void);
 
+/* Timer 0 counts once every TIMER0_CYCLES_PER_COUNT clock cycles and
+ * wraps (generating our tick) every TIMER0_COUNTS_PER_TICK counts.
+ * (TIMER0_COUNTS_PER_TICK is defined in clock.h.)
+ */
+#define TIMER0_CYCLES_PER_COUNT TIMER0_PRESCALER
+
+/* Return the time since the timer was initialised measured in timer 0
+ * counts (8 microseconds each at 8MHz). This has a much finer resolution than
+ * get_current_time() and is intended for profiling. It wraps after
+ * about 9.5 hours.
+ */
+uint32_t get_clock_counts(void);
+
+/* Return a timestamp in microseconds (with a resolution of one timer 0
+ * count) since the timer was initialised. Wraps after about 71 minutes
+ * so should only be used to measure intervals. Like get_current_time()
+ * these never disable interrupts and may be called from interrupt
+ * handlers.
+ */
+uint32_t get_current_time_us(void);
+
+/* Tick statistics. A tick is lost if its interrupt is held off for so long
+ * that the next compare match happens first (interrupts off for more than
+ * a millisecond). Lost ticks are detected by comparing with timer 2 and
+ * added back to the clock. latency is how long after the compare match
+ * the tick interrupt ran. critical_section is the longest time interrupts
+ * were turned off by begin_critical_section()/end_critical_section().
+ * Times are in microseconds.
+ */
+typedef struct {
+	uint32_t lost_ticks;
+	uint16_t max_latency;
+	uint16_t max_critical_section;
+} TickStats;
+
+void get_tick_stats(TickStats* stats);
+void reset_tick_stats(void);
+
+/* Turn interrupts off for a short critical section. The return value
+ * must be passed to end_critical_section() which turns interrupts back
+ * on if they were on before. The length of the longest critical section
+ * is recorded.
+ */
+uint8_t begin_critical_section(void);
+void end_critical_section(uint8_t interrupts_were_enabled);
+
+/* Software timers. A timer calls its callback (or, if the callback is
+ * NULL, just sets its expired flag) when it expires. Periodic timers are
+ * automatically rearmed. Timers are kept in a hierarchical timing wheel
+ * (4 levels of 16 slots) so arming, cancelling and expiring a timer
+ * take a constant time no matter how many timers are armed.
+ * The wheel is only ever touched from the main program - the timer
+ * interrupt just counts ticks - so these functions must not be called
+ * from an interrupt handler. Callbacks are run by run_soft_timers(),
+ * which must be called regularly (at least every few milliseconds).
+ * The SoftTimer structures are owned by the caller and must stay in
+ * existence while the timer is armed (i.e. they should be static).
+ */
+typedef struct SoftTimer SoftTimer;
+typedef void (*SoftTimerCallback)(SoftTimer* timer);
+
+struct SoftTimer {
+	SoftTimer* next;		// wheel slot list links
+	SoftTimer** pprev;		// NULL if the timer isn't armed
+	uint32_t expires;		// clock tick at which the timer expires
+	uint16_t period;		// ms, 0 for a one-shot timer
+	SoftTimerCallback callback;
+	uint8_t expired;		// set each time the timer expires
+};
+
+/* Arm a timer to expire delay_ms from now (at least 1ms) and then
+ * every period_ms after that (if period_ms is not 0). If the timer is
+ * already armed it is rearmed. The expired flag is cleared.
+ */
+void soft_timer_arm(SoftTimer* timer, uint16_t delay_ms, uint16_t period_ms,
+		SoftTimerCallback callback);
+
+/* Rearm an (armed or expired) timer to expire delay_ms from now, keeping
+ * its period and callback.
+ */
+void soft_timer_rearm(SoftTimer* timer, uint16_t delay_ms);
+
+/* Stop a timer and clear its expired flag. It is safe to cancel a timer
+ * that isn't armed.
+ */
+void soft_timer_cancel(SoftTimer* timer);
+
+/* Return non-zero if the timer is armed. */
+uint8_t soft_timer_armed(SoftTimer* timer);
+
+/* Advance the timing wheel to the current time and run the callbacks of
+ * any timers that have expired.
+ */
+void run_soft_timers(void);
+
 volatile int cc;
 
 #endif
\ No newline at end of file
@@ -0,0 +1,311 @@
+"""
+framelink.py
+
+Author: Xinyi Li
+
+Host side of the binary frames the board sends and receives alongside
+the terminal text (see frame.h): COBS encoding, the CRC, splitting what
+the board sends into text and frames, and a small client for the frame
+channels.
+
+    from framelink import Link
+    with Link.open("/dev/ttyUSB0") as link:
+        print(link.request_state())
+
+Only the Python standard library is used. Serial ports are opened with
+termios, so this runs on Linux and macOS.
+"""
+
+import collections
+import os
+import select
+import struct
+import termios
+import time
+import tty
+
+# Channels (frame.h)
+FRAME_INPUT = 1
+FRAME_STATE = 2
+FRAME_STATS = 3
+FRAME_BULK = 4
+FRAME_TELEMETRY = 5
+FRAME_MAX_PAYLOAD = 64
+
+# Input sources and serial key codes (input.h) and button events
+# (buttons.h)
+INPUT_BUTTON = 0
+INPUT_SERIAL = 1
+INPUT_JOYSTICK = 2
+KEY_UP = 0x80
+KEY_DOWN = 0x81
+KEY_RIGHT = 0x82
+KEY_LEFT = 0x83
+BUTTON_PRESS = 0x00
+BUTTON_RELEASE = 0x10
+
+# FrameState and FrameStats (frame.h), little endian and packed
+State = collections.namedtuple(
+    "State", "mode level lives paused frog_row frog_column frog_dead score")
+STATE_FORMAT = "<7BI"
+Stats = collections.namedtuple(
+    "Stats", "cpu_busy input_dropped serial_sent serial_dropped "
+    "frames_received frame_errors frames_dropped")
+STATS_FORMAT = "<BHIHHHH"
+
+BAUD_RATES = {
+    9600: termios.B9600, 19200: termios.B19200, 38400: termios.B38400,
+    57600: termios.B57600, 115200: termios.B115200,
+}
+for _rate in (230400, 250000, 460800, 500000, 1000000):
+    if hasattr(termios, "B%d" % _rate):
+        BAUD_RATES[_rate] = getattr(termios, "B%d" % _rate)
+
+
+def crc_ccitt(data, crc=0xFFFF):
+    """CRC-16 as avr-libc's _crc_ccitt_update() (reflected 0x8408)."""
+    for byte in data:
+        byte ^= crc & 0xFF
+        byte = (byte ^ (byte << 4)) & 0xFF
+        crc = ((byte << 8) | (crc >> 8)) ^ (byte >> 4) ^ (byte << 3)
+        crc &= 0xFFFF
+    return crc
+
+
+def cobs_encode(data):
+    out = bytearray([0])
+    code = 0
+    for byte in data:
+        if byte == 0:
+            out[code] = len(out) - code
+            code = len(out)
+            out.append(0)
+        else:
+            out.append(byte)
+            if len(out) - code == 0xFF:
+                out[code] = 0xFF
+                code = len(out)
+                out.append(0)
+    out[code] = len(out) - code
+    return bytes(out)
+
+
+def cobs_decode(data):
+    """Decode a COBS block. Raises ValueError if it is badly formed."""
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data):
+            raise ValueError("bad COBS code")
+        out += data[i + 1:i + code]
+        i += code
+        if code != 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def encode_frame(channel, payload=b""):
+    """A frame as it is sent: between zeros, COBS encoded, with the CRC."""
+    if len(payload) > FRAME_MAX_PAYLOAD:
+        raise ValueError("payload too long")
+    data = bytes([channel]) + bytes(payload)
+    data += struct.pack("<H", crc_ccitt(data))
+    return b"\0" + cobs_encode(data) + b"\0"
+
+
+class Decoder:
+    """Splits what the board sends into text and frames, as frame.c does.
+
+    feed() returns a list of events: ("text", bytes), ("frame", channel,
+    payload) or ("error", encoded bytes) for a frame that failed its CRC
+    or was badly formed. Frame lengths are not limited, so a stray zero in
+    the text costs the text up to the next zero.
+    """
+
+    def __init__(self):
+        self.in_frame = False
+        self.encoded = bytearray()
+        self.frames = 0
+        self.errors = 0
+
+    def feed(self, data):
+        events = []
+        text = bytearray()
+        for byte in data:
+            if not self.in_frame:
+                if byte == 0:
+                    self.in_frame = True
+                    self.encoded = bytearray()
+                else:
+                    text.append(byte)
+                continue
+            if byte != 0:
+                self.encoded.append(byte)
+                continue
+            # A zero straight after the one that started the frame starts
+            # the frame instead
+            if not self.encoded:
+                continue
+            if text:
+                events.append(("text", bytes(text)))
+                text = bytearray()
+            events.append(self._end_frame(bytes(self.encoded)))
+            self.in_frame = False
+        if text:
+            events.append(("text", bytes(text)))
+        return events
+
+    def _end_frame(self, encoded):
+        try:
+            data = cobs_decode(encoded)
+        except ValueError:
+            data = b""
+        if len(data) < 3 or crc_ccitt(data[:-2]) != \
+                struct.unpack("<H", data[-2:])[0]:
+            self.errors += 1
+            return ("error", encoded)
+        self.frames += 1
+        return ("frame", data[0], data[1:-2])
+
+
+class Timeout(Exception):
+    pass
+
+
+class Link:
+    """A serial connection to the board (or the simulated board)."""
+
+    def __init__(self, fd):
+        self.fd = fd
+        self.decoder = Decoder()
+        self.events = collections.deque()
+        self.text = bytearray()
+        self.bytes_received = 0
+
+    @classmethod
+    def open(cls, path, baud=19200):
+        fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+        try:
+            tty.setraw(fd)
+            settings = termios.tcgetattr(fd)
+            if baud in BAUD_RATES:
+                settings[4] = settings[5] = BAUD_RATES[baud]
+            settings[2] |= termios.CLOCAL | termios.CREAD
+            termios.tcsetattr(fd, termios.TCSANOW, settings)
+            termios.tcflush(fd, termios.TCIOFLUSH)
+        except termios.error:
+            os.close(fd)
+            raise
+        return cls(fd)
+
+    def set_baud(self, baud):
+        """Change the port's rate (after the board has been told to)."""
+        settings = termios.tcgetattr(self.fd)
+        settings[4] = settings[5] = BAUD_RATES[baud]
+        termios.tcsetattr(self.fd, termios.TCSADRAIN, settings)
+
+    def close(self):
+        if self.fd is not None:
+            os.close(self.fd)
+            self.fd = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exception):
+        self.close()
+
+    # Sending
+
+    def write(self, data):
+        data = bytes(data)
+        while data:
+            select.select([], [self.fd], [])
+            data = data[os.write(self.fd, data):]
+
+    def send_frame(self, channel, payload=b""):
+        self.write(encode_frame(channel, payload))
+
+    def send_input(self, *events):
+        """Add (source, code) input events to the board's input queue."""
+        self.send_frame(FRAME_INPUT, bytes(b for e in events for b in e))
+
+    def press_button(self, button):
+        self.send_input((INPUT_BUTTON, button | BUTTON_PRESS),
+                        (INPUT_BUTTON, button | BUTTON_RELEASE))
+
+    def send_keys(self, keys):
+        """Press keys as if they were typed (serial input events)."""
+        if isinstance(keys, str):
+            keys = keys.encode()
+        self.send_input(*((INPUT_SERIAL, k) for k in keys))
+
+    # Receiving
+
+    def poll(self, timeout=0.0):
+        """Read whatever has arrived (waiting up to timeout seconds for
+        something) and queue the frames. Text is added to self.text."""
+        ready, _, _ = select.select([self.fd], [], [], timeout)
+        if not ready:
+            return False
+        try:
+            data = os.read(self.fd, 4096)
+        except BlockingIOError:
+            return False
+        self.bytes_received += len(data)
+        for event in self.decoder.feed(data):
+            if event[0] == "text":
+                self.text += event[1]
+            elif event[0] == "frame":
+                self.events.append(event[1:])
+        return True
+
+    def next_frame(self, channel=None, timeout=1.0):
+        """The next frame (on channel, if given, discarding the frames on
+        other channels) as (channel, payload). Raises Timeout."""
+        end = time.monotonic() + timeout
+        while True:
+            while self.events:
+                frame = self.events.popleft()
+                if channel is None or frame[0] == channel:
+                    return frame
+            remaining = end - time.monotonic()
+            if remaining <= 0:
+                raise Timeout("no frame on channel %s" % channel)
+            self.poll(remaining)
+
+    def drain(self, quiet=0.05):
+        """Read until nothing arrives for quiet seconds."""
+        while self.poll(quiet):
+            pass
+
+    def wait_for_text(self, text, timeout=2.0, start=0):
+        """Wait for text to arrive (after self.text[start])."""
+        if isinstance(text, str):
+            text = text.encode()
+        end = time.monotonic() + timeout
+        while self.text.find(text, start) < 0:
+            remaining = end - time.monotonic()
+            if remaining <= 0:
+                raise Timeout("no %r in the output" % text)
+            self.poll(remaining)
+
+    def request(self, channel, payload=b"", timeout=1.0, retries=3):
+        """Send a frame and wait for the answer on the same channel,
+        resending it if none comes (the board may have been too busy)."""
+        for attempt in range(retries):
+            self.send_frame(channel, payload)
+            try:
+                return self.next_frame(channel, timeout)[1]
+            except Timeout:
+                if attempt == retries - 1:
+                    raise
+
+    def request_state(self, timeout=1.0):
+        return State(*struct.unpack(STATE_FORMAT,
+                                    self.request(FRAME_STATE, b"", timeout)))
+
+    def request_stats(self, timeout=1.0):
+        return Stats(*struct.unpack(STATS_FORMAT,
+                                    self.request(FRAME_STATS, b"", timeout)))
@@ -0,0 +1,37 @@
+/*
+ * compat.h
+ *
+ * Author: Xinyi Li
+ *
+ * Included before every firmware source file when building for the PC.
+ * The host C library's stdio is included first and then the avr-libc
+ * stdio extensions the firmware uses are mapped on to the simulated
+ * board (see host.h).
+ */
+
+#ifndef COMPAT_H_
+#define COMPAT_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "host.h"
+
+#undef FILE
+#define FILE HostFile
+#undef stdout
+#define stdout host_stdout
+#undef stdin
+#define stdin host_stdin
+#undef putchar
+#define putchar host_putchar
+#define printf host_printf
+
+#define FDEV_SETUP_STREAM(put, get, flags) { (put), (get) }
+#define _FDEV_SETUP_READ 1
+#define _FDEV_SETUP_WRITE 2
+#define _FDEV_SETUP_RW 3
+
+#endif /* COMPAT_H_ */
@@ -0,0 +1,50 @@
+/*
+ * host.h
+ *
+ * Author: Xinyi Li
+ *
+ * What the simulated board (sim.c) provides to the firmware when it is
+ * built to run on a PC (see the Makefile). The firmware sees these through
+ * the headers in include/ and compat.h; sim.c uses them directly.
+ */
+
+#ifndef HOST_H_
+#define HOST_H_
+
+#include <stdint.h>
+
+/* The stand in for an avr-libc stdio stream. Only the put and get
+ * functions are used.
+ */
+typedef struct HostFile {
+	int (*put)(char, struct HostFile*);
+	int (*get)(struct HostFile*);
+} HostFile;
+
+extern HostFile* host_stdout;
+extern HostFile* host_stdin;
+
+int host_printf(const char* format, ...);
+int host_putchar(int c);
+
+/* Interrupts. SREG bit 7 is the global interrupt enable, as on the AVR.
+ * Interrupts that happen while it is clear are held until host_sei().
+ */
+extern volatile uint8_t SREG;
+void host_sei(void);
+void host_cli(void);
+void host_sleep_cpu(void);
+void host_delay_us(double us);
+
+/* Registers whose value comes from the simulation when they are read */
+volatile uint8_t* host_tcnt0(void);
+volatile uint8_t* host_tcnt2(void);
+volatile uint8_t* host_tifr0(void);
+volatile uint8_t* host_spsr0(void);
+
+/* EEPROM (1KB, kept in a file) */
+uint8_t host_eeprom_read(uintptr_t address);
+void host_eeprom_write(uintptr_t address, uint8_t value);
+int host_eeprom_is_ready(void);
+
+#endif /* HOST_H_ */
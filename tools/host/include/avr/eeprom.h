@@ -0,0 +1,69 @@
+/*
+ * eeprom.h
+ *
+ * Author: Xinyi Li
+ *
+ * The avr-libc EEPROM functions for the host build, on top of the
+ * simulated EEPROM (see sim.c). As on the AVR, they wait for any write
+ * in progress before they start and a write takes 3.4ms.
+ */
+
+#ifndef HOST_AVR_EEPROM_H_
+#define HOST_AVR_EEPROM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "host.h"
+
+#define EEMEM
+
+#define eeprom_is_ready() host_eeprom_is_ready()
+#define eeprom_busy_wait() do { } while(!eeprom_is_ready())
+
+static inline uint8_t eeprom_read_byte(const uint8_t* address) {
+	return host_eeprom_read((uintptr_t)address);
+}
+
+static inline void eeprom_read_block(void* destination, const void* source,
+		size_t length) {
+	for(size_t i = 0; i < length; i++) {
+		((uint8_t*)destination)[i] = host_eeprom_read((uintptr_t)source + i);
+	}
+}
+
+static inline uint16_t eeprom_read_word(const uint16_t* address) {
+	uint16_t value;
+	eeprom_read_block(&value, address, sizeof(value));
+	return value;
+}
+
+static inline uint32_t eeprom_read_dword(const uint32_t* address) {
+	uint32_t value;
+	eeprom_read_block(&value, address, sizeof(value));
+	return value;
+}
+
+static inline void eeprom_update_byte(uint8_t* address, uint8_t value) {
+	host_eeprom_write((uintptr_t)address, value);
+}
+
+static inline void eeprom_write_byte(uint8_t* address, uint8_t value) {
+	host_eeprom_write((uintptr_t)address, value);
+}
+
+static inline void eeprom_update_block(const void* source, void* destination,
+		size_t length) {
+	for(size_t i = 0; i < length; i++) {
+		host_eeprom_write((uintptr_t)destination + i, ((const uint8_t*)source)[i]);
+	}
+}
+
+static inline void eeprom_update_word(uint16_t* address, uint16_t value) {
+	eeprom_update_block(&value, address, sizeof(value));
+}
+
+static inline void eeprom_update_dword(uint32_t* address, uint32_t value) {
+	eeprom_update_block(&value, address, sizeof(value));
+}
+
+#endif /* HOST_AVR_EEPROM_H_ */
@@ -0,0 +1,22 @@
+/*
+ * interrupt.h
+ *
+ * Author: Xinyi Li
+ *
+ * Interrupt handlers for the host build. A handler is an ordinary
+ * function that the simulation (sim.c) calls when the interrupt happens.
+ */
+
+#ifndef HOST_AVR_INTERRUPT_H_
+#define HOST_AVR_INTERRUPT_H_
+
+#include <avr/io.h>
+
+#define ISR_BLOCK
+#define ISR_NOBLOCK
+#define ISR(vector, ...) void vector(void); void vector(void)
+
+#define sei() host_sei()
+#define cli() host_cli()
+
+#endif /* HOST_AVR_INTERRUPT_H_ */
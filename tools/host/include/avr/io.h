@@ -0,0 +1,90 @@
+/*
+ * io.h
+ *
+ * Author: Xinyi Li
+ *
+ * The ATmega324A registers for the host build. Most are plain variables
+ * (defined in sim.c) that the simulation looks at when it needs to; the
+ * ones whose value changes by itself are read through functions. UDR0 is
+ * 16 bits wide so the simulation can tell when it has been written (see
+ * sim.c).
+ */
+
+#ifndef HOST_AVR_IO_H_
+#define HOST_AVR_IO_H_
+
+#include <stdint.h>
+#include "host.h"
+
+#define HOST_REGISTERS(R8, R16) \
+	R8(TCCR0A) R8(TCCR0B) R8(OCR0A) R8(OCR0B) R8(TIMSK0) \
+	R8(TCCR1A) R8(TCCR1B) R16(TCNT1) R16(OCR1A) R16(OCR1B) R8(TIMSK1) R8(TIFR1) \
+	R8(TCCR2A) R8(TCCR2B) R8(OCR2A) R8(TIMSK2) R8(TIFR2) R8(ASSR) \
+	R8(PINA) R8(PINB) R8(PINC) R8(PIND) R8(PORTA) R8(PORTB) R8(PORTC) R8(PORTD) \
+	R8(DDRA) R8(DDRB) R8(DDRC) R8(DDRD) \
+	R8(PCICR) R8(PCIFR) R8(PCMSK0) R8(PCMSK1) R8(PCMSK2) R8(PCMSK3) \
+	R16(UBRR0) R8(UCSR0A) R8(UCSR0B) R8(UCSR0C) R16(UDR0) \
+	R8(ADMUX) R8(ADCSRA) R8(ADCSRB) R16(ADC) R8(DIDR0) \
+	R8(SPCR0) R8(SPDR0) R8(EECR) R8(EEDR) R16(EEAR) R8(PRR0) R8(SMCR) R8(MCUCR)
+
+#define HOST_DECLARE8(name) extern volatile uint8_t name;
+#define HOST_DECLARE16(name) extern volatile uint16_t name;
+HOST_REGISTERS(HOST_DECLARE8, HOST_DECLARE16)
+
+#define TCNT0 (*host_tcnt0())
+#define TCNT2 (*host_tcnt2())
+#define TIFR0 (*host_tifr0())
+#define SPSR0 (*host_spsr0())
+#define ADCW ADC
+#define PRR PRR0
+#define SPCR SPCR0
+#define SPSR SPSR0
+#define SPDR SPDR0
+
+enum {
+	// Timers
+	WGM00 = 0, WGM01 = 1, CS00 = 0, CS01 = 1, CS02 = 2,
+	TOIE0 = 0, OCIE0A = 1, OCIE0B = 2, TOV0 = 0, OCF0A = 1, OCF0B = 2,
+	WGM10 = 0, WGM11 = 1, COM1B0 = 4, COM1B1 = 5, COM1A0 = 6, COM1A1 = 7,
+	CS10 = 0, CS11 = 1, CS12 = 2, WGM12 = 3, WGM13 = 4,
+	TOIE1 = 0, OCIE1A = 1, OCIE1B = 2, TOV1 = 0, OCF1A = 1, OCF1B = 2,
+	WGM20 = 0, WGM21 = 1, CS20 = 0, CS21 = 1, CS22 = 2,
+	// UART
+	MPCM0 = 0, U2X0 = 1, UPE0 = 2, DOR0 = 3, FE0 = 4, UDRE0 = 5, TXC0 = 6,
+	RXC0 = 7, TXEN0 = 3, RXEN0 = 4, UDRIE0 = 5, TXCIE0 = 6, RXCIE0 = 7,
+	UCSZ00 = 1, UCSZ01 = 2,
+	// ADC
+	MUX0 = 0, MUX1 = 1, MUX2 = 2, MUX3 = 3, MUX4 = 4, ADLAR = 5,
+	REFS0 = 6, REFS1 = 7,
+	ADPS0 = 0, ADPS1 = 1, ADPS2 = 2, ADIE = 3, ADIF = 4, ADATE = 5,
+	ADSC = 6, ADEN = 7, ADTS0 = 0, ADTS1 = 1, ADTS2 = 2,
+	ADC0D = 0, ADC1D = 1, ADC2D = 2, ADC3D = 3, ADC4D = 4, ADC5D = 5,
+	ADC6D = 6, ADC7D = 7,
+	// SPI
+	SPR00 = 0, SPR10 = 1, CPHA0 = 2, CPOL0 = 3, MSTR0 = 4, DORD0 = 5,
+	SPE0 = 6, SPIE0 = 7, SPI2X0 = 0, WCOL0 = 6, SPIF0 = 7,
+	SPR0 = 0, SPR1 = 1, MSTR = 4, SPE = 6, SPI2X = 0, SPIF = 7,
+	// EEPROM
+	EERE = 0, EEPE = 1, EEMPE = 2, EERIE = 3,
+	// Pin change interrupts (only the pins the board uses)
+	PCIE0 = 0, PCIE1 = 1, PCIE2 = 2, PCIE3 = 3,
+	PCIF0 = 0, PCIF1 = 1, PCIF2 = 2, PCIF3 = 3,
+	PCINT8 = 0, PCINT9 = 1, PCINT10 = 2, PCINT11 = 3,
+	PCINT27 = 3, PCINT29 = 5,
+	// Port pins (only the ones the board uses)
+	PINB0 = 0, PINB1 = 1, PINB2 = 2, PINB3 = 3,
+	PINC5 = 5, PINC6 = 6, PORTC7 = 7, PIND3 = 3, PIND5 = 5,
+	PORTD2 = 2, PORTD4 = 4, DDRD2 = 2, DDRD4 = 4,
+	// Power and sleep
+	PRADC = 0, PRUSART0 = 1, PRSPI = 2, PRTIM1 = 3, PRUSART1 = 4,
+	PRTIM0 = 5, PRTIM2 = 6, PRTWI = 7, SE = 0, SM0 = 1, SM1 = 2, SM2 = 3,
+	SREG_I = 7
+};
+
+#define _BV(bit) (1 << (bit))
+#define bit_is_set(sfr, bit) ((sfr) & _BV(bit))
+#define bit_is_clear(sfr, bit) (!((sfr) & _BV(bit)))
+#define loop_until_bit_is_set(sfr, bit) do { } while(bit_is_clear(sfr, bit))
+#define loop_until_bit_is_clear(sfr, bit) do { } while(bit_is_set(sfr, bit))
+
+#endif /* HOST_AVR_IO_H_ */
@@ -0,0 +1,33 @@
+/*
+ * pgmspace.h
+ *
+ * Author: Xinyi Li
+ *
+ * Program memory for the host build - it is just ordinary memory.
+ * pgm_read_word() is also used to read pointers (which are 16 bits on
+ * the AVR), so it reads whatever type the object is.
+ */
+
+#ifndef HOST_AVR_PGMSPACE_H_
+#define HOST_AVR_PGMSPACE_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PGM_P const char*
+#define PSTR(s) (s)
+
+#define pgm_read_byte(address) (*(const uint8_t*)(address))
+#define pgm_read_word(address) ((uintptr_t)*(address))
+#define pgm_read_dword(address) (*(const uint32_t*)(address))
+#define pgm_read_ptr(address) (*(void* const*)(address))
+
+#define printf_P host_printf
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define strlen_P strlen
+#define strcpy_P strcpy
+#define memcpy_P memcpy
+
+#endif /* HOST_AVR_PGMSPACE_H_ */
@@ -0,0 +1,19 @@
+/*
+ * power.h
+ *
+ * Author: Xinyi Li
+ *
+ * Power reduction for the host build - there is nothing to turn off.
+ */
+
+#ifndef HOST_AVR_POWER_H_
+#define HOST_AVR_POWER_H_
+
+#define power_adc_disable() do { } while(0)
+#define power_spi_disable() do { } while(0)
+#define power_twi_disable() do { } while(0)
+#define power_usart1_disable() do { } while(0)
+#define power_timer1_disable() do { } while(0)
+#define power_timer2_disable() do { } while(0)
+
+#endif /* HOST_AVR_POWER_H_ */
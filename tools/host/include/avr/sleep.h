@@ -0,0 +1,20 @@
+/*
+ * sleep.h
+ *
+ * Author: Xinyi Li
+ *
+ * Sleeping for the host build. sleep_cpu() waits for the next interrupt.
+ */
+
+#ifndef HOST_AVR_SLEEP_H_
+#define HOST_AVR_SLEEP_H_
+
+#include "host.h"
+
+#define SLEEP_MODE_IDLE 0
+#define set_sleep_mode(mode) do { } while(0)
+#define sleep_enable() do { } while(0)
+#define sleep_disable() do { } while(0)
+#define sleep_cpu() host_sleep_cpu()
+
+#endif /* HOST_AVR_SLEEP_H_ */
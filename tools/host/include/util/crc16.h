@@ -0,0 +1,30 @@
+/*
+ * crc16.h
+ *
+ * Author: Xinyi Li
+ *
+ * The avr-libc CRC functions for the host build (the same calculations
+ * as the assembly versions in avr-libc).
+ */
+
+#ifndef HOST_UTIL_CRC16_H_
+#define HOST_UTIL_CRC16_H_
+
+#include <stdint.h>
+
+static inline uint16_t _crc16_update(uint16_t crc, uint8_t data) {
+	crc ^= data;
+	for(uint8_t i = 0; i < 8; i++) {
+		crc = crc & 1 ? (crc >> 1) ^ 0xA001 : crc >> 1;
+	}
+	return crc;
+}
+
+static inline uint16_t _crc_ccitt_update(uint16_t crc, uint8_t data) {
+	data ^= crc & 0xFF;
+	data ^= data << 4;
+	return (((uint16_t)data << 8) | (crc >> 8)) ^ (uint8_t)(data >> 4) ^
+			((uint16_t)data << 3);
+}
+
+#endif /* HOST_UTIL_CRC16_H_ */
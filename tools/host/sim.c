@@ -0,0 +1,590 @@
+/*
+ * sim.c
+ *
+ * Author: Xinyi Li
+ *
+ * A simulated board, so the whole program can be run and tested on a PC
+ * (see the Makefile and tools/README.md). The serial port is a
+ * pseudo-terminal: the host end is printed when the board starts (and can
+ * be linked to a fixed path with -l), and anything that talks to the real
+ * board over a USB serial adapter can talk to it.
+ *
+ * Interrupts are a SIGALRM every SIM_POLL_US. The signal handler brings
+ * the simulated hardware up to the current time, one event at a time in
+ * time order - timer 0 compare matches, UART characters finishing being
+ * sent or received, ADC conversions finishing - and calls the interrupt
+ * handlers each event makes due, in the AVR's priority order. While the
+ * program has interrupts turned off (SREG bit 7 clear) the signal is just
+ * noted and handled when they are turned back on. The registers the
+ * handlers read (TCNT0, TCNT2, TIFR0) show the simulated time of the
+ * event being handled, so a handler that runs late on the PC still sees
+ * the hardware as it was when the interrupt happened.
+ *
+ * What is simulated: the timer 0 tick and timer 2 reference, the UART
+ * (paced at the baud rate set in UBRR0 and U2X0, with the transmit
+ * holding and shift registers and the TXC flag), the ADC auto triggered
+ * by the tick (the joystick is always centred), SPI (always finished)
+ * and the EEPROM (1KB, 3.4ms per write, kept in a file with -e). The
+ * buttons are never pressed and there is no sound. Code runs at the PC's
+ * speed, so the task times and CPU use the board reports are the PC's,
+ * not the AVR's.
+ *
+ * The board runs until it is sent SIGINT or SIGTERM. It then prints the
+ * simulation counters (the number of times each interrupt handler ran,
+ * characters sent and received) on standard error. SIGUSR1 prints them
+ * without stopping.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <avr/io.h>
+#include "host.h"
+#include "../../clock.h"
+
+#define SIM_POLL_US 50
+#define EEPROM_SIZE 1024
+#define EEPROM_WRITE_NS 3400000ULL
+#define JOYSTICK_CENTRE 512
+
+// Simulated times are in ns since the board started
+#define NS_PER_S 1000000000ULL
+#define TIMER0_COUNT_NS (TIMER0_PRESCALER * NS_PER_S / F_CPU)
+#define TICK_NS (TIMER0_COUNTS_PER_TICK * TIMER0_COUNT_NS)
+#define TIMER2_COUNT_NS (1024 * NS_PER_S / F_CPU)
+#define NEVER UINT64_MAX
+
+int firmware_main(void);
+void TIMER0_COMPA_vect(void);
+void USART0_RX_vect(void);
+void USART0_UDRE_vect(void);
+void ADC_vect(void);
+
+/* Registers */
+#define HOST_DEFINE8(name) volatile uint8_t name;
+#define HOST_DEFINE16(name) volatile uint16_t name;
+HOST_REGISTERS(HOST_DEFINE8, HOST_DEFINE16)
+volatile uint8_t SREG;
+
+// UDR0 holds one of these (or a character written by the program)
+#define UDR_EMPTY 0x100
+#define UDR_RECEIVED 0x200
+
+/* Interrupt handlers, in priority order, and how often each ran */
+enum { VECTOR_TIMER0, VECTOR_RX, VECTOR_UDRE, VECTOR_ADC, NUM_VECTORS };
+static const char* const vector_names[NUM_VECTORS] = {
+	"TIMER0_COMPA", "USART0_RX", "USART0_UDRE", "ADC"
+};
+static uint64_t vector_calls[NUM_VECTORS];
+static uint64_t vector_ns[NUM_VECTORS];
+
+static uint64_t start_ns;
+static volatile sig_atomic_t servicing;	// in service()
+static volatile sig_atomic_t pending;	// signal while interrupts were off
+static volatile sig_atomic_t quit;
+static volatile sig_atomic_t print;		// SIGUSR1 - print the counters
+static uint64_t sim_ns;					// time of the event being handled
+
+/* Timer 0. timer_match is the number of the last compare match and
+ * timer_serviced the one the interrupt handler last ran for.
+ */
+static uint64_t timer_next = TICK_NS;
+static uint64_t timer_match;
+static uint64_t timer_serviced;
+static uint8_t timer_flag;
+
+/* UART */
+static int pty = -1;
+static uint8_t tx_holding, tx_holding_full;
+static uint8_t tx_shift;
+static uint64_t tx_end = NEVER;		// when the character in the shift register has gone
+static uint8_t tx_complete;
+static uint8_t rx_data, rx_full;
+static uint64_t rx_free;			// when the next character can start arriving
+static uint8_t rx_buffer[256];		// read from the pty but not yet received
+static unsigned rx_start, rx_end;
+static uint8_t out_buffer[4096];	// sent but not yet written to the pty
+static unsigned out_length;
+static uint64_t sent, received, pty_dropped, overruns;
+
+/* ADC */
+static uint64_t adc_end = NEVER;
+static uint8_t adc_flag;
+
+/* EEPROM */
+static uint8_t eeprom[EEPROM_SIZE];
+static int eeprom_file = -1;
+static uint64_t eeprom_ready_ns;
+
+static uint64_t real_ns(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * NS_PER_S + now.tv_nsec - start_ns;
+}
+
+static uint64_t now_ns(void) {
+	return servicing ? sim_ns : real_ns();
+}
+
+/* Registers that change by themselves */
+
+volatile uint8_t* host_tcnt0(void) {
+	static volatile uint8_t tcnt0;
+	tcnt0 = now_ns() % TICK_NS / TIMER0_COUNT_NS;
+	return &tcnt0;
+}
+
+volatile uint8_t* host_tcnt2(void) {
+	static volatile uint8_t tcnt2;
+	tcnt2 = now_ns() / TIMER2_COUNT_NS;
+	return &tcnt2;
+}
+
+volatile uint8_t* host_tifr0(void) {
+	static volatile uint8_t tifr0;
+	tifr0 = now_ns() / TICK_NS > timer_serviced ? (1 << OCF0A) : 0;
+	return &tifr0;
+}
+
+volatile uint8_t* host_spsr0(void) {
+	static volatile uint8_t spsr0;
+	spsr0 = 1 << SPIF0;
+	return &spsr0;
+}
+
+/* UART */
+
+static uint64_t character_ns(void) {
+	uint64_t divisor = UCSR0A & (1 << U2X0) ? 8 : 16;
+	return 10 * divisor * (UBRR0 + 1ULL) * NS_PER_S / F_CPU;
+}
+
+static void update_status(void) {
+	UCSR0A = (UCSR0A & (1 << U2X0)) |
+			(tx_holding_full ? 0 : 1 << UDRE0) |
+			(tx_complete ? 1 << TXC0 : 0) |
+			(rx_full ? 1 << RXC0 : 0);
+}
+
+// The program wrote c to UDR0
+static void transmit(uint8_t c, uint64_t time) {
+	// (The program always clears TXC0 as it writes a character.)
+	tx_complete = 0;
+	if(tx_end == NEVER) {
+		tx_shift = c;
+		tx_end = time + character_ns();
+	} else {
+		tx_holding = c;
+		tx_holding_full = 1;
+	}
+}
+
+static void flush_output(void) {
+	unsigned written = 0;
+	while(written < out_length) {
+		ssize_t n = write(pty, out_buffer + written, out_length - written);
+		if(n <= 0) {
+			// Nothing is reading the serial port - the characters are lost
+			pty_dropped += out_length - written;
+			break;
+		}
+		written += n;
+	}
+	out_length = 0;
+}
+
+static void read_input(void) {
+	if(rx_start == rx_end) {
+		rx_start = rx_end = 0;
+	}
+	if(rx_end < sizeof(rx_buffer)) {
+		ssize_t n = read(pty, rx_buffer + rx_end, sizeof(rx_buffer) - rx_end);
+		if(n > 0) {
+			rx_end += n;
+		}
+	}
+}
+
+/* Interrupts */
+
+static void call(uint8_t vector, void (*handler)(void)) {
+	uint64_t start = real_ns();
+	update_status();
+	handler();
+	vector_calls[vector]++;
+	vector_ns[vector] += real_ns() - start;
+}
+
+// Call every interrupt handler that is due, highest priority first
+static void dispatch(void) {
+	for(unsigned limit = 0; limit < 1000; limit++) {
+		if(timer_flag && (TIMSK0 & (1 << OCIE0A))) {
+			timer_flag = 0;
+			timer_serviced = timer_match;
+			call(VECTOR_TIMER0, TIMER0_COMPA_vect);
+		} else if(rx_full && (UCSR0B & (1 << RXCIE0))) {
+			rx_full = 0;
+			UDR0 = UDR_RECEIVED | rx_data;
+			call(VECTOR_RX, USART0_RX_vect);
+			if(UDR0 < UDR_EMPTY) {
+				// Echoed
+				transmit(UDR0, sim_ns);
+			}
+		} else if(!tx_holding_full && (UCSR0B & (1 << UDRIE0))) {
+			UDR0 = UDR_EMPTY;
+			call(VECTOR_UDRE, USART0_UDRE_vect);
+			if(UDR0 < UDR_EMPTY) {
+				transmit(UDR0, sim_ns);
+			} else if(UCSR0B & (1 << UDRIE0)) {
+				// Nothing written and the interrupt left on - it would
+				// run forever
+				break;
+			}
+		} else if(adc_flag && (ADCSRA & (1 << ADIE))) {
+			adc_flag = 0;
+			call(VECTOR_ADC, ADC_vect);
+		} else {
+			break;
+		}
+	}
+}
+
+static uint64_t adc_conversion_ns(void) {
+	return 13 * (1ULL << (ADCSRA & 7)) * NS_PER_S / F_CPU;
+}
+
+// Bring the hardware up to the current time and run the interrupt
+// handlers. Called with interrupts enabled, from the signal handler or
+// host_sei().
+static void service(void) {
+	servicing = 1;
+	uint8_t sreg = SREG;
+	SREG &= ~(1 << SREG_I);
+
+	uint64_t now = real_ns();
+	read_input();
+	if(rx_start != rx_end && rx_free < now) {
+		// Characters that arrived since the last time start now
+		rx_free = now;
+	}
+	for(;;) {
+		// The next event
+		uint64_t rx_next = rx_start != rx_end ? rx_free : NEVER;
+		uint64_t next = timer_next;
+		if(tx_end < next) {
+			next = tx_end;
+		}
+		if(rx_next < next) {
+			next = rx_next;
+		}
+		if(adc_end < next) {
+			next = adc_end;
+		}
+		if(next > now) {
+			break;
+		}
+		sim_ns = next;
+		if(next == timer_next) {
+			timer_flag = 1;
+			timer_match = timer_next / TICK_NS;
+			timer_next += TICK_NS;
+			// The ADC is triggered by the compare match
+			if((ADCSRA & (1 << ADEN)) && (ADCSRA & (1 << ADATE)) &&
+					(ADCSRB & 7) == ((1 << ADTS1) | (1 << ADTS0)) && adc_end == NEVER) {
+				adc_end = next + adc_conversion_ns();
+			}
+		} else if(next == tx_end) {
+			if(out_length == sizeof(out_buffer)) {
+				flush_output();
+			}
+			out_buffer[out_length++] = tx_shift;
+			sent++;
+			if(tx_holding_full) {
+				tx_shift = tx_holding;
+				tx_holding_full = 0;
+				tx_end += character_ns();
+			} else {
+				tx_end = NEVER;
+				tx_complete = 1;
+			}
+		} else if(next == rx_next) {
+			if(rx_full) {
+				overruns++;
+			}
+			rx_data = rx_buffer[rx_start++];
+			rx_full = 1;
+			received++;
+			rx_free = next + character_ns();
+		} else {
+			ADC = JOYSTICK_CENTRE;
+			adc_flag = 1;
+			adc_end = NEVER;
+		}
+		dispatch();
+	}
+	// The program may have turned on the UDR empty interrupt
+	sim_ns = now;
+	dispatch();
+	update_status();
+	flush_output();
+
+	SREG = sreg;
+	servicing = 0;
+}
+
+static void print_counters(void) {
+	double seconds = real_ns() / 1e9;
+	fprintf(stderr, "sim: ran %.3fs at %lu baud\n", seconds,
+			(unsigned long)(NS_PER_S * 10 / character_ns()));
+	fprintf(stderr, "sim: sent %llu characters (%llu not read), received %llu "
+			"(%llu overruns)\n", (unsigned long long)sent,
+			(unsigned long long)pty_dropped, (unsigned long long)received,
+			(unsigned long long)overruns);
+	for(uint8_t i = 0; i < NUM_VECTORS; i++) {
+		fprintf(stderr, "sim: %-12s %10llu calls %8.0f/s %6.0fns each\n",
+				vector_names[i], (unsigned long long)vector_calls[i],
+				vector_calls[i] / seconds,
+				vector_calls[i] ? (double)vector_ns[i] / vector_calls[i] : 0.0);
+	}
+	fflush(stderr);
+}
+
+static void alarm_handler(int signal) {
+	(void)signal;
+	if(!(SREG & (1 << SREG_I)) || servicing) {
+		pending = 1;
+		return;
+	}
+	pending = 0;
+	service();
+	if(print || quit) {
+		print = 0;
+		print_counters();
+	}
+	if(quit) {
+		_exit(0);
+	}
+}
+
+static void print_handler(int signal) {
+	(void)signal;
+	print = 1;
+}
+
+static void quit_handler(int signal) {
+	(void)signal;
+	if(quit) {
+		// Interrupts have been off since the first signal
+		_exit(1);
+	}
+	quit = 1;
+}
+
+void host_sei(void) {
+	SREG |= 1 << SREG_I;
+	if(pending && !servicing) {
+		pending = 0;
+		service();
+	}
+}
+
+void host_cli(void) {
+	SREG &= ~(1 << SREG_I);
+}
+
+void host_sleep_cpu(void) {
+	// The next interrupt is never more than SIM_POLL_US away
+	if(SREG & (1 << SREG_I)) {
+		pause();
+	}
+}
+
+void host_delay_us(double us) {
+	uint64_t end = real_ns() + us * 1000;
+	while(real_ns() < end) {
+	}
+}
+
+/* EEPROM */
+
+static void eeprom_wait(void) {
+	while(real_ns() < eeprom_ready_ns) {
+	}
+}
+
+int host_eeprom_is_ready(void) {
+	return real_ns() >= eeprom_ready_ns;
+}
+
+uint8_t host_eeprom_read(uintptr_t address) {
+	eeprom_wait();
+	return eeprom[address % EEPROM_SIZE];
+}
+
+void host_eeprom_write(uintptr_t address, uint8_t value) {
+	// An update - only a byte that changes is written
+	eeprom_wait();
+	address %= EEPROM_SIZE;
+	if(eeprom[address] != value) {
+		eeprom[address] = value;
+		if(eeprom_file >= 0 && pwrite(eeprom_file, &value, 1, address) != 1) {
+			perror("sim: EEPROM file");
+		}
+		eeprom_ready_ns = real_ns() + EEPROM_WRITE_NS;
+	}
+}
+
+static void open_eeprom(const char* path) {
+	memset(eeprom, 0xFF, sizeof(eeprom));
+	eeprom_file = open(path, O_RDWR | O_CREAT, 0644);
+	if(eeprom_file < 0) {
+		perror(path);
+		exit(1);
+	}
+	ssize_t length = read(eeprom_file, eeprom, sizeof(eeprom));
+	if(length < EEPROM_SIZE &&
+			pwrite(eeprom_file, eeprom + (length > 0 ? length : 0),
+			EEPROM_SIZE - (length > 0 ? length : 0), length > 0 ? length : 0) < 0) {
+		perror(path);
+		exit(1);
+	}
+}
+
+/* stdio */
+
+HostFile* host_stdout;
+HostFile* host_stdin;
+
+int host_putchar(int c) {
+	if(host_stdout) {
+		host_stdout->put(c, host_stdout);
+	}
+	return c;
+}
+
+/* printf for the avr-libc formats the program uses: %S is a string in
+ * program memory (i.e. %s here) and l is a 32 bit value (unsigned long on
+ * the AVR, an int is enough here).
+ */
+int host_printf(const char* format, ...) {
+	char host_format[256];
+	char text[512];
+	unsigned out = 0;
+	for(const char* in = format; *in && out < sizeof(host_format) - 1; in++) {
+		if(*in != '%') {
+			host_format[out++] = *in;
+			continue;
+		}
+		host_format[out++] = *in++;
+		while(*in && strchr("-+ #0123456789.*", *in) && out < sizeof(host_format) - 2) {
+			host_format[out++] = *in++;
+		}
+		while(*in == 'l') {
+			in++;
+		}
+		if(!*in) {
+			break;
+		}
+		host_format[out++] = *in == 'S' ? 's' : *in;
+	}
+	host_format[out] = 0;
+
+	va_list args;
+	va_start(args, format);
+	int length = vsnprintf(text, sizeof(text), host_format, args);
+	va_end(args);
+	for(int i = 0; i < length && i < (int)sizeof(text) - 1; i++) {
+		host_putchar(text[i]);
+	}
+	return length;
+}
+
+/* Start up */
+
+static void open_pty(const char* link) {
+	pty = posix_openpt(O_RDWR | O_NOCTTY);
+	if(pty < 0 || grantpt(pty) || unlockpt(pty)) {
+		perror("sim: pty");
+		exit(1);
+	}
+	const char* name = ptsname(pty);
+	// Keep the other end open so nothing is lost (and writes don't fail)
+	// while nothing is connected, and make it a raw serial line
+	int other = open(name, O_RDWR | O_NOCTTY);
+	struct termios settings;
+	if(other < 0 || tcgetattr(other, &settings)) {
+		perror(name);
+		exit(1);
+	}
+	cfmakeraw(&settings);
+	tcsetattr(other, TCSANOW, &settings);
+	fcntl(pty, F_SETFL, fcntl(pty, F_GETFL) | O_NONBLOCK);
+	if(link) {
+		unlink(link);
+		if(symlink(name, link)) {
+			perror(link);
+			exit(1);
+		}
+		name = link;
+	}
+	printf("sim: serial port %s\n", name);
+	fflush(stdout);
+}
+
+static void usage(const char* program) {
+	fprintf(stderr, "usage: %s [-l link] [-e eeprom-file]\n"
+			"  -l link         also make the serial port available as link\n"
+			"  -e eeprom-file  keep the EEPROM in this file (created if it\n"
+			"                  doesn't exist - otherwise the EEPROM starts\n"
+			"                  blank every time)\n", program);
+	exit(2);
+}
+
+int main(int argc, char** argv) {
+	const char* link = 0;
+	int option;
+	memset(eeprom, 0xFF, sizeof(eeprom));
+	while((option = getopt(argc, argv, "l:e:h")) != -1) {
+		switch(option) {
+			case 'l':
+				link = optarg;
+				break;
+			case 'e':
+				open_eeprom(optarg);
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	start_ns = 0;
+	start_ns = real_ns();
+	open_pty(link);
+
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = quit_handler;
+	sigaction(SIGINT, &action, 0);
+	sigaction(SIGTERM, &action, 0);
+	action.sa_handler = print_handler;
+	sigaction(SIGUSR1, &action, 0);
+	action.sa_handler = alarm_handler;
+	action.sa_flags = SA_RESTART;
+	sigaction(SIGALRM, &action, 0);
+	struct itimerval poll = { { 0, SIM_POLL_US }, { 0, SIM_POLL_US } };
+	setitimer(ITIMER_REAL, &poll, 0);
+
+	// The board starts with interrupts off
+	SREG = 0;
+	return firmware_main();
+}
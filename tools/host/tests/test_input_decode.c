@@ -0,0 +1,213 @@
+/*
+ * test_input_decode.c
+ *
+ * Author: Xinyi Li
+ *
+ * Feeds characters to the serial receive interrupt handler (serialio.c)
+ * and checks the key events it puts in the input queue (input.c): cursor
+ * keys in both the ESC [ and ESC O forms and with parameters, a lone ESC,
+ * Enter as CR, LF or CR LF, Backspace as BS or DEL, and pasted bursts
+ * that arrive faster than the game takes them. The firmware objects are
+ * the ones the simulation is built from - only the timer and the frame
+ * receiver are stood in for.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <avr/io.h>
+#include "host.h"
+#include "../../input.h"
+#include "../../serialio.h"
+
+/* What the firmware objects need */
+#define HOST_DEFINE8(name) volatile uint8_t name;
+#define HOST_DEFINE16(name) volatile uint16_t name;
+HOST_REGISTERS(HOST_DEFINE8, HOST_DEFINE16)
+volatile uint8_t SREG;
+HostFile* host_stdout;
+HostFile* host_stdin;
+
+static uint32_t now_us;
+
+uint32_t get_current_time(void) {
+	return now_us / 1000;
+}
+
+uint32_t get_current_time_us(void) {
+	return now_us;
+}
+
+uint8_t begin_critical_section(void) {
+	return 0;
+}
+
+void end_critical_section(uint8_t interrupts_were_enabled) {
+	(void)interrupts_were_enabled;
+}
+
+// No frames - every character is a key
+uint8_t frame_receive(uint8_t c) {
+	(void)c;
+	return 0;
+}
+
+void USART0_RX_vect(void);
+
+/* Checks */
+static unsigned checks, failures;
+
+#define CHECK(condition, ...) do { \
+	checks++; \
+	if(!(condition)) { \
+		failures++; \
+		printf("%s:%d: ", __FILE__, __LINE__); \
+		printf(__VA_ARGS__); \
+		printf("\n"); \
+	} \
+} while(0)
+
+// Receive the characters, 1 every 520us (a character time at 19200 baud)
+static void receive(const char* characters, size_t length) {
+	for(size_t i = 0; i < length; i++) {
+		UDR0 = (uint8_t)characters[i];
+		USART0_RX_vect();
+		now_us += 520;
+	}
+}
+
+// Take every event off the queue. Returns the number.
+static size_t take_events(uint8_t* codes, size_t size) {
+	InputEvent event;
+	size_t count = 0;
+	while(input_get(&event)) {
+		CHECK(event.source == INPUT_SERIAL, "event from source %u",
+				event.source);
+		if(count < size) {
+			codes[count] = event.code;
+		}
+		count++;
+	}
+	return count;
+}
+
+// Receive the characters and check the key codes they make
+#define EXPECT(characters, ...) do { \
+	static const uint8_t expected[] = { __VA_ARGS__ }; \
+	expect(__LINE__, characters, sizeof(characters) - 1, expected, \
+			sizeof(expected)); \
+} while(0)
+#define NOTHING 0xFF	// (for EXPECT() of no events)
+
+static void expect(int line, const char* characters, size_t length,
+		const uint8_t* expected, size_t count) {
+	uint8_t codes[64];
+	if(count == 1 && expected[0] == NOTHING) {
+		count = 0;
+	}
+	receive(characters, length);
+	size_t got = take_events(codes, sizeof(codes));
+	checks++;
+	if(got != count || memcmp(codes, expected, count)) {
+		failures++;
+		printf("%s:%d: got", __FILE__, line);
+		for(size_t i = 0; i < got && i < sizeof(codes); i++) {
+			printf(" %02x", codes[i]);
+		}
+		printf(", expected");
+		for(size_t i = 0; i < count; i++) {
+			printf(" %02x", expected[i]);
+		}
+		printf("\n");
+	}
+}
+
+static void test_cursor_keys(void) {
+	EXPECT("\x1b[A\x1b[B\x1b[C\x1b[D", KEY_UP, KEY_DOWN, KEY_RIGHT, KEY_LEFT);
+	// Application cursor mode
+	EXPECT("\x1bOA\x1bOB\x1bOC\x1bOD", KEY_UP, KEY_DOWN, KEY_RIGHT, KEY_LEFT);
+	// With modifiers (Ctrl, Shift) as parameters
+	EXPECT("\x1b[1;5D\x1b[1;2A", KEY_LEFT, KEY_UP);
+	// Keys the game doesn't use are dropped whole
+	EXPECT("\x1b[2~\x1b[15~\x1bOP\x1b[H", NOTHING);
+	EXPECT("a\x1b[3~b", 'a', 'b');
+	// A sequence broken by a control character is abandoned
+	EXPECT("\x1b[\rx", '\n', 'x');
+}
+
+static void test_escape(void) {
+	// A lone ESC is only sent once the next character shows it didn't
+	// start a sequence
+	EXPECT("\x1b", NOTHING);
+	EXPECT("p", ESCAPE_CHAR, 'p');
+	EXPECT("\x1b\x1b[A", ESCAPE_CHAR, KEY_UP);
+	EXPECT("\x1b" "A", ESCAPE_CHAR, 'A');
+}
+
+static void test_enter(void) {
+	EXPECT("\n", '\n');
+	EXPECT("\r", '\n');
+	// (The LF of a CR LF split between two reads is still skipped)
+	EXPECT("\n", NOTHING);
+	EXPECT("\r\n", '\n');
+	EXPECT("\r\r\n\n", '\n', '\n', '\n');
+	EXPECT("a\rb\nc\r\nd", 'a', '\n', 'b', '\n', 'c', '\n', 'd');
+	// The LF after a CR is only skipped straight after it
+	EXPECT("\r", '\n');
+	EXPECT("x\n", 'x', '\n');
+}
+
+static void test_backspace(void) {
+	EXPECT("ab\b\x7f" "c", 'a', 'b', '\b', '\b', 'c');
+}
+
+static void test_pasted_burst(void) {
+	// A burst that fills the queue before the game takes anything
+	static const char burst[] =
+			":stats\r\x1b[D\x1b[D\x1bOC\x1b[1;5Dqwx\x7f\r\n";
+	EXPECT(burst, ':', 's', 't', 'a', 't', 's', '\n', KEY_LEFT, KEY_LEFT,
+			KEY_RIGHT, KEY_LEFT, 'q', 'w', 'x', '\b', '\n');
+	CHECK(input_overflows() == 0, "%u overflows", input_overflows());
+}
+
+static void test_burst_overflow(void) {
+	// 24 keys at once - the queue keeps the first INPUT_QUEUE_SIZE
+	uint16_t overflows = input_overflows();
+	uint8_t codes[64];
+	char keys[24 * 3];
+	for(uint8_t i = 0; i < 24; i++) {
+		memcpy(keys + 3 * i, "\x1b[D", 3);
+	}
+	receive(keys, sizeof(keys));
+	size_t got = take_events(codes, sizeof(codes));
+	CHECK(got == INPUT_QUEUE_SIZE, "%zu events kept", got);
+	CHECK(input_overflows() - overflows == 24 - INPUT_QUEUE_SIZE,
+			"%u overflows", input_overflows() - overflows);
+	// Nothing was lost from the sequences the dropped keys were part of
+	EXPECT("\x1b[A", KEY_UP);
+}
+
+static void test_timestamps(void) {
+	InputEvent first, second;
+	uint32_t start = now_us;
+	receive("\x1b[Ax", 4);
+	CHECK(input_get(&first) && input_get(&second), "two events");
+	// An event is stamped when its last character arrives
+	CHECK(first.timestamp_us == start + 2 * 520, "key at %lu",
+			(unsigned long)(first.timestamp_us - start));
+	CHECK(second.timestamp_us == start + 3 * 520, "x at %lu",
+			(unsigned long)(second.timestamp_us - start));
+}
+
+int main(void) {
+	serial_input_to_events(1);
+	test_cursor_keys();
+	test_escape();
+	test_enter();
+	test_backspace();
+	test_pasted_burst();
+	test_burst_overflow();
+	test_timestamps();
+	printf("test_input_decode: %u checks, %u failed\n", checks, failures);
+	return failures != 0;
+}
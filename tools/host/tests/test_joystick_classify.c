@@ -0,0 +1,254 @@
+/*
+ * test_joystick_classify.c
+ *
+ * Author: Xinyi Li
+ *
+ * Sweeps every pair of ADC readings (x, y) through the joystick code
+ * (joystick.c) and compares the directions joystick_classify() gives
+ * with the floating point mapping it replaced:
+ *
+ *     mag = sqrt(pow(x, 2) + pow(y, 2));
+ *     angle = atan2(y, x) * (180/M_PI);	(an int)
+ *     if(mag > 400) { forward if 60 < angle < 120, ... }
+ *
+ * The readings go through the ADC interrupt handler, so the calibration
+ * and scaling are the firmware's. The two mappings may only differ where
+ * the old one rounded: the 1 degree either side of each boundary (its
+ * angle was truncated to a whole number of degrees, and a whole number
+ * on a boundary gave no direction at all) and magnitudes from 400 to 401
+ * (the magnitude was truncated too). The hysteresis is then checked from
+ * every previous direction: a direction is only kept past a boundary
+ * next to it, by no more than JOYSTICK_HYSTERESIS degrees, and only
+ * released below JOYSTICK_RELEASE.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <avr/io.h>
+#include "host.h"
+#include "../../joystick.h"
+
+/* What the firmware objects need */
+#define HOST_DEFINE8(name) volatile uint8_t name;
+#define HOST_DEFINE16(name) volatile uint16_t name;
+HOST_REGISTERS(HOST_DEFINE8, HOST_DEFINE16)
+volatile uint8_t SREG;
+
+uint32_t get_current_time_us(void) {
+	return 0;
+}
+
+void input_post(uint8_t source, uint8_t code) {
+	(void)source;
+	(void)code;
+}
+
+void ADC_vect(void);
+
+/* Checks */
+static unsigned long checks, failures;
+
+#define CHECK(condition, ...) do { \
+	checks++; \
+	if(!(condition) && failures++ < 20) { \
+		printf("%s:%d: ", __FILE__, __LINE__); \
+		printf(__VA_ARGS__); \
+		printf("\n"); \
+	} \
+} while(0)
+
+#define ADC_READINGS 1024
+#define CENTRE_READING 512
+
+// (Allowance for rounding the tan^2 boundaries to integers)
+#define BOUNDARY_ROUNDING 0.2
+
+static const char* const direction_names[] = {
+	"centre", "forward", "backward", "left", "right",
+	"up left", "up right", "down left", "down right"
+};
+
+// Deflection the firmware gives for each ADC reading of each axis
+static int16_t deflection[2][ADC_READINGS];
+
+// Convert a reading of x and then of y (the ADC alternates between them)
+static void convert(uint16_t x, uint16_t y) {
+	ADC = x;
+	ADC_vect();
+	ADC = y;
+	ADC_vect();
+}
+
+static void find_deflections(void) {
+	JoystickState state;
+	initialise_joystick();
+	// Calibrate with the joystick centred
+	for(uint16_t i = 0; i < 2 * JOYSTICK_CALIBRATION_SAMPLES; i++) {
+		convert(CENTRE_READING, CENTRE_READING);
+	}
+	get_joystick_state(&state);
+	CHECK(state.calibrated, "not calibrated");
+	for(uint16_t reading = 0; reading < ADC_READINGS; reading++) {
+		// Hold x at the reading (and y at the other end of the range)
+		// until the averages have caught up
+		for(uint8_t i = 0; i < JOYSTICK_OVERSAMPLE; i++) {
+			convert(reading, ADC_READINGS - 1 - reading);
+		}
+		get_joystick_state(&state);
+		deflection[0][reading] = state.x;
+		deflection[1][ADC_READINGS - 1 - reading] = state.y;
+	}
+	CHECK(deflection[0][CENTRE_READING] == 0 && deflection[1][CENTRE_READING] == 0,
+			"centre deflection %d, %d", deflection[0][CENTRE_READING],
+			deflection[1][CENTRE_READING]);
+	CHECK(deflection[0][0] == -JOYSTICK_FULL_SCALE &&
+			deflection[1][ADC_READINGS - 1] >= JOYSTICK_FULL_SCALE - 1,
+			"full scale %d to %d", deflection[0][0],
+			deflection[1][ADC_READINGS - 1]);
+}
+
+/* The mapping joystick_classify() replaced (from the old input task).
+ * Returns -1 where it gave no direction (on a boundary).
+ */
+static int old_direction(int16_t x, int16_t y) {
+	uint32_t mag = sqrt(pow(x, 2) + pow(y, 2));
+	int angle = atan2(y, x) * (180/M_PI);
+	if(mag <= 400) {
+		return JOYSTICK_CENTRE;
+	} else if(angle > 60 && angle < 120) {
+		return JOYSTICK_FORWARD;
+	} else if(angle < -60 && angle > -120) {
+		return JOYSTICK_BACKWARD;
+	} else if(angle > -30 && angle < 30) {
+		return JOYSTICK_LEFT;
+	} else if(angle < -150 || angle > 150) {
+		return JOYSTICK_RIGHT;
+	} else if(angle > 30 && angle < 60) {
+		return JOYSTICK_UP_LEFT;
+	} else if(angle > 120 && angle < 150) {
+		return JOYSTICK_UP_RIGHT;
+	} else if(angle < -30 && angle > -60) {
+		return JOYSTICK_DOWN_LEFT;
+	} else if(angle < -120 && angle > -150) {
+		return JOYSTICK_DOWN_RIGHT;
+	}
+	return -1;
+}
+
+// Distance (degrees) from an angle to the nearest boundary between
+// directions (every 30 degrees from 30, skipping 90 and 180 - 0)
+static double boundary_distance(double angle) {
+	double folded = fabs(angle);
+	if(folded > 90) {
+		folded = 180 - folded;
+	}
+	return fmin(fabs(folded - 30), fabs(folded - 60));
+}
+
+// Distance (degrees) from an angle to the range of a direction
+static double direction_distance(double angle, JoystickDirection direction) {
+	static const double centre[] = { 0, 90, -90, 0, 180, 45, 135, -45, -135 };
+	static const double half_width[] = { 0, 30, 30, 30, 30, 15, 15, 15, 15 };
+	double difference = fabs(fmod(angle - centre[direction] + 540, 360) - 180);
+	return fmax(difference - half_width[direction], 0);
+}
+
+static void test_against_old_mapping(void) {
+	unsigned long engaged = 0, rounding = 0, magnitude = 0;
+	for(uint16_t i = 0; i < ADC_READINGS; i++) {
+		for(uint16_t j = 0; j < ADC_READINGS; j++) {
+			int16_t x = deflection[0][i], y = deflection[1][j];
+			int32_t magnitude2 = (int32_t)x * x + (int32_t)y * y;
+			double angle = atan2(y, x) * (180/M_PI);
+			JoystickDirection new = joystick_classify(x, y, JOYSTICK_CENTRE);
+			int old = old_direction(x, y);
+			engaged += new != JOYSTICK_CENTRE;
+			if(new == old) {
+				continue;
+			}
+			if(magnitude2 > 400 * 400 && magnitude2 < 401 * 401) {
+				magnitude++;
+				CHECK(old == JOYSTICK_CENTRE, "(%d, %d) was %s", x, y,
+						direction_names[old]);
+			} else {
+				rounding++;
+				CHECK(boundary_distance(angle) < 1 + BOUNDARY_ROUNDING,
+						"(%d, %d) at %.2f degrees is %s, was %s", x, y, angle,
+						direction_names[new], old < 0 ? "none" : direction_names[old]);
+			}
+		}
+	}
+	printf("test_joystick_classify: %d ADC pairs, %lu engaged; differ from "
+			"the old mapping at %lu within 1 degree of a boundary and %lu at "
+			"magnitude 400 to 401\n", ADC_READINGS * ADC_READINGS, engaged,
+			rounding, magnitude);
+}
+
+static void test_hysteresis(void) {
+	unsigned long kept = 0;
+	for(uint16_t i = 0; i < ADC_READINGS; i++) {
+		for(uint16_t j = 0; j < ADC_READINGS; j++) {
+			int16_t x = deflection[0][i], y = deflection[1][j];
+			int32_t magnitude2 = (int32_t)x * x + (int32_t)y * y;
+			double angle = atan2(y, x) * (180/M_PI);
+			JoystickDirection fresh = joystick_classify(x, y, JOYSTICK_CENTRE);
+			for(JoystickDirection previous = JOYSTICK_FORWARD;
+					previous <= JOYSTICK_DOWN_RIGHT; previous++) {
+				JoystickDirection new = joystick_classify(x, y, previous);
+				if(magnitude2 <= JOYSTICK_RELEASE * JOYSTICK_RELEASE) {
+					CHECK(new == JOYSTICK_CENTRE, "(%d, %d) not released", x, y);
+				} else if(magnitude2 <= JOYSTICK_ENGAGE * JOYSTICK_ENGAGE) {
+					CHECK(new != JOYSTICK_CENTRE, "(%d, %d) released early", x, y);
+				} else if(new != fresh) {
+					kept++;
+					CHECK(new == previous, "(%d, %d) at %.2f degrees from %s "
+							"is %s, not %s", x, y, angle,
+							direction_names[previous], direction_names[new],
+							direction_names[fresh]);
+					CHECK(direction_distance(angle, previous) <
+							JOYSTICK_HYSTERESIS + BOUNDARY_ROUNDING,
+							"%s kept %.2f degrees past its range",
+							direction_names[previous],
+							direction_distance(angle, previous));
+				}
+			}
+		}
+	}
+	printf("test_joystick_classify: a previous direction kept at %lu "
+			"(pair, direction) combinations\n", kept);
+}
+
+// Sweep round at full deflection, one way and back: each change comes
+// JOYSTICK_HYSTERESIS degrees past the boundary in the direction of travel
+static void test_sweep(void) {
+	for(int8_t way = 1; way >= -1; way -= 2) {
+		JoystickDirection direction = joystick_classify(
+				JOYSTICK_FULL_SCALE, 0, JOYSTICK_CENTRE);
+		for(int tenth = 1; tenth <= 3600; tenth++) {
+			double angle = way * tenth / 10.0;
+			int16_t x = lround(JOYSTICK_FULL_SCALE * cos(angle * M_PI / 180));
+			int16_t y = lround(JOYSTICK_FULL_SCALE * sin(angle * M_PI / 180));
+			JoystickDirection new = joystick_classify(x, y, direction);
+			if(new != direction) {
+				double past = fmod(fabs(angle), 30);
+				CHECK(fabs(past - JOYSTICK_HYSTERESIS) < 2 * BOUNDARY_ROUNDING,
+						"%s to %s at %.1f degrees", direction_names[direction],
+						direction_names[new], angle);
+				direction = new;
+			}
+		}
+		CHECK(direction == JOYSTICK_LEFT, "sweep ended %s",
+				direction_names[direction]);
+	}
+}
+
+int main(void) {
+	find_deflections();
+	test_against_old_mapping();
+	test_hysteresis();
+	test_sweep();
+	printf("test_joystick_classify: %lu checks, %lu failed\n", checks, failures);
+	return failures != 0;
+}
@@ -0,0 +1,252 @@
+"""
+level_upload.py
+
+Author: Xinyi Li
+
+Uploads a level to the board over the serial port (see level.h) and
+reports how long it took.
+
+    python3 tools/level_upload.py level.json -n 1 -e -p /dev/ttyUSB0
+    python3 tools/level_upload.py level.json -n 1 -e   # simulated board
+    python3 tools/level_upload.py --remove -p /dev/ttyUSB0
+
+A level file is JSON, with the fields of Level (level.h):
+
+    {"lanes": ["0x0F0F0F0F0F0F0F0F", ...3], "logs": ["0x00FF00FF", ...2],
+     "vehicle_colours": [15, 15, 15], "log_colour": 19}
+
+(numbers or strings of numbers), or the 36 bytes of a Level as they are
+sent. The transfer is stop and wait: each command is sent once the last
+one has been answered, and resent if it is NAKed or no answer comes.
+"""
+
+import argparse
+import collections
+import json
+import os
+import struct
+import sys
+import time
+
+TOOLS = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, os.path.join(TOOLS, "tests"))
+
+from framelink import (FRAME_BULK, FRAME_MAX_PAYLOAD, Link,  # noqa: E402
+                       Timeout, crc_ccitt, encode_frame)
+
+# level.h
+LEVEL_FORMAT = "<3Q2I4B"
+LEVEL_SIZE = struct.calcsize(LEVEL_FORMAT)
+LEVEL_NUMBERS = 4
+LEVEL_BEGIN, LEVEL_DATA, LEVEL_FINISH, LEVEL_REMOVE, LEVEL_STATUS = \
+    1, 2, 3, 4, 5
+LEVEL_ACK, LEVEL_NAK = 0x06, 0x15
+LEVEL_TO_RAM, LEVEL_TO_EEPROM = 0, 1
+LEVEL_ERRORS = {1: "not every byte was received", 2: "bad CRC",
+                3: "the level can't be played"}
+LEVEL_STATES = ("idle", "receiving", "playable", "stored", "failed")
+LEVEL_STATE_PLAYABLE, LEVEL_STATE_STORED, LEVEL_STATE_FAILED = 2, 3, 4
+
+MAX_CHUNK = FRAME_MAX_PAYLOAD - 2  # (after the command and offset)
+
+Status = collections.namedtuple(
+    "Status", "state upload_ms playable_ms stored_ms")
+Result = collections.namedtuple(
+    "Result", "bytes seconds wire_bytes commands resends status")
+
+
+class UploadError(Exception):
+    pass
+
+
+def pack_level(lanes, logs, vehicle_colours, log_colour):
+    return struct.pack(LEVEL_FORMAT, *lanes, *logs, *vehicle_colours,
+                       log_colour)
+
+
+def read_level(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    if data.lstrip()[:1] != b"{":
+        if len(data) != LEVEL_SIZE:
+            raise UploadError("a level is %d bytes, not %d" %
+                              (LEVEL_SIZE, len(data)))
+        return data
+    fields = json.loads(data)
+
+    def number(value):
+        return int(value, 0) if isinstance(value, str) else int(value)
+    return pack_level([number(v) for v in fields["lanes"]],
+                      [number(v) for v in fields["logs"]],
+                      [number(v) for v in fields["vehicle_colours"]],
+                      number(fields["log_colour"]))
+
+
+class Uploader:
+    """Stop and wait transfers of FRAME_BULK commands."""
+
+    def __init__(self, link, timeout=0.5, retries=5):
+        self.link = link
+        self.timeout = timeout
+        self.retries = retries
+        self.wire_bytes = 0
+        self.commands = 0
+        self.resends = 0
+
+    def send(self, payload):
+        frame = encode_frame(FRAME_BULK, payload)
+        self.wire_bytes += len(frame)
+        self.link.write(frame)
+
+    def receive(self, command):
+        """The answer to command, or None if none comes in time."""
+        end = time.monotonic() + self.timeout
+        while True:
+            try:
+                _, reply = self.link.next_frame(
+                    FRAME_BULK, max(end - time.monotonic(), 0))
+            except Timeout:
+                return None
+            # (A late answer to an earlier command is skipped)
+            if len(reply) >= 3 and reply[1] == command:
+                self.wire_bytes += len(encode_frame(FRAME_BULK, reply))
+                return reply
+
+    def command(self, payload, done=None):
+        """Send a command until it is ACKed. done(reply) can accept a NAK
+        (returning True) or change what is resent (returning a new
+        payload). Returns the last answer."""
+        self.commands += 1
+        for attempt in range(self.retries):
+            if attempt:
+                self.resends += 1
+            self.send(payload)
+            reply = self.receive(payload[0])
+            if reply is None:
+                continue
+            if reply[0] == LEVEL_ACK:
+                return reply
+            if done:
+                answer = done(reply)
+                if answer is True:
+                    return reply
+                if answer:
+                    payload = answer
+        raise UploadError("no ACK for command %d after %d tries" %
+                          (payload[0], self.retries))
+
+    def status(self):
+        reply = self.command(bytes([LEVEL_STATUS]))
+        return Status(reply[2], *struct.unpack("<3H", reply[3:9]))
+
+    def upload(self, level, number, destination=LEVEL_TO_RAM,
+               chunk=MAX_CHUNK, store_timeout=2.0):
+        """Upload a level and wait for it to be stored. Returns a Result."""
+        if not 0 <= number < LEVEL_NUMBERS:
+            raise UploadError("levels are numbered 0 to %d" %
+                              (LEVEL_NUMBERS - 1))
+        start = time.monotonic()
+        wire_bytes, commands, resends = \
+            self.wire_bytes, self.commands, self.resends
+        crc = crc_ccitt(level)
+        self.command(bytes([LEVEL_BEGIN, number, destination,
+                            crc & 0xFF, crc >> 8]))
+
+        offset = 0
+        while offset < len(level):
+            data = level[offset:offset + chunk]
+
+            def resync(reply):
+                # The board says where the next chunk should start - it
+                # has the last one if only its ACK was lost
+                if reply[2] > offset:
+                    return True
+                return bytes([LEVEL_DATA, reply[2]]) + \
+                    level[reply[2]:reply[2] + chunk]
+            reply = self.command(bytes([LEVEL_DATA, offset]) + data, resync)
+            offset = reply[2]
+
+        def finished(reply):
+            # A NAK with no error is a resent FINISH after the board
+            # finished - check that it did
+            if reply[2] == 0 and \
+                    self.status().state in (LEVEL_STATE_PLAYABLE,
+                                            LEVEL_STATE_STORED):
+                return True
+            raise UploadError(LEVEL_ERRORS.get(reply[2], "refused"))
+        self.command(bytes([LEVEL_FINISH]), finished)
+        seconds = time.monotonic() - start
+        counts = (self.wire_bytes - wire_bytes, self.commands - commands,
+                  self.resends - resends)
+
+        # (The board's timings say when it was stored - the polling only
+        # has to see that it has been)
+        end = time.monotonic() + store_timeout
+        status = self.status()
+        while status.state == LEVEL_STATE_PLAYABLE and \
+                time.monotonic() < end:
+            time.sleep(0.05)
+            status = self.status()
+        return Result(len(level), seconds, *counts, status)
+
+    def remove(self):
+        self.command(bytes([LEVEL_REMOVE]))
+
+
+def report(result):
+    status = result.status
+    lines = ["%d bytes in %.0fms: %.0f bytes/s (%d bytes on the wire, "
+             "%d commands, %d resent)" %
+             (result.bytes, result.seconds * 1000,
+              result.bytes / result.seconds, result.wire_bytes,
+              result.commands, result.resends),
+             "board: %s - uploaded in %dms, playable after %dms, stored "
+             "after %dms" % (LEVEL_STATES[status.state], status.upload_ms,
+                             status.playable_ms, status.stored_ms)]
+    return "\n".join(lines)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[2])
+    parser.add_argument("level", nargs="?", help="the level file")
+    parser.add_argument("-n", "--number", type=int, default=0,
+                        help="the level it replaces (0 to 3)")
+    parser.add_argument("-e", "--eeprom", action="store_true",
+                        help="keep it in EEPROM (rather than RAM)")
+    parser.add_argument("-c", "--chunk", type=int, default=MAX_CHUNK,
+                        help="bytes per frame (1 to %d)" % MAX_CHUNK)
+    parser.add_argument("-p", "--port", help="the board's serial port")
+    parser.add_argument("-b", "--baud", type=int, default=19200)
+    parser.add_argument("--remove", action="store_true",
+                        help="go back to the built in level")
+    args = parser.parse_args()
+    if not args.remove and not args.level:
+        parser.error("a level file is needed")
+    if not 1 <= args.chunk <= MAX_CHUNK:
+        parser.error("chunks are 1 to %d bytes" % MAX_CHUNK)
+
+    def run(link):
+        uploader = Uploader(link)
+        if args.remove:
+            uploader.remove()
+            print("removed")
+            return
+        result = uploader.upload(
+            read_level(args.level), args.number,
+            LEVEL_TO_EEPROM if args.eeprom else LEVEL_TO_RAM, args.chunk)
+        print(report(result))
+
+    try:
+        if args.port:
+            with Link.open(args.port, args.baud) as link:
+                run(link)
+        else:
+            from simboard import SimBoard
+            with SimBoard() as board:
+                run(board.link)
+    except UploadError as error:
+        sys.exit("level_upload: %s" % error)
+
+
+if __name__ == "__main__":
+    main()
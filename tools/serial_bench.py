@@ -0,0 +1,155 @@
+"""
+serial_bench.py
+
+Author: Xinyi Li
+
+Measures how much the serial port carries at each baud rate, and (on the
+simulated board) how often the interrupt handlers run to carry it. The
+board is kept as busy talking as it can be - a game running with
+telemetry and the LED matrix mirror on, and a new stats report asked for
+as soon as each one finishes - and the bytes that arrive are counted.
+
+    python3 tools/serial_bench.py                # on the simulated board
+    python3 tools/serial_bench.py -p /dev/ttyUSB0 19200 38400
+
+Below about 38400 baud the line is the limit. Above it the board can't
+fill the line (it only has so much to say), and the numbers show what
+the interrupt handlers cost per byte instead: a UDR Empty interrupt for
+every byte, so at 500000 baud a full line would be 50000 a second, one
+every 160 cycles at 8MHz. (The simulation runs the handlers at the PC's
+speed, so their times on the AVR aren't measured here.)
+
+Each rate is tried on a fresh simulated board. A real board is changed
+from rate to rate (and left at the last one). Rates the board can't
+generate accurately (115200 at 8MHz is 3.5% out) are reported as refused.
+"""
+
+import argparse
+import os
+import re
+import sys
+import time
+
+TOOLS = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, os.path.join(TOOLS, "tests"))
+
+from framelink import BAUD_RATES, Link, Timeout  # noqa: E402
+from simboard import SimBoard  # noqa: E402
+
+RATES = (19200, 38400, 57600, 115200, 250000, 500000)
+VECTORS = ("TIMER0_COMPA", "USART0_RX", "USART0_UDRE", "ADC")
+
+
+def read_for(link, seconds):
+    """Read for a while. (drain() would never finish while the board is
+    talking all the time.)"""
+    end = time.monotonic() + seconds
+    while time.monotonic() < end:
+        link.poll(end - time.monotonic())
+
+
+def change_baud(link, rate):
+    """Change the board's rate (and the port's). False if it refused."""
+    mark = len(link.text)
+    link.write(b":baud %d\r" % rate)
+    end = time.monotonic() + 2.0
+    while link.text.find(b"changing to", mark) < 0:
+        if link.text.find(b"can't be generated", mark) >= 0:
+            return False
+        if time.monotonic() >= end:
+            raise Timeout("no answer to :baud %d" % rate)
+        link.poll(end - time.monotonic())
+    link.drain(0.1)
+    if rate in BAUD_RATES:
+        link.set_baud(rate)
+    link.drain(0.1)
+    return True
+
+
+def measure(link, seconds, snapshot=None):
+    """Keep the board talking for seconds and count what arrives."""
+    link.press_button(0)
+    time.sleep(0.3)
+    link.write(b":tele on\r")
+    time.sleep(0.05)
+    link.write(b":mirror on\r")
+    read_for(link, 0.2)
+
+    before = snapshot() if snapshot else None
+    received = link.bytes_received
+    start = time.monotonic()
+    mark = len(link.text)
+    link.write(b":stats\r")
+    while time.monotonic() - start < seconds:
+        link.poll(0.02)
+        if link.text.find(b"level upload", mark) >= 0:
+            mark = len(link.text)
+            link.write(b":stats\r")
+    elapsed = time.monotonic() - start
+    after = snapshot() if snapshot else None
+    result = {"received": (link.bytes_received - received) / elapsed}
+
+    reported = re.findall(rb"serial throughput: (\d+) bytes/s", link.text)
+    if reported:
+        result["reported"] = int(reported[-1])
+    link.write(b":mirror off\r")
+    link.write(b":tele off\r")
+    read_for(link, 0.2)
+    stats = link.request_stats()
+    result["serial_dropped"] = stats.serial_dropped
+    result["frames_dropped"] = stats.frames_dropped
+
+    if before and after:
+        sim_seconds = after["seconds"] - before["seconds"]
+        sent = after["sent"] - before["sent"]
+        result["baud"] = after["baud"]
+        result["sent"] = sent / sim_seconds
+        for vector in VECTORS:
+            result[vector] = (after[vector] - before[vector]) / sim_seconds
+        result["udre_per_byte"] = \
+            result["USART0_UDRE"] / result["sent"] if sent else 0.0
+    return result
+
+
+def print_result(rate, result, file=sys.stdout):
+    if result is None:
+        print("%7d  refused" % rate, file=file)
+        return
+    line_rate = result.get("baud", rate) / 10
+    print("%7d  %7.0f bytes/s received (%3.0f%% of %.0f)  board says %s  "
+          "dropped %d bytes, %d frames" %
+          (rate, result["received"], 100 * result["received"] / line_rate,
+           line_rate, result.get("reported", "-"), result["serial_dropped"],
+           result["frames_dropped"]), file=file)
+    if "sent" in result:
+        print("         interrupts/s: " + "  ".join(
+            "%s %.0f" % (vector, result[vector]) for vector in VECTORS) +
+            "  (%.2f UDRE per byte)" % result["udre_per_byte"], file=file)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[2])
+    parser.add_argument("rates", nargs="*", type=int, default=RATES)
+    parser.add_argument("-p", "--port",
+                        help="a real board's serial port (at 19200 baud)")
+    parser.add_argument("-s", "--seconds", type=float, default=3.0)
+    args = parser.parse_args()
+
+    if args.port:
+        with Link.open(args.port) as link:
+            for rate in args.rates:
+                result = None
+                if change_baud(link, rate):
+                    result = measure(link, args.seconds)
+                print_result(rate, result)
+        return
+    for rate in args.rates:
+        with SimBoard() as board:
+            result = None
+            if change_baud(board.link, rate):
+                result = measure(board.link, args.seconds, board.snapshot)
+        print_result(rate, result)
+
+
+if __name__ == "__main__":
+    main()
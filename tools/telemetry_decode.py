@@ -0,0 +1,234 @@
+"""
+telemetry_decode.py
+
+Author: Xinyi Li
+
+Rebuilds the game state timeline from the board's telemetry frames (see
+telemetry.h) and reports the bandwidth the stream takes.
+
+    python3 tools/telemetry_decode.py -p /dev/ttyUSB0 -s 10
+    python3 tools/telemetry_decode.py -s 5       # on the simulated board
+
+Each record only carries what changed, so the decoder needs an unbroken
+run of records from a key record on. A gap in the record numbers (a
+frame the board dropped or the host missed) or a badly formed record
+loses the state until the next key record, which the board sends every
+TELEMETRY_KEY_PERIOD records and straight after dropping a frame.
+
+The bandwidth is given as a share of the serial port at 19200, 115200
+and 250000 baud. (115200 is for comparison - at 8MHz the board can't
+generate it accurately and 250000 is the next rate up it takes.)
+"""
+
+import argparse
+import collections
+import os
+import struct
+import sys
+import time
+
+TOOLS = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, os.path.join(TOOLS, "tests"))
+
+from framelink import FRAME_TELEMETRY, Link, encode_frame  # noqa: E402
+
+# telemetry.h
+TELEMETRY_PERIOD_MS = 20
+TELEMETRY_MORE = 1 << 7
+KEY_HEADER, KEY_MORE = 0xFF, 0x07
+
+# Fields in header bit order: (name, value format)
+FIELDS = (("frog", "B"), ("lanes", "3B"), ("logs", "2B"),
+          ("riverbank", "<H"), ("countdown", "B"), ("score", "<I"),
+          ("events", "B"))
+MORE_FIELDS = (("level", "B"), ("lives", "B"), ("mode", "B"))
+
+EVENTS = ("move", "death", "level up", "new game")
+
+Record = collections.namedtuple("Record", "index number state events changed")
+
+
+def decode_record(data, i):
+    """Decode the record starting at data[i]. Returns (values, key, next
+    i), where values holds the fields the record changed. Raises
+    ValueError if the record runs off the end."""
+    header = data[i]
+    i += 1
+    more = 0
+    if header & TELEMETRY_MORE:
+        if i >= len(data):
+            raise ValueError("record cut short")
+        more = data[i]
+        i += 1
+    values = {}
+    fields = [f for bit, f in enumerate(FIELDS) if header & (1 << bit)] + \
+        [f for bit, f in enumerate(MORE_FIELDS) if more & (1 << bit)]
+    for name, value_format in fields:
+        size = struct.calcsize(value_format)
+        if i + size > len(data):
+            raise ValueError("record cut short")
+        value = struct.unpack_from(value_format, data, i)
+        i += size
+        if name == "frog":
+            values["frog_row"], values["frog_column"] = \
+                value[0] >> 4, value[0] & 0x0F
+        elif name == "mode":
+            values["mode"], values["paused"] = value[0] >> 1, value[0] & 1
+        else:
+            values[name] = value if len(value) > 1 else value[0]
+    key = header == KEY_HEADER and more & KEY_MORE == KEY_MORE
+    return values, key, i
+
+
+def event_names(events):
+    return [name for bit, name in enumerate(EVENTS) if events & (1 << bit)]
+
+
+class Timeline:
+    """The state after each record, rebuilt from the telemetry frames.
+
+    feed() takes a frame's payload and returns the new Records: the index
+    of the record since the first one seen (counting the records lost in
+    gaps), its number, the whole state after it, the events in it and the
+    names of the fields it changed.
+    """
+
+    def __init__(self):
+        self.state = None		# None until a key record arrives
+        self.expected = None		# number of the next record
+        self.index = 0
+        self.records = []
+        self.frames = 0
+        self.bytes = 0			# on the wire, framing included
+        self.gaps = 0
+        self.lost = 0			# records in the gaps
+        self.skipped = 0		# records waiting for a key record
+        self.errors = 0
+        self.resyncs = 0
+
+    def feed(self, payload):
+        self.frames += 1
+        self.bytes += len(encode_frame(FRAME_TELEMETRY, payload))
+        if not payload:
+            self.errors += 1
+            return []
+        number = payload[0]
+        if self.expected is not None and number != self.expected:
+            missing = (number - self.expected) % 256
+            self.gaps += 1
+            self.lost += missing
+            self.index += missing
+            self.state = None
+        new = []
+        i = 1
+        while i < len(payload):
+            try:
+                values, key, i = decode_record(payload, i)
+            except ValueError:
+                self.errors += 1
+                self.state = None
+                self.expected = None
+                return new
+            if key:
+                if self.state is None and self.records:
+                    self.resyncs += 1
+                self.state = {}
+            if self.state is None:
+                self.skipped += 1
+            else:
+                events = values.pop("events", 0)
+                self.state.update(values)
+                record = Record(self.index, number, dict(self.state), events,
+                                sorted(values))
+                self.records.append(record)
+                new.append(record)
+            self.index += 1
+            number = (number + 1) % 256
+        self.expected = number
+        return new
+
+    def bytes_per_second(self):
+        seconds = self.index * TELEMETRY_PERIOD_MS / 1000
+        return self.bytes / seconds if seconds else 0.0
+
+
+def describe(record, previous):
+    """What changed in record, as a line of the timeline."""
+    state = record.state
+    parts = []
+    for name in record.changed:
+        if previous is not None and previous.get(name) == state[name]:
+            continue
+        if name in ("frog_row", "frog_column"):
+            part = "frog %d,%d" % (state["frog_row"], state["frog_column"])
+        elif name in ("lanes", "logs"):
+            part = "%s %s" % (name, ",".join(map(str, state[name])))
+        elif name == "riverbank":
+            part = "riverbank %04x" % state[name]
+        else:
+            part = "%s %d" % (name, state[name])
+        if part not in parts:
+            parts.append(part)
+    parts += event_names(record.events)
+    return "%8.2fs #%-3d %s" % (record.index * TELEMETRY_PERIOD_MS / 1000,
+                                record.number, " ".join(parts))
+
+
+def bandwidth_report(timeline, rates=(19200, 115200, 250000)):
+    rate = timeline.bytes_per_second()
+    lines = ["%d records in %d frames: %.0f bytes/s" %
+             (timeline.index, timeline.frames, rate)]
+    lines += ["  %5.1f%% of the serial port at %d baud" % (1000 * rate / baud,
+                                                          baud)
+              for baud in rates]
+    lines.append("%d gaps (%d records lost, %d waiting for a key record), "
+                 "%d bad frames, %d resyncs" %
+                 (timeline.gaps, timeline.lost, timeline.skipped,
+                  timeline.errors, timeline.resyncs))
+    return "\n".join(lines)
+
+
+def record(link, seconds, timeline, show):
+    """Decode the telemetry that arrives in the next seconds."""
+    end = time.monotonic() + seconds
+    previous = None
+    while time.monotonic() < end:
+        link.poll(end - time.monotonic())
+        while link.events:
+            channel, payload = link.events.popleft()
+            if channel != FRAME_TELEMETRY:
+                continue
+            for entry in timeline.feed(payload):
+                if show and (entry.events or previous is None or
+                             entry.state != previous):
+                    print(describe(entry, previous))
+                previous = entry.state
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[2])
+    parser.add_argument("-p", "--port", help="the board's serial port")
+    parser.add_argument("-b", "--baud", type=int, default=19200)
+    parser.add_argument("-s", "--seconds", type=float, default=5.0)
+    parser.add_argument("-q", "--quiet", action="store_true",
+                        help="only print the bandwidth report")
+    args = parser.parse_args()
+
+    timeline = Timeline()
+    if args.port:
+        with Link.open(args.port, args.baud) as link:
+            link.write(b":tele on\r")
+            record(link, args.seconds, timeline, not args.quiet)
+            link.write(b":tele off\r")
+    else:
+        from simboard import SimBoard
+        with SimBoard() as board:
+            board.link.press_button(0)
+            time.sleep(0.3)
+            board.link.write(b":tele on\r")
+            record(board.link, args.seconds, timeline, not args.quiet)
+    print(bandwidth_report(timeline))
+
+
+if __name__ == "__main__":
+    main()
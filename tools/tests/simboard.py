@@ -0,0 +1,116 @@
+"""
+simboard.py
+
+Author: Xinyi Li
+
+Runs the simulated board (tools/host) for the host tests and connects to
+its serial port.
+
+    with SimBoard() as board:
+        board.link.request_state()
+    print(board.counters)
+
+The simulation is tools/host/build/frogger-sim unless FROGGER_SIM names
+another build. Each board starts with a blank EEPROM (kept in a temporary
+file, so it survives restart()).
+"""
+
+import os
+import re
+import signal
+import subprocess
+import sys
+import tempfile
+import time
+
+TOOLS = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+sys.path.insert(0, TOOLS)
+
+from framelink import Link  # noqa: E402
+
+SIM = os.environ.get("FROGGER_SIM",
+                     os.path.join(TOOLS, "host", "build", "frogger-sim"))
+
+
+class SimBoard:
+    def __init__(self, sim=SIM):
+        self.sim = sim
+        self.directory = tempfile.TemporaryDirectory(prefix="frogger-")
+        self.port = os.path.join(self.directory.name, "serial")
+        self.eeprom = os.path.join(self.directory.name, "eeprom")
+        self.process = None
+        self.link = None
+        self.output = ""
+        self.counters = {}
+
+    def start(self):
+        self.process = subprocess.Popen(
+            [self.sim, "-l", self.port, "-e", self.eeprom],
+            stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True)
+        line = self.process.stdout.readline()
+        if not line.startswith("sim: serial port"):
+            self.process.kill()
+            raise RuntimeError("simulation didn't start: %r" % line)
+        self.link = Link.open(self.port)
+        # Let the board get through its start up output
+        time.sleep(0.1)
+        self.link.drain()
+        return self
+
+    def stop(self):
+        """Stop the board and collect its counters (see sim.c)."""
+        if self.link:
+            self.link.close()
+            self.link = None
+        if self.process:
+            self.process.send_signal(signal.SIGTERM)
+            try:
+                _, self.output = self.process.communicate(timeout=5)
+            except subprocess.TimeoutExpired:
+                self.process.kill()
+                _, self.output = self.process.communicate()
+            self.process = None
+            self.counters = parse_counters(self.output)
+        return self.counters
+
+    def snapshot(self):
+        """The counters so far, without stopping the board."""
+        self.process.send_signal(signal.SIGUSR1)
+        lines = []
+        while True:
+            line = self.process.stderr.readline()
+            if not line:
+                break
+            lines.append(line)
+            if line.startswith("sim: ADC"):  # (the last vector)
+                break
+        return parse_counters("".join(lines))
+
+    def restart(self):
+        """Reset the board (the EEPROM is kept)."""
+        self.stop()
+        return self.start()
+
+    def __enter__(self):
+        return self.start()
+
+    def __exit__(self, *exception):
+        self.stop()
+        self.directory.cleanup()
+
+
+def parse_counters(output):
+    counters = {}
+    for name, calls in re.findall(r"sim: (\w+)\s+(\d+) calls", output):
+        counters[name] = int(calls)
+    match = re.search(r"sent (\d+) characters \((\d+) not read\), "
+                      r"received (\d+) \((\d+) overruns\)", output)
+    if match:
+        for key, value in zip(("sent", "not_read", "received", "overruns"),
+                              match.groups()):
+            counters[key] = int(value)
+    match = re.search(r"ran ([\d.]+)s at (\d+) baud", output)
+    if match:
+        counters["seconds"] = float(match.group(1))
+        counters["baud"] = int(match.group(2))
+    return counters
@@ -0,0 +1,99 @@
+"""
+test_console_flood.py
+
+Author: Xinyi Li
+
+Floods the console with report commands while a game is being played,
+and checks that the game never waits for the serial port: input still
+moves the frog, state requests are still answered promptly, no task
+runs for long and no critical output is dropped. (Each new command
+abandons the report before it, so the last report covers the whole
+flood.)
+"""
+
+import os
+import re
+import sys
+import time
+import unittest
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+
+from simboard import SimBoard  # noqa: E402
+from framelink import KEY_LEFT, KEY_RIGHT  # noqa: E402
+
+COMMAND_COUNT = 30  # (even, so the frog ends up where it started)
+COMMAND_INTERVAL = 0.05
+COMMANDS = [b":stats\r", b":params\r", b":lat\r"]
+# Timer 0 counts are 64 cycles (8us at 8MHz). A report line waiting for
+# the serial port at 19200 baud would take several ms.
+MAX_TASK_CYCLES = 16000
+MAX_STATE_DELAY = 0.25
+
+
+def parse_report(text):
+    text = re.sub(r"\x1b\[[0-9;]*[A-Za-z]|\r", "\n", text)
+    tasks = {}
+    for name, runs, average, maximum, misses, overruns in re.findall(
+            r"^(\w+)\s+(\d+)\s+(\d+)\s+(\d+)\s+(\d+)\s+(\d+)$", text, re.M):
+        tasks[name] = int(maximum)
+    values = {}
+    for key, pattern in (("skipped", r"skipped ticks: (\d+)"),
+                         ("lost", r"lost ticks: (\d+)"),
+                         ("critical", r"dropped bytes: critical (\d+)"),
+                         ("debug", r"dropped bytes: .* debug (\d+)"),
+                         ("input_dropped", r"input events dropped: (\d+)")):
+        match = re.search(pattern, text)
+        values[key] = int(match.group(1)) if match else None
+    return tasks, values
+
+
+class ConsoleFloodTest(unittest.TestCase):
+    def test_flood_never_blocks_the_game(self):
+        with SimBoard() as board:
+            link = board.link
+            link.press_button(0)
+            time.sleep(0.3)
+            start = link.request_state()
+            self.assertEqual(start.mode, 1)
+
+            worst_delay = 0.0
+            for command in range(COMMAND_COUNT):
+                link.write(COMMANDS[command % len(COMMANDS)])
+                # Step along the riverbank and back
+                link.send_keys([KEY_LEFT if command % 2 == 0 else KEY_RIGHT])
+                sent = time.monotonic()
+                state = link.request_state(timeout=1.0)
+                worst_delay = max(worst_delay, time.monotonic() - sent)
+                self.assertEqual(state.mode, 1)
+                time.sleep(COMMAND_INTERVAL)
+
+            # Every move was made, so the frog is back where it started
+            time.sleep(0.1)
+            self.assertEqual(link.request_state().frog_column, start.frog_column)
+            self.assertLess(worst_delay, MAX_STATE_DELAY)
+
+            # The last report, left to finish
+            link.drain()
+            mark = len(link.text)
+            link.write(b":stats\r")
+            link.wait_for_text("level upload", timeout=5.0, start=mark)
+            tasks, values = parse_report(bytes(link.text[mark:]).decode())
+            stats = link.request_stats()
+
+        self.assertEqual(len(tasks), 15)
+        slow = {name: cycles for name, cycles in tasks.items()
+                if cycles > MAX_TASK_CYCLES}
+        self.assertEqual(slow, {})
+        self.assertEqual(values["critical"], 0)
+        self.assertEqual(values["input_dropped"], 0)
+        self.assertEqual(stats.frames_dropped, 0)
+        print("\nflood: %d commands, worst state reply %.0fms, longest task "
+              "%d cycles (%s), skipped ticks %s, debug bytes dropped %s" %
+              (COMMAND_COUNT, worst_delay * 1000, max(tasks.values()),
+               max(tasks, key=tasks.get), values["skipped"], values["debug"]),
+              file=sys.stderr)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,123 @@
+"""
+test_level_upload.py
+
+Author: Xinyi Li
+
+Uploads levels to the simulated board with the host uploader
+(level_upload.py): to RAM and to EEPROM (where the level is still there
+after a reset), over a link that loses commands and answers, and a level
+the board refuses.
+"""
+
+import os
+import sys
+import time
+import unittest
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+sys.path.insert(0, os.path.dirname(os.path.dirname(
+    os.path.abspath(__file__))))
+
+from simboard import SimBoard  # noqa: E402
+from framelink import FRAME_BULK, crc_ccitt, encode_frame  # noqa: E402
+import level_upload  # noqa: E402
+from level_upload import (LEVEL_DATA, LEVEL_FINISH, LEVEL_STATE_STORED,  # noqa: E402
+                          LEVEL_TO_EEPROM, Uploader, UploadError, pack_level)
+
+LEVEL = pack_level((0x0F0F0F0F0F0F0F0F, 0x00FF00FF00FF00FF, 0x0303030303030303),
+                   (0x00FF00FF, 0x0F0F0F0F), (0x0F, 0x0F, 0x0F), 0x13)
+LEVEL_SLOT_START = 512
+LEVEL_MAGIC = 0x4C
+
+
+class LossyUploader(Uploader):
+    """Loses the first frame of each command in corrupt (it arrives with
+    a bad CRC) and the first answer to each command in drop."""
+
+    def __init__(self, link, corrupt=(), drop=()):
+        super().__init__(link, timeout=0.2)
+        self.corrupt = set(corrupt)
+        self.drop = set(drop)
+
+    def send(self, payload):
+        if payload[0] not in self.corrupt:
+            return super().send(payload)
+        self.corrupt.discard(payload[0])
+        frame = bytearray(encode_frame(FRAME_BULK, payload))
+        frame[-2] ^= 0x40
+        self.link.write(frame)
+
+    def receive(self, command):
+        reply = super().receive(command)
+        if command in self.drop:
+            self.drop.discard(command)
+            return None
+        return reply
+
+
+class LevelUploadTest(unittest.TestCase):
+    def setUp(self):
+        self.board = SimBoard().start()
+
+    def tearDown(self):
+        self.board.stop()
+        self.board.directory.cleanup()
+
+    def eeprom_slot(self):
+        with open(self.board.eeprom, "rb") as f:
+            f.seek(LEVEL_SLOT_START)
+            return f.read(3 + len(LEVEL) + 2)
+
+    def test_ram(self):
+        result = Uploader(self.board.link).upload(LEVEL, 1, chunk=16)
+        self.assertEqual(result.status.state, LEVEL_STATE_STORED)
+        self.assertEqual((result.commands, result.resends), (5, 0))
+        self.assertEqual(result.status.stored_ms, result.status.playable_ms)
+        print("\n" + level_upload.report(result), file=sys.stderr)
+
+    def test_eeprom_survives_a_reset(self):
+        result = Uploader(self.board.link).upload(LEVEL, 2, LEVEL_TO_EEPROM)
+        self.assertEqual(result.status.state, LEVEL_STATE_STORED)
+        # 41 bytes at 3.4ms each
+        self.assertGreater(result.status.stored_ms,
+                           result.status.playable_ms + 100)
+        print("\n" + level_upload.report(result), file=sys.stderr)
+        self.board.restart()
+        slot = self.eeprom_slot()
+        self.assertEqual(slot[:3], bytes([LEVEL_MAGIC, 1, 2]))
+        self.assertEqual(slot[3:-2], LEVEL)
+        self.assertEqual(int.from_bytes(slot[-2:], "little"),
+                         crc_ccitt(LEVEL))
+
+        # The slot is cleared in the background after the ACK
+        Uploader(self.board.link).remove()
+        end = time.monotonic() + 1.0
+        while self.eeprom_slot()[0] != 0xFF and time.monotonic() < end:
+            time.sleep(0.01)
+        self.board.restart()
+        self.assertEqual(self.eeprom_slot()[0], 0xFF)
+
+    def test_lost_commands_and_answers(self):
+        uploader = LossyUploader(self.board.link, corrupt=[LEVEL_DATA],
+                                 drop=[LEVEL_FINISH])
+        result = uploader.upload(LEVEL, 0, chunk=16)
+        self.assertEqual(result.status.state, LEVEL_STATE_STORED)
+        self.assertEqual(result.resends, 2)
+
+    def test_lost_chunk_answer(self):
+        # The board has the chunk, so the resend is NAKed with where the
+        # next one starts
+        uploader = LossyUploader(self.board.link, drop=[LEVEL_DATA])
+        result = uploader.upload(LEVEL, 0, chunk=16)
+        self.assertEqual(result.status.state, LEVEL_STATE_STORED)
+        self.assertEqual(result.resends, 1)
+        self.assertEqual(self.board.link.request_stats().frame_errors, 0)
+
+    def test_refused(self):
+        unplayable = pack_level((0,) * 3, (0, 1), (0x0F,) * 3, 0x13)
+        with self.assertRaisesRegex(UploadError, "can't be played"):
+            Uploader(self.board.link).upload(unplayable, 0)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,175 @@
+"""
+test_loopback.py
+
+Author: Xinyi Li
+
+Talks to the simulated board over its serial port through framelink, on
+every frame channel: input frames drive the game and the state and stats
+frames show what happened, a level goes up over the bulk channel, and
+telemetry frames arrive mixed in with the terminal text.
+"""
+
+import os
+import struct
+import sys
+import time
+import unittest
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+
+from simboard import SimBoard  # noqa: E402
+import framelink  # noqa: E402
+from framelink import (FRAME_BULK, FRAME_TELEMETRY, KEY_LEFT,  # noqa: E402
+                       encode_frame)
+
+MODE_SPLASH = 0
+MODE_PLAYING = 1
+
+# level.h
+LEVEL_BEGIN, LEVEL_DATA, LEVEL_FINISH, LEVEL_REMOVE, LEVEL_STATUS = 1, 2, 3, 4, 5
+LEVEL_ACK, LEVEL_NAK = 0x06, 0x15
+LEVEL_ERROR_CRC, LEVEL_ERROR_UNPLAYABLE = 2, 3
+LEVEL_STATE_IDLE, LEVEL_STATE_STORED = 0, 3
+
+
+def level_bytes(lanes=(0x0F0F0F0F0F0F0F0F,) * 3, logs=(0x00FF00FF,) * 2,
+                vehicle_colours=(0x0F, 0x0F, 0x0F), log_colour=0x13):
+    return struct.pack("<3Q2I4B", *lanes, *logs, *vehicle_colours, log_colour)
+
+
+def wait_for_state(link, predicate, timeout=2.0):
+    end = time.monotonic() + timeout
+    while True:
+        state = link.request_state()
+        if predicate(state) or time.monotonic() > end:
+            return state
+        time.sleep(0.02)
+
+
+class LoopbackTest(unittest.TestCase):
+    def setUp(self):
+        self.board = SimBoard().start()
+        self.link = self.board.link
+
+    def tearDown(self):
+        self.board.stop()
+        self.board.directory.cleanup()
+
+    def bulk(self, *command):
+        reply = self.link.request(FRAME_BULK, bytes(command))
+        return reply
+
+    def start_game(self):
+        self.assertEqual(self.link.request_state().mode, MODE_SPLASH)
+        self.link.press_button(0)
+        state = wait_for_state(self.link, lambda s: s.mode == MODE_PLAYING)
+        self.assertEqual(state.mode, MODE_PLAYING)
+        return state
+
+    def test_input_moves_the_frog(self):
+        state = self.start_game()
+        self.assertEqual((state.frog_row, state.frog_column, state.score),
+                         (0, 7, 0))
+        # Along the riverbank, where nothing can hit the frog
+        self.link.send_keys([KEY_LEFT, KEY_LEFT])
+        state = wait_for_state(self.link, lambda s: s.frog_column == 5)
+        self.assertEqual((state.frog_row, state.frog_column), (0, 5))
+        self.link.send_keys("r")
+        state = wait_for_state(self.link, lambda s: s.frog_column == 6)
+        self.assertEqual(state.frog_column, 6)
+        self.link.send_keys("p")
+        self.assertEqual(wait_for_state(self.link, lambda s: s.paused).paused, 1)
+        self.link.send_keys("p")
+        self.assertEqual(
+            wait_for_state(self.link, lambda s: not s.paused).paused, 0)
+
+    def test_stats_count_frames(self):
+        before = self.link.request_stats()
+        self.link.request_state()
+        # A frame with a bad CRC is counted and otherwise ignored
+        bad = bytearray(encode_frame(framelink.FRAME_STATE))
+        bad[-2] ^= 0x40
+        self.link.write(bad)
+        after = self.link.request_stats()
+        self.assertEqual(after.frames_received, before.frames_received + 2)
+        self.assertEqual(after.frame_errors, before.frame_errors + 1)
+        self.assertEqual(after.frames_dropped, 0)
+        self.assertEqual(after.serial_dropped, 0)
+        self.assertGreater(after.serial_sent, before.serial_sent)
+        self.assertEqual(self.link.decoder.errors, 0)
+
+    def test_input_from_unknown_source(self):
+        state = self.start_game()
+        before = self.link.request_stats()
+        # The pair with a source that doesn't exist is counted as an error
+        # and the good pair after it still gets through
+        self.link.send_input((framelink.INPUT_JOYSTICK + 1, KEY_LEFT),
+                             (framelink.INPUT_SERIAL, KEY_LEFT))
+        state = wait_for_state(
+            self.link, lambda s: s.frog_column == state.frog_column - 1)
+        self.assertEqual(state.frog_column, 6)
+        time.sleep(0.1)
+        self.assertEqual(self.link.request_state().frog_column, 6)
+        after = self.link.request_stats()
+        self.assertEqual(after.frame_errors, before.frame_errors + 1)
+
+    def test_level_upload(self):
+        self.assertEqual(self.bulk(LEVEL_STATUS)[:3],
+                         bytes([LEVEL_ACK, LEVEL_STATUS, LEVEL_STATE_IDLE]))
+        level = level_bytes()
+        crc = framelink.crc_ccitt(level)
+        self.assertEqual(self.bulk(LEVEL_BEGIN, 1, 0, crc & 0xFF, crc >> 8),
+                         bytes([LEVEL_ACK, LEVEL_BEGIN, 0]))
+        self.assertEqual(self.bulk(LEVEL_DATA, 0, *level[:20]),
+                         bytes([LEVEL_ACK, LEVEL_DATA, 20]))
+        # A chunk that doesn't follow on is refused
+        self.assertEqual(self.bulk(LEVEL_DATA, 10, *level[10:20]),
+                         bytes([LEVEL_NAK, LEVEL_DATA, 20]))
+        self.assertEqual(self.bulk(LEVEL_DATA, 20, *level[20:]),
+                         bytes([LEVEL_ACK, LEVEL_DATA, len(level)]))
+        self.assertEqual(self.bulk(LEVEL_FINISH),
+                         bytes([LEVEL_ACK, LEVEL_FINISH, 0]))
+        status = self.bulk(LEVEL_STATUS)
+        self.assertEqual(status[:3],
+                         bytes([LEVEL_ACK, LEVEL_STATUS, LEVEL_STATE_STORED]))
+        upload_ms, playable_ms, stored_ms = struct.unpack("<3H", status[3:])
+        self.assertLessEqual(upload_ms, playable_ms)
+
+        # A bad CRC and a level that can't be played are refused
+        self.assertEqual(self.bulk(LEVEL_BEGIN, 1, 0, ~crc & 0xFF, crc >> 8)[0],
+                         LEVEL_ACK)
+        self.bulk(LEVEL_DATA, 0, *level)
+        self.assertEqual(self.bulk(LEVEL_FINISH),
+                         bytes([LEVEL_NAK, LEVEL_FINISH, LEVEL_ERROR_CRC]))
+        unplayable = level_bytes(logs=(0, 0x00FF00FF))
+        crc = framelink.crc_ccitt(unplayable)
+        self.bulk(LEVEL_BEGIN, 1, 0, crc & 0xFF, crc >> 8)
+        self.bulk(LEVEL_DATA, 0, *unplayable)
+        self.assertEqual(self.bulk(LEVEL_FINISH),
+                         bytes([LEVEL_NAK, LEVEL_FINISH, LEVEL_ERROR_UNPLAYABLE]))
+        self.assertEqual(self.bulk(LEVEL_REMOVE),
+                         bytes([LEVEL_ACK, LEVEL_REMOVE, 0]))
+
+    def test_telemetry_mixed_with_text(self):
+        self.start_game()
+        self.link.write(b":tele on\r")
+        channel, payload = self.link.next_frame(FRAME_TELEMETRY, timeout=2.0)
+        # The stream starts with a key record - every field
+        self.assertEqual(payload[1], 0xFF)
+        self.assertEqual(payload[2], 0x07)
+        frames = 1
+        end = time.monotonic() + 1.0
+        while time.monotonic() < end:
+            self.link.next_frame(FRAME_TELEMETRY, timeout=1.0)
+            frames += 1
+        # A record every 20ms, 10 to a frame
+        self.assertGreaterEqual(frames, 4)
+        self.link.write(b":tele off\r")
+        self.link.wait_for_text("telemetry off")
+        self.assertIn(b"telemetry on", self.link.text)
+        self.assertEqual(self.link.decoder.errors, 0)
+        self.assertEqual(self.link.request_stats().frames_dropped, 0)
+
+
+if __name__ == "__main__":
+    unittest.main()
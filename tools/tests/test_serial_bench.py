@@ -0,0 +1,67 @@
+"""
+test_serial_bench.py
+
+Author: Xinyi Li
+
+Runs the serial benchmark (serial_bench.py) at a few rates on the
+simulated board: at 19200 baud the board fills the line, a rate that
+can't be generated (or isn't a rate at all) is refused, and at 250000
+baud nothing is dropped and each byte costs one UDR Empty interrupt.
+"""
+
+import os
+import sys
+import unittest
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+sys.path.insert(0, os.path.dirname(os.path.dirname(
+    os.path.abspath(__file__))))
+
+from simboard import SimBoard  # noqa: E402
+import serial_bench  # noqa: E402
+
+SECONDS = 1.5
+
+
+def bench(rate):
+    with SimBoard() as board:
+        if not serial_bench.change_baud(board.link, rate):
+            return None
+        return serial_bench.measure(board.link, SECONDS, board.snapshot)
+
+
+class SerialBenchTest(unittest.TestCase):
+    def test_19200_fills_the_line(self):
+        result = bench(19200)
+        self.assertEqual(result["baud"], 19230)
+        self.assertGreater(result["sent"], 0.85 * result["baud"] / 10)
+        self.assertLess(result["udre_per_byte"], 1.1)
+
+    def test_115200_is_refused(self):
+        self.assertIsNone(bench(115200))
+
+    def test_bad_rates_are_refused(self):
+        with SimBoard() as board:
+            link = board.link
+            for command, answer in ((b"baud 0", b"0 baud can't be generated"),
+                                    (b"baud abc", b"abc isn't a baud rate"),
+                                    (b"baud 9600x", b"9600x isn't a baud"),
+                                    (b"baud -1", b"-1 isn't a baud rate")):
+                mark = len(link.text)
+                link.write(b":" + command + b"\r")
+                link.wait_for_text(answer, start=mark)
+                self.assertEqual(link.text.find(b"changing to", mark), -1)
+            link.write(b":baud\r")
+            link.wait_for_text(b"19230 baud", start=mark)
+
+    def test_250000_drops_nothing(self):
+        result = bench(250000)
+        self.assertEqual(result["baud"], 250000)
+        self.assertEqual(result["frames_dropped"], 0)
+        self.assertLess(result["udre_per_byte"], 1.1)
+        print(file=sys.stderr)
+        serial_bench.print_result(250000, result, file=sys.stderr)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,121 @@
+"""
+test_telemetry_decode.py
+
+Author: Xinyi Li
+
+Checks the telemetry decoder (telemetry_decode.py): on hand made frames,
+that a timeline is rebuilt from a key record on and that a gap or a
+broken record loses the state until the next key record; and on the
+simulated board, that the timeline follows the game.
+"""
+
+import os
+import struct
+import sys
+import time
+import unittest
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+sys.path.insert(0, os.path.dirname(os.path.dirname(
+    os.path.abspath(__file__))))
+
+from simboard import SimBoard  # noqa: E402
+from framelink import FRAME_TELEMETRY, KEY_LEFT  # noqa: E402
+from telemetry_decode import Timeline  # noqa: E402
+
+# Frog at row 0 column 7, lanes 1 2 3, logs 4 5, riverbank dddd, 15s
+# left, score 0, new game, level 0, 3 lives, playing
+KEY = struct.pack("<BBB3B2BHBIBBBB", 0xFF, 0x07, 0x07, 1, 2, 3, 4, 5, 0xDDDD,
+                  15, 0, 1 << 3, 0, 3, 1 << 1)
+IDLE = b"\0"
+MOVE_UP = bytes([0x41, 0x17, 0x01])		# frog to row 1, move event
+SCORE = bytes([0x20]) + struct.pack("<I", 10)
+
+
+def frame(number, *records):
+    return bytes([number % 256]) + b"".join(records)
+
+
+class TimelineTest(unittest.TestCase):
+    def test_rebuilds_the_state(self):
+        timeline = Timeline()
+        records = timeline.feed(frame(250, KEY, IDLE, MOVE_UP))
+        records += timeline.feed(frame(253, SCORE, IDLE))
+        self.assertEqual([r.number for r in records], [250, 251, 252, 253, 254])
+        first, last = records[0].state, records[-1].state
+        self.assertEqual((first["frog_row"], first["frog_column"]), (0, 7))
+        self.assertEqual(first["lanes"], (1, 2, 3))
+        self.assertEqual((first["mode"], first["paused"]), (1, 0))
+        self.assertEqual(records[2].events, 1)
+        self.assertEqual((last["frog_row"], last["score"]), (1, 10))
+        self.assertEqual(last["riverbank"], 0xDDDD)
+        self.assertEqual((timeline.gaps, timeline.errors), (0, 0))
+
+    def test_waits_for_a_key_record(self):
+        timeline = Timeline()
+        # Started part way through
+        self.assertEqual(timeline.feed(frame(7, IDLE, MOVE_UP)), [])
+        self.assertEqual(timeline.skipped, 2)
+        self.assertEqual(len(timeline.feed(frame(9, KEY, IDLE))), 2)
+
+    def test_gap_loses_the_state_until_a_key_record(self):
+        timeline = Timeline()
+        timeline.feed(frame(0, KEY, IDLE))
+        # Records 2 to 4 never arrive
+        self.assertEqual(timeline.feed(frame(5, MOVE_UP, IDLE)), [])
+        self.assertEqual((timeline.gaps, timeline.lost), (1, 3))
+        records = timeline.feed(frame(7, KEY, MOVE_UP))
+        self.assertEqual([r.index for r in records], [7, 8])
+        self.assertEqual(records[-1].state["frog_row"], 1)
+        self.assertEqual(timeline.resyncs, 1)
+
+    def test_broken_record(self):
+        timeline = Timeline()
+        timeline.feed(frame(0, KEY))
+        # The score is cut short - the idle record before it still counts
+        self.assertEqual(len(timeline.feed(frame(1, IDLE, SCORE[:3]))), 1)
+        self.assertEqual(timeline.errors, 1)
+        self.assertIsNone(timeline.state)
+        self.assertEqual(len(timeline.feed(frame(9, KEY))), 1)
+
+
+class BoardTelemetryTest(unittest.TestCase):
+    def test_timeline_follows_the_game(self):
+        timeline = Timeline()
+        with SimBoard() as board:
+            link = board.link
+            link.press_button(0)
+            time.sleep(0.3)
+            link.write(b":tele on\r")
+            frames = [link.next_frame(FRAME_TELEMETRY, timeout=2.0)[1]]
+            # Along the riverbank, where nothing can hit the frog
+            link.send_keys([KEY_LEFT])
+            end = time.monotonic() + 1.0
+            while time.monotonic() < end:
+                link.poll(0.05)
+            link.write(b":tele off\r")
+            link.wait_for_text("telemetry off")
+            # (Asking for the state would throw away the frames waiting)
+            frames += [payload for channel, payload in link.events
+                       if channel == FRAME_TELEMETRY]
+            state = link.request_state()
+        for payload in frames:
+            timeline.feed(payload)
+
+        self.assertEqual(timeline.records[0].state["mode"], 1)
+        # The new game started before telemetry was turned on, so the key
+        # record has no events
+        self.assertEqual(timeline.records[0].events, 0)
+        self.assertGreaterEqual(len(timeline.records), 50)
+        moves = [r for r in timeline.records if r.events & 1]
+        self.assertEqual(len(moves), 1)
+        last = timeline.records[-1].state
+        self.assertEqual((last["frog_row"], last["frog_column"]),
+                         (state.frog_row, state.frog_column))
+        self.assertEqual((timeline.gaps, timeline.errors), (0, 0))
+        # An idle record is 1 byte - about 85 bytes/s with the framing
+        self.assertLess(timeline.bytes_per_second(), 200)
+
+
+if __name__ == "__main__":
+    unittest.main()